@@ -0,0 +1,184 @@
+#include "accumulator.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+///egy darab összege, szélsőértékei és szorzata (első menet)
+static void chunkStats(const double* p, size_t n, double& sum, double& min, double& max, double& product){
+	size_t i = 0;
+	sum = 0;
+	min = std::numeric_limits<double>::infinity();
+	max = -std::numeric_limits<double>::infinity();
+	product = 1;
+#if defined(__AVX__)
+	__m256d s = _mm256_setzero_pd(), lo = _mm256_set1_pd(min), hi = _mm256_set1_pd(max), pr = _mm256_set1_pd(1);
+	for (; i + 4 <= n; i += 4) {
+		__m256d x = _mm256_loadu_pd(p + i);
+		s = _mm256_add_pd(s, x);
+		lo = _mm256_min_pd(lo, x);
+		hi = _mm256_max_pd(hi, x);
+		pr = _mm256_mul_pd(pr, x);
+	}
+	double lanes[4][4];
+	_mm256_storeu_pd(lanes[0], s);
+	_mm256_storeu_pd(lanes[1], lo);
+	_mm256_storeu_pd(lanes[2], hi);
+	_mm256_storeu_pd(lanes[3], pr);
+	sum = (lanes[0][0] + lanes[0][1]) + (lanes[0][2] + lanes[0][3]);
+	min = std::min(std::min(lanes[1][0], lanes[1][1]), std::min(lanes[1][2], lanes[1][3]));
+	max = std::max(std::max(lanes[2][0], lanes[2][1]), std::max(lanes[2][2], lanes[2][3]));
+	product = (lanes[3][0] * lanes[3][1]) * (lanes[3][2] * lanes[3][3]);
+#elif defined(__SSE2__)
+	__m128d s = _mm_setzero_pd(), lo = _mm_set1_pd(min), hi = _mm_set1_pd(max), pr = _mm_set1_pd(1);
+	for (; i + 2 <= n; i += 2) {
+		__m128d x = _mm_loadu_pd(p + i);
+		s = _mm_add_pd(s, x);
+		lo = _mm_min_pd(lo, x);
+		hi = _mm_max_pd(hi, x);
+		pr = _mm_mul_pd(pr, x);
+	}
+	double lanes[4][2];
+	_mm_storeu_pd(lanes[0], s);
+	_mm_storeu_pd(lanes[1], lo);
+	_mm_storeu_pd(lanes[2], hi);
+	_mm_storeu_pd(lanes[3], pr);
+	sum = lanes[0][0] + lanes[0][1];
+	min = std::min(lanes[1][0], lanes[1][1]);
+	max = std::max(lanes[2][0], lanes[2][1]);
+	product = lanes[3][0] * lanes[3][1];
+#endif
+	for (; i < n; i++) {
+		sum += p[i];
+		min = std::min(min, p[i]);
+		max = std::max(max, p[i]);
+		product *= p[i];
+	}
+}
+
+///egy darab értékeinek a megadott átlagtól vett eltérés-négyzetösszege (második menet)
+static double chunkSquares(const double* p, size_t n, double mean){
+	size_t i = 0;
+	double sq = 0;
+#if defined(__AVX__)
+	__m256d acc = _mm256_setzero_pd(), m = _mm256_set1_pd(mean);
+	for (; i + 4 <= n; i += 4) {
+		__m256d d = _mm256_sub_pd(_mm256_loadu_pd(p + i), m);
+		acc = _mm256_add_pd(acc, _mm256_mul_pd(d, d));
+	}
+	double lanes[4];
+	_mm256_storeu_pd(lanes, acc);
+	sq = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__SSE2__)
+	__m128d acc = _mm_setzero_pd(), m = _mm_set1_pd(mean);
+	for (; i + 2 <= n; i += 2) {
+		__m128d d = _mm_sub_pd(_mm_loadu_pd(p + i), m);
+		acc = _mm_add_pd(acc, _mm_mul_pd(d, d));
+	}
+	double lanes[2];
+	_mm_storeu_pd(lanes, acc);
+	sq = lanes[0] + lanes[1];
+#endif
+	for (; i < n; i++)
+		sq += (p[i] - mean) * (p[i] - mean);
+	return sq;
+}
+
+void Accumulator::combine(size_t count, double sum, double mean, double sq, double min, double max, double product){
+	if (count == 0)
+		return;
+	if (n == 0) {
+		n = count;
+		total = sum;
+		avg = mean;
+		m2 = sq;
+		lo = min;
+		hi = max;
+		prod = product;
+		return;
+	}
+	size_t all = n + count;
+	double delta = mean - avg;
+	avg += delta * ((double)count / (double)all);
+	m2 += sq + delta * delta * ((double)n * (double)count / (double)all);
+	n = all;
+	total += sum;
+	prod *= product;
+	//a NaN értékek is átjutnak (a feltétel NaN-ra hamis)
+	if (!(min >= lo))
+		lo = min;
+	if (!(max <= hi))
+		hi = max;
+}
+
+void Accumulator::add(double v){
+	if (ErrorValue::isError(v)) {
+		fail(v);
+		return;
+	}
+	n++;
+	double delta = v - avg;
+	avg += delta / (double)n;
+	m2 += delta * (v - avg);
+	total += v;
+	prod *= v;
+	if (!(v >= lo))
+		lo = v;
+	if (!(v <= hi))
+		hi = v;
+}
+
+void Accumulator::addRun(const double* p, size_t count){
+	for (size_t i = 0; i < count; i += CHUNK) {
+		size_t k = count - i < CHUNK ? count - i : CHUNK;
+		double sum, min, max, product;
+		chunkStats(p + i, k, sum, min, max, product);
+		if (std::isnan(sum)) { //NaN (pl. hibaérték) a darabban: értékenként dolgozzuk fel
+			for (size_t j = i; j < i + k; j++)
+				add(p[j]);
+			continue;
+		}
+		double mean = sum / (double)k;
+		combine(k, sum, mean, chunkSquares(p + i, k, mean), min, max, product);
+	}
+}
+
+void Accumulator::addRepeated(double v, size_t count){
+	if (ErrorValue::isError(v)) {
+		fail(v);
+		return;
+	}
+	combine(count, v * (double)count, v, 0, v, v, std::pow(v, (double)count));
+}
+
+double Accumulator::stddev() const {
+	return failed ? error : std::sqrt(variance());
+}
+
+void AggregateCache::end(){
+	std::lock_guard<std::mutex> lock(mutex);
+	active = false;
+	entries.clear();
+}
+
+bool AggregateCache::find(const CellRect& r, Accumulator& acc){
+	if (!active)
+		return false;
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = entries.find(keyOf(r));
+	if (it == entries.end())
+		return false;
+	acc = it->second;
+	return true;
+}
+
+void AggregateCache::store(const CellRect& r, const Accumulator& acc){
+	if (!active || (size_t)(r.col2 - r.col1 + 1) * (size_t)(r.row2 - r.row1 + 1) < MIN_AREA)
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	entries.emplace(keyOf(r), acc);
+}
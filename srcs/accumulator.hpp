@@ -0,0 +1,97 @@
+#ifndef ACCUMULATOR_HPP
+#define ACCUMULATOR_HPP
+
+#include <cstddef>
+#include <map>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <limits>
+
+#include "dependency.hpp"
+#include "exceptions.hpp"
+
+///Tartományon végzett összesítő függvények (sum, avg, min, max, count, product, var, stddev) közös, egymenetes számolója
+/**
+Az értékeket egyenként (add) vagy összefüggő tömbként (addRun) kapja, és egyszerre vezeti
+a darabszámot, az összeget, a szorzatot, a minimumot, a maximumot, valamint az átlagot és az
+átlagtól vett eltérések négyzetösszegét. Így egy tartomány egyetlen bejárása után bármelyik
+összesítés kiolvasható, több függvény ugyanazon a tartományon egy bejáráson osztozhat.
+
+A szórásnégyzethez a naiv Σx² - (Σx)²/n képlet helyett az átlag és az eltérés-négyzetösszeg
+numerikusan stabil, online frissítését használja (Welford): nagy, egymáshoz közeli értékek
+esetén sem vész el a különbségük. A tömbök darabjait vektorizáltan két menetben dolgozza fel
+(összeg, szélsőértékek és szorzat, majd a darab átlagától vett eltérések), a darabokat pedig
+a részeredmények összevonásával (Chan-féle párhuzamos képlet) adja az eddigiekhez.
+
+A hibaértékeket (ld. ErrorValue) nem számolja bele az összesítésbe: a count csak a nem hibás
+értékeket számolja, a többi függvény eredménye az első előforduló hibaérték. Ha maga a
+tartomány hibás (pl. kilóg a táblából, ld. failRange), a count is a hibaértéket adja.
+*/
+class Accumulator {
+	size_t n = 0; ///<a nem hibás értékek száma
+	double total = 0; ///<az értékek összege
+	double avg = 0; ///<az értékek átlaga (online frissítve)
+	double m2 = 0; ///<az átlagtól vett eltérések négyzetösszege
+	double lo = std::numeric_limits<double>::infinity(); ///<legkisebb érték
+	double hi = -std::numeric_limits<double>::infinity(); ///<legnagyobb érték
+	double prod = 1; ///<az értékek szorzata
+	double error = 0; ///<az első hibaérték
+	bool failed = false; ///<volt-e hibaérték
+	bool rangeError = false; ///<a tartomány maga hibás, ekkor a count is a hibaértéket adja
+
+	///egy másik összesítés részeredményeinek hozzávétele
+	void combine(size_t count, double sum, double mean, double sq, double min, double max, double product);
+	void fail(double v) {if (!failed) {failed = true; error = v;}} ///<hibaérték rögzítése
+public:
+	static const size_t CHUNK = 512; ///<a tömbök ekkora darabjait dolgozza fel egyben (a második menethez a darab a gyorsítótárban marad)
+
+	void add(double v); ///<egy érték hozzávétele
+	void addRun(const double* p, size_t count); ///<összefüggő tömb értékeinek hozzávétele vektorizáltan
+	void addRepeated(double v, size_t count); ///<ugyanannak az értéknek count-szoros hozzávétele (pl. egy nem írt csempe)
+	void failRange(double v) {fail(v); rangeError = true;} ///<a tartomány egészének hibája (pl. kilóg a táblából)
+	void merge(const Accumulator& other) {
+		if (other.failed)
+			fail(other.error);
+		rangeError = rangeError || other.rangeError;
+		combine(other.n, other.total, other.avg, other.m2, other.lo, other.hi, other.prod);
+	} ///<egy másik számoló értékeinek hozzávétele
+
+	bool isEmpty() const {return n == 0 && !failed;} ///<igaz, ha még nem kapott értéket
+	double count() const {return rangeError ? error : (double)n;} ///<a nem hibás értékek száma (hibás tartománynál a hibaérték)
+	double sum() const {return failed ? error : total;} ///<összeg
+	double mean(double cells) const {return failed ? error : total / cells;} ///<átlag a megadott számú cellára (az avg a tartomány minden cellájával oszt)
+	double min() const {return failed ? error : lo;} ///<legkisebb érték
+	double max() const {return failed ? error : hi;} ///<legnagyobb érték
+	double product() const {return failed ? error : prod;} ///<szorzat
+	///korrigált (mintabeli) szórásnégyzet, egyetlen értékre 0
+	double variance() const {return failed ? error : n < 2 ? 0 : m2 / (double)(n - 1);}
+	double stddev() const; ///<korrigált (mintabeli) szórás
+};
+
+///Egy újraszámolás alatt a nagy tartományok összesítéseit megosztó gyorsítótár
+/**
+Ha egy újraszámolásban (ld. Sheet::recalculate) több cella ugyanazon a tartományon végez
+összesítést (pl. az egyik a min-t, a másik a stddev-et kéri), a tartományt csak egyszer kell
+bejárni. Az újraszámolás a tartományok celláit a rájuk hivatkozó cellák előtt kiszámolja, és
+közben a tábla nem változik, így a tárolt összesítés végig érvényes. A gyorsítótár csak az
+újraszámolás alatt aktív (begin, end), és csak legalább MIN_AREA cellás tartományokat tárol, a
+kisebbeket olcsóbb újra bejárni. A lekérdezés több szálról is érkezhet, ezt egy mutex védi.
+*/
+class AggregateCache {
+	std::map<std::array<unsigned int, 4>, Accumulator> entries; ///<a tárolt összesítések a tartományok sarkai szerint
+	std::mutex mutex; ///<az entries védelme
+	std::atomic<bool> active{false}; ///<tart-e újraszámolás
+	static std::array<unsigned int, 4> keyOf(const CellRect& r) {return {r.col1, r.row1, r.col2, r.row2};} ///<a tartomány kulcsa
+public:
+	static const size_t MIN_AREA = 1024; ///<ennél kisebb tartományt nem tárolunk
+
+	void begin() {active = true;} ///<újraszámolás kezdete
+	void end(); ///<újraszámolás vége, a tárolt összesítések eldobása
+	///ha a tartomány összesítése tárolva van, acc-ba másolja
+	/**@return hamis, ha nincs tárolva (vagy a gyorsítótár nem aktív)*/
+	bool find(const CellRect& r, Accumulator& acc);
+	void store(const CellRect& r, const Accumulator& acc); ///<a tartomány összesítésének tárolása (ha a gyorsítótár aktív és a tartomány elég nagy)
+};
+
+#endif
@@ -0,0 +1,142 @@
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+
+#include "arena.hpp"
+
+#ifdef __SANITIZE_ADDRESS__
+#include <sanitizer/asan_interface.h>
+#define POISON(p, size) ASAN_POISON_MEMORY_REGION(p, size)
+#define UNPOISON(p, size) ASAN_UNPOISON_MEMORY_REGION(p, size)
+#else
+#define POISON(p, size) ((void)(p), (void)(size))
+#define UNPOISON(p, size) ((void)(p), (void)(size))
+#endif
+
+
+thread_local NodeArena* NodeArena::active = nullptr;
+
+NodeArena& NodeArena::global(){
+	//szándékosan sosem szabadul fel, hogy a statikus objektumok destruktorai is használhassák
+	static NodeArena* arena = new NodeArena(new std::mutex);
+	return *arena;
+}
+
+void* NodeArena::allocate(size_t size){
+	if (size > MAX_NODE)
+		return ::operator new(size);
+	return (active ? active : &global())->alloc(size);
+}
+
+void NodeArena::release(void* p, size_t size){
+	if (p == nullptr)
+		return;
+	if (size > MAX_NODE) {
+		::operator delete(p);
+		return;
+	}
+	Chunk* chunk = reinterpret_cast<Chunk*>(reinterpret_cast<std::uintptr_t>(p) & ~(std::uintptr_t)(CHUNK_SIZE - 1));
+	NodeArena* owner = chunk->owner;
+	owner->free(p, size);
+	if (owner->retired && owner->stats.nodes == 0)
+		delete owner;
+}
+
+void NodeArena::retire(){
+	if (stats.nodes == 0)
+		delete this;
+	else
+		retired = true;
+}
+
+void NodeArena::merge(NodeArena& other){
+	while (Chunk* chunk = other.chunks) {
+		other.chunks = chunk->next;
+		chunk->owner = this;
+		chunk->next = chunks;
+		chunks = chunk;
+	}
+	//a másik szabadlistáit a sajátjaink elé fűzzük (a listaelemek a bejárás idejére elérhetők)
+	for (size_t cls = 0; cls < MAX_NODE / GRANULE; cls++) {
+		FreeNode* tail = other.freeLists[cls];
+		if (tail == nullptr)
+			continue;
+		size_t size = (cls + 1) * GRANULE;
+		UNPOISON(tail, size);
+		while (tail->next) {
+			FreeNode* next = tail->next;
+			POISON(tail, size);
+			tail = next;
+			UNPOISON(tail, size);
+		}
+		tail->next = freeLists[cls];
+		POISON(tail, size);
+		freeLists[cls] = other.freeLists[cls];
+		other.freeLists[cls] = nullptr;
+	}
+	//a másik aktuális blokkjának maradéka kihasználatlan marad
+	other.bump = other.bumpEnd = nullptr;
+	stats.chunks += other.stats.chunks;
+	stats.nodes += other.stats.nodes;
+	stats.allocations += other.stats.allocations;
+	other.stats = Stats();
+}
+
+void* NodeArena::alloc(size_t size){
+	std::unique_lock<std::mutex> guard;
+	if (lock)
+		guard = std::unique_lock<std::mutex>(*lock);
+	size_t cls = (size + GRANULE - 1) / GRANULE;
+	size_t rounded = cls * GRANULE;
+	stats.nodes++;
+	stats.allocations++;
+	if (FreeNode* node = freeLists[cls-1]) {
+		UNPOISON(node, rounded);
+		freeLists[cls-1] = node->next;
+		return node;
+	}
+	if (bump == nullptr || bump + rounded > bumpEnd) {
+		void* mem = std::aligned_alloc(CHUNK_SIZE, CHUNK_SIZE);
+		if (mem == nullptr)
+			throw std::bad_alloc();
+		Chunk* chunk = static_cast<Chunk*>(mem);
+		chunk->owner = this;
+		chunk->next = chunks;
+		chunks = chunk;
+		stats.chunks++;
+		//a fejléc után az első csomópont is GRANULE-ra igazítva kezdődik
+		bump = static_cast<char*>(mem) + (sizeof(Chunk) + GRANULE - 1) / GRANULE * GRANULE;
+		bumpEnd = static_cast<char*>(mem) + CHUNK_SIZE;
+		POISON(bump, (size_t)(bumpEnd - bump));
+	}
+	void* p = bump;
+	bump += rounded;
+	UNPOISON(p, rounded);
+	return p;
+}
+
+void NodeArena::free(void* p, size_t size){
+	std::unique_lock<std::mutex> guard;
+	if (lock)
+		guard = std::unique_lock<std::mutex>(*lock);
+	size_t cls = (size + GRANULE - 1) / GRANULE;
+	stats.nodes--;
+	//a lemondott NodeArena-ból már nem foglalunk, a blokkjai az utolsó csomóponttal együtt
+	//egyben szabadulnak fel, így a csomópontot nem kell a szabadlistára fűzni
+	if (!retired) {
+		FreeNode* node = static_cast<FreeNode*>(p);
+		node->next = freeLists[cls-1];
+		freeLists[cls-1] = node;
+	}
+	POISON(p, cls * GRANULE);
+}
+
+NodeArena::~NodeArena(){
+	while (chunks) {
+		Chunk* next = chunks->next;
+		UNPOISON(chunks, CHUNK_SIZE);
+		std::free(chunks);
+		chunks = next;
+	}
+	delete lock;
+}
@@ -0,0 +1,90 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <mutex>
+
+///Kifejezésfák csomópontjainak memóriáját kezelő osztály
+/**
+A kifejezések csomópontjai kicsik (16-64 bájt), és egy nagy tábla betöltésekor milliószámra
+jönnek létre és szűnnek meg. A NodeArena ezeket nagy, CHUNK_SIZE méretű, CHUNK_SIZE-ra
+igazított blokkokból osztja ki egyszerű mutatóléptetéssel, a felszabadított csomópontokat
+pedig méretosztályonként egy szabadlistára fűzi, ahonnan a következő azonos méretű
+foglalás újra felhasználja őket. Minden blokk elején ott van a tulajdonos NodeArena címe,
+így egy csomópont felszabadításakor a címéből (a blokk kezdetére kerekítve) megtudjuk, hova
+kell visszaadni. A MAX_NODE-nál nagyobb foglalásokat a szokásos operator new szolgálja ki.
+
+Minden Sheet-nek saját NodeArena-ja van: a tábla függvényei egy Scope objektummal jelölik
+ki, hogy az adott szálon létrejövő csomópontok a tábla blokkjaiba kerüljenek. A tábla
+megszűnésekor (vagy értékadásakor) a blokkok egyszerre szabadulnak fel (retire). Mivel a
+kifejezésfákat a táblák megoszthatják egymással (ld. ExprPointer), egy NodeArena csomópontjai
+túlélhetik a táblát: ekkor a blokkok az utolsó csomópont felszabadításakor szűnnek meg. A Scope-on kívül
+létrehozott csomópontok egy közös, mutexszel védett globális NodeArena-ból származnak; a
+táblák saját NodeArena-ját csak egy szálról szabad módosítani.
+*/
+class NodeArena {
+public:
+	static const size_t CHUNK_SIZE = 64 * 1024; ///<egy blokk mérete (és igazítása)
+	static const size_t GRANULE = 16; ///<a méretosztályok lépésköze
+	static const size_t MAX_NODE = 256; ///<az ennél nagyobb foglalások nem a blokkokból jönnek
+	///foglalási statisztika
+	struct Stats {
+		size_t chunks = 0; ///<lefoglalt blokkok száma (ennyiszer kértünk memóriát a rendszertől)
+		size_t nodes = 0; ///<élő csomópontok száma
+		size_t allocations = 0; ///<összes csomópontfoglalás száma
+	};
+	///az adott szálon a hatókör végéig a megadott NodeArena-ból foglalnak a csomópontok
+	/**nullptr megadásakor a korábban aktív NodeArena marad érvényben*/
+	class Scope {
+		NodeArena* prev; ///<a korábban aktív NodeArena
+	public:
+		explicit Scope(NodeArena* arena) : prev(active) {if (arena) active = arena;} ///<konstruktor
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+		~Scope() {active = prev;} ///<visszaállítja a korábban aktív NodeArena-t
+	};
+private:
+	///blokk fejléce, a blokk elején helyezkedik el
+	struct Chunk {
+		NodeArena* owner; ///<a blokk tulajdonosa
+		Chunk* next; ///<a tulajdonos következő blokkja
+	};
+	///felszabadított csomópont a szabadlistán
+	struct FreeNode {
+		FreeNode* next; ///<következő szabad csomópont
+	};
+	FreeNode* freeLists[MAX_NODE / GRANULE] = {}; ///<méretosztályonként a szabad csomópontok
+	Chunk* chunks = nullptr; ///<a lefoglalt blokkok listája
+	char* bump = nullptr; ///<az aktuális blokk első szabad bájtja
+	char* bumpEnd = nullptr; ///<az aktuális blokk vége
+	Stats stats; ///<foglalási statisztika
+	std::mutex* lock; ///<több szálról használt NodeArena-nál a hozzáférést védi (különben nullptr)
+	bool retired = false; ///<a tulajdonos már lemondott róla, az utolsó csomóponttal együtt szűnik meg
+
+	static thread_local NodeArena* active; ///<az adott szálon aktív NodeArena (nullptr esetén a globális)
+	explicit NodeArena(std::mutex* lock) : lock(lock) {} ///<konstruktor a globális NodeArena-hoz
+
+	void* alloc(size_t size); ///<foglalás ebből a NodeArena-ból
+	void free(void* p, size_t size); ///<csomópont visszaadása ennek a NodeArena-nak
+public:
+	NodeArena() : lock(nullptr) {} ///<konstruktor
+	NodeArena(const NodeArena&) = delete;
+	NodeArena& operator=(const NodeArena&) = delete;
+	~NodeArena(); ///<az összes blokkot egyszerre felszabadítja
+	const Stats& getStats() const {return stats;} ///<foglalási statisztika lekérdezése
+	///a dinamikusan foglalt NodeArena tulajdonosa lemond róla
+	/**Ha nincs élő csomópontja, azonnal felszabadul, különben az utolsó csomópont felszabadításakor.
+	Ezután a felszabadított csomópontok már nem kerülnek szabadlistára, ezért ha a tulajdonos a saját
+	fáit csak a retire után engedi el, a blokkok csomópontonkénti könyvelés nélkül, egyben szűnnek meg.*/
+	void retire();
+	///átveszi a másik NodeArena összes blokkját és szabad csomópontját, a másik üres marad
+	/**Így a párhuzamosan, szálanként külön NodeArena-ba épített fák utólag egy tábla
+	NodeArena-jába kerülhetnek. Egyik NodeArena-t sem használhatja közben más szál.*/
+	void merge(NodeArena& other);
+
+	static NodeArena& global(); ///<a Scope-on kívül használt közös NodeArena
+	static void* allocate(size_t size); ///<foglalás az adott szálon aktív NodeArena-ból
+	static void release(void* p, size_t size); ///<csomópont felszabadítása (a tulajdonos NodeArena-nak adja vissza)
+};
+
+#endif
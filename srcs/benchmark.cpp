@@ -0,0 +1,534 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
+
+#include "sheet.hpp"
+#include "parser.hpp"
+#include "threadpool.hpp"
+#include "console.hpp"
+#include "mappedfile.hpp"
+#include "snapshot.hpp"
+
+static size_t allocCount = 0; ///<a globális operator new hívásainak száma
+static size_t allocBytes = 0; ///<a globális operator new által kért bájtok száma
+
+void* operator new(size_t size) {
+	allocCount++;
+	allocBytes += size;
+	if (void* p = std::malloc(size == 0 ? 1 : size))
+		return p;
+	throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept {std::free(p);}
+void operator delete(void* p, size_t) noexcept {std::free(p);}
+
+///egy függvény futási ideje másodpercben
+static double measure(const std::function<void()>& fn) {
+	auto start = std::chrono::steady_clock::now();
+	fn();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+///egy w×h méretű tábla, amelynek minden sora az előzőre hivatkozik, minden ötödik oszlopban egy teljes soros összeggel
+static Sheet layeredSheet(unsigned int w, unsigned int h) {
+	Sheet sh(w, h, 1);
+	std::string last = Sheet::colLetter(w);
+	for (unsigned int row = 1; row < h; row++) {
+		std::string prev = std::to_string(row);
+		for (unsigned int col = 0; col < w; col++) {
+			std::string f = col%5 == 0
+				? "sum(a" + prev + ":" + last + prev + ")/" + std::to_string(w)
+				: Sheet::colLetter(col+1) + prev + "/2+" + Sheet::colLetter((col+7)%w+1) + prev + "*0.75";
+			Parser(f).parseTo(&sh, sh[row][col]);
+		}
+	}
+	return sh;
+}
+
+///teljes újraszámolás ideje különböző szálszámokkal
+static void benchRecalculate() {
+	std::cout << "== recalculate: 100x2000 layered sheet ==" << std::endl;
+	Sheet base = layeredSheet(100, 2000);
+	double serial = 0;
+	for (size_t threads = 1; threads <= std::thread::hardware_concurrency() || threads == 1; threads *= 2) {
+		ThreadPool pool(threads);
+		Sheet sh(base);
+		double t = measure([&]{sh.recalculate(pool);});
+		if (threads == 1)
+			serial = t;
+		std::cout << std::setw(3) << threads << " threads: " << std::fixed << std::setprecision(4)
+			<< t << " s, speedup " << std::setprecision(2) << serial / t << "x" << std::endl;
+	}
+}
+
+///mély aritmetikai képlet kiértékelése a fán, illetve lefordított utasítássorozatként
+static void benchBytecode() {
+	std::cout << "== bytecode: 200-term formula, 100000 evaluations ==" << std::endl;
+	Sheet sh(10, 10, 1.5);
+	std::string f = "a1";
+	for (unsigned int i = 0; i < 200; i++)
+		f += (i%4 == 0 ? "+" : i%4 == 1 ? "*" : i%4 == 2 ? "-" : "/") + Sheet::colLetter(i%10+1) + std::to_string(i/10%10+1);
+	Expression* expr = Parser(f).parse();
+	EvalContext::Scope scope(sh.getContext());
+	Bytecode* bc = Bytecode::compile(*expr);
+	const int n = 100000;
+	double sink = 0;
+	double tree = measure([&]{for (int i = 0; i < n; i++) sink += expr->eval();});
+	double vm = measure([&]{for (int i = 0; i < n; i++) sink += bc->run();});
+	std::cout << "tree: " << std::fixed << std::setprecision(4) << tree << " s, bytecode: " << vm
+		<< " s, speedup " << std::setprecision(2) << tree / vm << "x (" << bc->size() << " instructions)" << std::endl;
+	if (sink == 0)
+		std::cout << std::endl;
+	delete bc;
+	delete expr;
+}
+
+///generált, redundáns képlet kiértékelése egyszerűsítés nélkül és egyszerűsítve
+static void benchOptimizer() {
+	std::cout << "== optimizer: 100-term generated formula, 100000 evaluations ==" << std::endl;
+	Sheet sh(10, 10, 1.5);
+	std::string f = "0";
+	for (unsigned int i = 0; i < 100; i++)
+		f += "+(" + Sheet::colLetter(i%10+1) + std::to_string(i/10+1) + "*1+(2*3)-0)/1+-" + Sheet::colLetter(i%10+1) + "1";
+	Expression* raw = Parser(f).parse();
+	Expression* opt = Parser(f).parse()->optimize();
+	EvalContext::Scope scope(sh.getContext());
+	const int n = 100000;
+	double sink = 0;
+	double tRaw = measure([&]{for (int i = 0; i < n; i++) sink += raw->eval();});
+	double tOpt = measure([&]{for (int i = 0; i < n; i++) sink += opt->eval();});
+	std::cout << "raw: " << std::fixed << std::setprecision(4) << tRaw << " s, optimized: " << tOpt
+		<< " s, speedup " << std::setprecision(2) << tRaw / tOpt << "x" << std::endl;
+	if (sink == 0)
+		std::cout << std::endl;
+	delete raw;
+	delete opt;
+}
+
+///1M számot tartalmazó tartomány összegzése cellánkénti kiértékeléssel, illetve az oszlopfolytonos tömbből
+static void benchRangeSum() {
+	std::cout << "== range sum: 10x100000 numeric cells ==" << std::endl;
+	Sheet sh(10, 100000, 0.5);
+	CellRect all = {1, 1, 10, 100000};
+	const int n = 20;
+	double sink = 0;
+	double perCell = measure([&]{
+		for (int i = 0; i < n; i++) {
+			for (unsigned int row = all.row1; row <= all.row2; row++)
+				for (unsigned int col = all.col1; col <= all.col2; col++)
+					sink += sh.parseCell(col, row)->evalMe();
+		}
+	});
+	double plane = measure([&]{for (int i = 0; i < n; i++) sink += sh.rangeSum(all);});
+	double bytes = 1e6 * sizeof(double) * n;
+	std::cout << "per cell: " << std::fixed << std::setprecision(4) << perCell << " s, plane: " << plane
+		<< " s (" << std::setprecision(2) << bytes / plane / 1e9 << " GB/s), speedup " << perCell / plane << "x" << std::endl;
+	if (sink == 0)
+		std::cout << std::endl;
+}
+
+///sok, egymással átfedő téglalapon számolt összeg újraszámolása összegtábla nélkül és összegtáblával
+static void benchSumIndex() {
+	std::cout << "== sum index: 1000 sums over a 20x5000 block ==" << std::endl;
+	Sheet base(21, 5000, 1.25);
+	for (unsigned int row = 1; row <= 1000; row++) {
+		std::string f = "sum(a" + std::to_string(row) + ":t" + std::to_string(row + 3000) + ")";
+		Parser(f).parseTo(&base, base[row-1][20]);
+	}
+	ThreadPool pool(1);
+	Sheet scan(base);
+	double tScan = measure([&]{scan.recalculate(pool);});
+	Sheet indexed(base);
+	indexed.setSumIndex({1, 1, 20, 5000});
+	double tIndexed = measure([&]{indexed.recalculate(pool);});
+	std::cout << "scan: " << std::fixed << std::setprecision(4) << tScan << " s, indexed: " << tIndexed
+		<< " s, speedup " << std::setprecision(2) << tScan / tIndexed << "x" << std::endl;
+}
+
+///nagy csv fájl betöltése: idő, a globális operator new hívásainak száma és a kért memória
+static void benchLoad() {
+	std::cout << "== load: 100x5000 csv (numbers and formulas) ==" << std::endl;
+	const unsigned int w = 100, h = 5000;
+	{
+		std::ofstream f("bench_load.csv");
+		for (unsigned int row = 1; row <= h; row++) {
+			for (unsigned int col = 1; col <= w; col++) {
+				if (row > 1 && col % 4 == 0)
+					f << Sheet::colLetter(col - 1) << row - 1 << "*2+" << Sheet::colLetter(col) << row - 1;
+				else if (row > 1 && col % 10 == 5)
+					f << "sum(a" << row - 1 << ":d" << row - 1 << ")";
+				else
+					f << row * col % 97 << "." << col % 10;
+				f << ",";
+			}
+			f << "\n";
+		}
+	}
+	std::stringstream oss, iss;
+	Console con(oss, iss);
+	iss << "load bench_load";
+	size_t count = allocCount, bytes = allocBytes;
+	size_t heap = mallinfo2().uordblks + mallinfo2().hblkhd;
+	double t = measure([&]{con.readCommand();});
+	double inUse = (double)(mallinfo2().uordblks + mallinfo2().hblkhd - heap);
+	std::cout << std::fixed << std::setprecision(4) << t << " s, " << allocCount - count << " operator new calls, "
+		<< std::setprecision(1) << (double)(allocBytes - bytes) / 1e6 << " MB requested, "
+		<< inUse / 1e6 << " MB heap in use after load" << std::endl;
+	iss.clear();
+	iss << "new 1 1";
+	t = measure([&]{con.readCommand();});
+	std::cout << "release: " << std::setprecision(4) << t << " s" << std::endl;
+	MappedFile file("bench_load.csv");
+	double serial = 0;
+	for (size_t threads = 1; threads <= std::thread::hardware_concurrency() || threads == 1; threads *= 2) {
+		ThreadPool pool(threads);
+		Sheet sh;
+		t = measure([&]{sh = Sheet::fromCsv(file.view(), pool);});
+		if (threads == 1)
+			serial = t;
+		std::cout << std::setw(3) << threads << " threads: " << std::fixed << std::setprecision(4) << t << " s, "
+			<< std::setprecision(1) << (double)file.view().size() / 1e6 / t << " MB/s, speedup "
+			<< std::setprecision(2) << serial / t << "x" << std::endl;
+	}
+	std::remove("bench_load.csv");
+}
+
+///tábla másolása, átméretezése és kitöltése (pull) fele-fele arányban konstans és képletcellákkal
+static void benchCopy() {
+	std::cout << "== copy: 100x5000 sheet, half constants ==" << std::endl;
+	Sheet base(100, 5000, 1.5);
+	for (unsigned int row = 2; row <= 5000; row++)
+		for (unsigned int col = 1; col <= 100; col += 2)
+			Parser(Sheet::colLetter(col) + std::to_string(row - 1) + "+1").parseTo(&base, base[row-1][col-1]);
+	double tCopy = measure([&]{Sheet cpy(base);});
+	Sheet numbers(100, 5000);
+	for (unsigned int row = 0; row < 5000; row++)
+		for (unsigned int col = 0; col < 100; col++)
+			numbers[row][col] = new NumberExpr(row + col);
+	double tNumbers = measure([&]{Sheet cpy(numbers);});
+	Sheet sh(base);
+	double tResize = measure([&]{sh.resize(100, 5001);});
+	std::stringstream oss, iss;
+	Console con(Sheet(100, 5000, 2), oss, iss);
+	iss << "pull a1 cv5000";
+	double tPull = measure([&]{con.readCommand();});
+	std::cout << "copy: " << std::fixed << std::setprecision(4) << tCopy << " s, copy of constants only: " << tNumbers << " s, resize: " << tResize
+		<< " s, pull of a constant: " << tPull << " s" << std::endl;
+}
+
+///sorok hozzáfűzése egyenként (appendRow), összevetve a soronkénti átméretezéssel
+static void benchAppend() {
+	std::cout << "== append: rows of 100 cells to a 100x1000 sheet ==" << std::endl;
+	Sheet grown(100, 1000);
+	double tResize = measure([&]{
+		for (size_t row = 0; row < 200; row++)
+			grown.resize(100, grown.getHeight() + 1, 1);
+	});
+	Sheet appended(100, 1000);
+	double tAppend = measure([&]{
+		for (size_t row = 0; row < 20000; row++)
+			appended.appendRow(1);
+	});
+	double tMove = measure([&]{Sheet moved(std::move(appended));});
+	std::cout << "resize: " << std::fixed << std::setprecision(2) << tResize / 200 * 1e6 << " us/row, append: "
+		<< tAppend / 20000 * 1e6 << " us/row, move of the 100x21000 sheet: " << std::setprecision(4) << tMove << " s" << std::endl;
+}
+
+///egy nagy, többnyire üres tábla létrehozása, kitöltése és összegzése ritka elrendezésben
+static void benchSparse() {
+	std::cout << "== sparse: 10000x10000 sheet with 1000 populated cells ==" << std::endl;
+	size_t bytes = allocBytes;
+	Sheet sh;
+	double tCreate = measure([&]{sh = Sheet(10000, 10000, 0, CellTable::SPARSE);});
+	double tWrite = measure([&]{
+		for (size_t i = 0; i < 1000; i++)
+			Parser(std::to_string(i)).parseTo(&sh, sh[i*7 % 10000][i*13 % 10000]);
+	});
+	size_t used = allocBytes - bytes;
+	double sum = 0;
+	double tSum = measure([&]{sum = sh.rangeSum({1, 1, 10000, 10000});});
+	std::cout << "create: " << std::fixed << std::setprecision(4) << tCreate << " s, 1000 writes: " << tWrite
+		<< " s, full-sheet sum: " << tSum << " s (" << std::setprecision(0) << sum << "), "
+		<< sh.allocatedTiles() << " tiles, " << std::setprecision(1) << (double)used / (1 << 20) << " MB allocated" << std::endl;
+}
+
+///egy oszlop kitöltése (pull) egyetlen relatív képlettel: idő, memória és a tábla csomópontjainak száma
+static void benchFill() {
+	std::cout << "== fill: pull of one formula over a 4x1000000 column ==" << std::endl;
+	std::stringstream oss, iss;
+	Console con(oss, iss);
+	iss << "new 4 1000000 set b1 a1*2+sum(c1:d1)/$a$1 ";
+	for (int i = 0; i < 2; i++) {con.readCommand();}
+	iss << "pull b1 b1000000 ";
+	size_t heap = mallinfo2().uordblks + mallinfo2().hblkhd;
+	double t = measure([&]{con.readCommand();});
+	double inUse = (double)(mallinfo2().uordblks + mallinfo2().hblkhd - heap);
+	std::cout << std::fixed << std::setprecision(4) << t << " s, " << std::setprecision(1) << inUse / 1e6
+		<< " MB heap growth, " << con.getSheet().getArena()->getStats().nodes << " expression nodes" << std::endl;
+	t = measure([&]{con.getSheet().recalculate();});
+	std::cout << "recalculate: " << std::setprecision(4) << t << " s" << std::endl;
+}
+
+///vegyes (szám, hivatkozás, függvény) képletek értelmezésének átbocsátása
+static void benchParse() {
+	std::cout << "== parse: 500000 mixed formulas ==" << std::endl;
+	std::vector<std::string> formulas;
+	for (unsigned int i = 0; i < 500000; i++) {
+		std::string a = Sheet::colLetter(i%50 + 1) + std::to_string(i%1000 + 1);
+		std::string b = Sheet::colLetter((i*7)%50 + 1) + std::to_string((i*13)%1000 + 1);
+		switch (i % 4) {
+			case 0: formulas.push_back(std::to_string(i) + ".25"); break;
+			case 1: formulas.push_back(a + "*1.5+" + b + "/2"); break;
+			case 2: formulas.push_back("sum(" + a + ":" + b + ")-$" + a); break;
+			default: formulas.push_back("(" + a + "+" + b + ")*(" + std::to_string(i) + "-" + a + ")"); break;
+		}
+	}
+	size_t calls = allocCount;
+	double t = measure([&]{
+		for (const std::string& f : formulas)
+			delete Parser(f).parse();
+	});
+	std::cout << std::fixed << std::setprecision(4) << t << " s, " << std::setprecision(0) << (double)formulas.size() / t
+		<< " formulas/s, " << std::setprecision(1) << (double)(allocCount - calls) / (double)formulas.size() << " operator new calls per formula" << std::endl;
+}
+
+///hibamentes és hibás értékekkel teli tábla kiértékelése, kiírása és exportja
+static void benchErrors() {
+	std::cout << "== errors: print and export of a 100x2000 layered sheet ==" << std::endl;
+	for (bool failing : {false, true}) {
+		Sheet sh = layeredSheet(100, 2000);
+		if (failing)
+			Parser("a9999").parseTo(&sh, sh[0][0]); //a hiba az összegeken át az egész táblára kiterjed
+		std::ostringstream table, values;
+		double tPrint = measure([&]{sh.formattedPrint(table);});
+		double tExport = measure([&]{sh.printValues(values);});
+		std::cout << (failing ? "all cells #ERR" : "no errors") << " - print: " << std::fixed << std::setprecision(4)
+			<< tPrint << " s, export: " << tExport << " s" << std::endl;
+	}
+}
+
+///egy kiszámolt tábla megnyitása és első kiírása csv-ből, illetve bináris pillanatképből
+static void benchSnapshot() {
+	std::cout << "== snapshot: open and print a computed 100x2000 layered sheet ==" << std::endl;
+	Sheet base = layeredSheet(100, 2000);
+	base.recalculate();
+	{
+		std::ofstream csv("bench_snapshot.csv");
+		base.printExpr(csv);
+		std::ofstream bin("bench_snapshot.bin", std::ios::binary);
+		Snapshot::save(base, bin);
+	}
+	for (const char* fname : {"bench_snapshot.csv", "bench_snapshot.bin"}) {
+		bool binary = std::string(fname).find(".bin") != std::string::npos;
+		std::ostringstream values;
+		size_t size = 0;
+		double t = measure([&]{
+			MappedFile file(fname);
+			size = file.view().size();
+			Sheet sh = binary ? Snapshot::load(file.view()) : Sheet::fromCsv(file.view());
+			sh.printValues(values);
+		});
+		std::cout << (binary ? "binary: " : "csv:    ") << std::fixed << std::setprecision(4) << t << " s, "
+			<< std::setprecision(1) << (double)size / 1e6 << " MB" << std::endl;
+		std::remove(fname);
+	}
+}
+
+///kiszámolt tábla értékeinek exportja fájlba: soronként operator<<-rel és std::endl-lel, illetve a pufferelt printValues-zal
+static void benchExport() {
+	std::cout << "== export: values of a computed 100x20000 layered sheet to csv ==" << std::endl;
+	Sheet sh = layeredSheet(100, 20000);
+	sh.recalculate();
+	size_t size = 0;
+	double t = measure([&]{
+		std::ofstream f("bench_export.csv");
+		for (unsigned int row = 0; row < sh.getHeight(); row++) {
+			for (unsigned int col = 0; col < sh.getWidth(); col++)
+				f << sh[row][col].result() << ",";
+			f << std::endl;
+		}
+		size = (size_t)f.tellp();
+	});
+	std::cout << "operator<<: " << std::fixed << std::setprecision(4) << t << " s, "
+		<< std::setprecision(1) << (double)size / 1e6 / t << " MB/s" << std::endl;
+	double serial = 0;
+	for (size_t threads = 1; threads <= std::thread::hardware_concurrency() || threads == 1; threads *= 2) {
+		ThreadPool pool(threads);
+		t = measure([&]{
+			std::ofstream f("bench_export.csv");
+			sh.printValues(f, pool);
+			size = (size_t)f.tellp();
+		});
+		if (threads == 1)
+			serial = t;
+		std::cout << std::setw(3) << threads << " threads: " << std::fixed << std::setprecision(4) << t << " s, "
+			<< std::setprecision(1) << (double)size / 1e6 / t << " MB/s, speedup "
+			<< std::setprecision(2) << serial / t << "x" << std::endl;
+	}
+	std::remove("bench_export.csv");
+}
+
+///teljes mentés, illetve néhány cella módosítása utáni, naplózott mentés ideje
+static void benchJournal() {
+	std::cout << "== journal: save of a 100x2000 layered sheet after 10 edits ==" << std::endl;
+	std::stringstream oss, iss;
+	Console con(layeredSheet(100, 2000), oss, iss);
+	iss << "save bench_journal ";
+	double tFull = measure([&]{con.readCommand();});
+	for (int i = 0; i < 10; i++)
+		iss << "set c" << i * 100 + 2 << " a" << i * 100 + 1 << "*3 ";
+	for (int i = 0; i < 10; i++) {con.readCommand();}
+	iss << "save bench_journal ";
+	double tJournal = measure([&]{con.readCommand();});
+	std::cout << "full save: " << std::fixed << std::setprecision(4) << tFull << " s, journaled save: "
+		<< std::setprecision(6) << tJournal << " s, journal " << con.getJournal().size() << " bytes" << std::endl;
+	con.getJournal().discard();
+	std::remove("bench_journal.csv");
+}
+
+///a parancsok futási ideje automatikus mentés közben egy 100x2000-es táblán
+static void benchAutosave() {
+	std::cout << "== autosave: command latency while a 100x2000 layered sheet is saved in the background ==" << std::endl;
+	std::stringstream oss, iss;
+	Console con(layeredSheet(100, 2000), oss, iss);
+	iss << "autosave bench_autosave 1 edits set a1 2 autosave off ";
+	con.readCommand();
+	double tFirst = measure([&]{con.readCommand();}); //ez indítja a mentést
+	con.readCommand();
+	double tMax = 0;
+	size_t commands = 0;
+	double tAll = measure([&]{
+		while (con.getJournal().isCompacting() || commands == 0) {
+			iss << "set b" << commands % 2000 + 1 << " " << commands << " ";
+			tMax = std::max(tMax, measure([&]{con.readCommand();}));
+			commands++;
+		}
+	});
+	std::cout << "triggering command: " << std::fixed << std::setprecision(4) << tFirst << " s, then " << commands
+		<< " commands in " << tAll << " s, slowest " << std::setprecision(6) << tMax << " s" << std::endl;
+	con.getJournal().discard();
+	std::remove("bench_autosave.csv");
+}
+
+///több összesítés ugyanazon a nagy tartományon: közös bejárás újraszámoláskor és egy képleten belül, illetve külön bejárások
+static void benchAggregates() {
+	std::cout << "== aggregates: min/max/count/product/var/stddev over a 1000000-row column ==" << std::endl;
+	const char* names[] = {"min", "max", "count", "product", "var", "stddev"};
+	Sheet sh(2, 1000000, 0);
+	for (unsigned int row = 0; row < 1000000; row++)
+		sh[row][0] = new NumberExpr(1 + (row * 7919 % 1000) * 1e-3);
+	sh.invalidate();
+	Parser("stddev(a1:a1000000)").parseTo(&sh, sh[0][1]);
+	double tOne = measure([&]{sh.recalculate();});
+	for (unsigned int i = 0; i < 6; i++)
+		Parser(std::string(names[i]) + "(a1:a1000000)").parseTo(&sh, sh[i][1]);
+	double tShared = measure([&]{sh.recalculate();});
+	double sink = 0;
+	double tSeparate = measure([&]{
+		for (unsigned int i = 0; i < 6; i++)
+			sink += sh.rangeAggregate({1, 1, 1, 1000000}).variance();
+	});
+	Parser("min(a1:a1000000)+max(a1:a1000000)+count(a1:a1000000)+avg(a1:a1000000)+var(a1:a1000000)+stddev(a1:a1000000)")
+		.parseTo(&sh, sh[6][1]);
+	double tFormula = measure([&]{sink += sh[6][1].evalMe();});
+	double tSum = measure([&]{sink += sh.rangeSum({1, 1, 1, 1000000});});
+	std::cout << "recalculate with 1 aggregate cell: " << std::fixed << std::setprecision(4) << tOne << " s, with 6: " << tShared
+		<< " s, 6 separate scans: " << tSeparate << " s, one formula with 6 aggregates: " << tFormula
+		<< " s, plain sum scan: " << tSum << " s (" << std::setprecision(2) << sink << ")" << std::endl;
+}
+
+///100000 kereső cella egy 1000000 soros táblában, pontos és közelítő kereséssel (az indexek építésével együtt)
+static void benchLookup() {
+	std::cout << "== lookup: 100000 lookup cells against a 1000000-row table ==" << std::endl;
+	Sheet sh(4, 1000000, 0);
+	for (unsigned int row = 0; row < 1000000; row++) {
+		sh[row][0] = new NumberExpr((double)(row * 7919u % 1000000u));
+		sh[row][1] = new NumberExpr(row * 0.5);
+	}
+	sh.invalidate();
+	for (unsigned int sorted = 0; sorted < 2; sorted++) {
+		std::string mode = sorted ? ";1)" : ")";
+		double tParse = measure([&]{
+			sh.beginUpdate();
+			for (unsigned int row = 0; row < 100000; row++)
+				Parser("lookup(" + std::to_string(row * 13 % 1000000) + (sorted ? ".5" : "") + ";$a$1:$a$1000000;$b$1:$b$1000000" + mode)
+					.parseTo(&sh, sh[row][2 + sorted]);
+			sh.endUpdate();
+		});
+		double tFirst = measure([&]{sh[0][2 + sorted].result();});
+		double tAll = measure([&]{sh.recalculate();});
+		std::cout << (sorted ? "sorted" : "exact") << ": parse " << std::fixed << std::setprecision(4) << tParse << " s, first lookup (builds index): "
+			<< tFirst << " s, 100000 lookups: " << tAll << " s (" << std::setprecision(3) << tAll * 10 << " us/lookup)" << std::endl;
+	}
+	double sink = 0;
+	double tScan = measure([&]{sink += sh.rangeSum({1, 1, 1, 1000000});});
+	std::cout << "one O(n) column scan for comparison: " << std::setprecision(4) << tScan << " s (" << std::setprecision(0) << sink << ")" << std::endl;
+}
+
+///feltételes összesítés egy 1000000 soros táblán: rendezett oszlopon (a zónatérkép a blokkok nagy részét átugorja), rendezetlen oszlopon (csak a kernel) és cellánként
+static void benchConditional() {
+	std::cout << "== conditional: sumif over a 1000000-row table (100 runs each) ==" << std::endl;
+	Sheet sh(3, 1000000, 0);
+	for (unsigned int row = 0; row < 1000000; row++) {
+		sh[row][0] = new NumberExpr(row / 1000); //pl. nap sorszáma, rendezett
+		sh[row][1] = new NumberExpr((double)(row * 7919u % 1000u)); //rendezetlen
+	}
+	sh.invalidate();
+	double sum = 0, count = 0, sink = 0;
+	double tSorted = measure([&]{
+		for (int i = 0; i < 100; i++) {
+			sh.rangeSumIf({1, 1, 1, 1000000}, {Criterion::GE, 990}, {2, 1, 2, 1000000}, sum, count);
+			sink += sum;
+		}
+	});
+	double tUnsorted = measure([&]{
+		for (int i = 0; i < 100; i++) {
+			sh.rangeSumIf({2, 1, 2, 1000000}, {Criterion::LT, 500}, {1, 1, 1, 1000000}, sum, count);
+			sink += sum;
+		}
+	});
+	double tCells = measure([&]{
+		Criterion c = {Criterion::LT, 500};
+		for (int i = 0; i < 100; i++) {
+			for (unsigned int row = 0; row < 1000000; row++)
+				if (c.matches(sh[row][1].result()))
+					sink += sh[row][0].result();
+		}
+	});
+	std::cout << "per run: sorted column, 1% selected (zone maps): " << std::fixed << std::setprecision(3) << tSorted * 10
+		<< " ms, unsorted column, 50% selected (kernel): " << tUnsorted * 10 << " ms, cell by cell: " << tCells * 10
+		<< " ms (" << std::setprecision(0) << sink << ")" << std::endl;
+}
+
+int main() {
+	benchRecalculate();
+	benchBytecode();
+	benchOptimizer();
+	benchRangeSum();
+	benchSumIndex();
+	benchLoad();
+	benchCopy();
+	benchAppend();
+	benchSparse();
+	benchErrors();
+	benchParse();
+	benchFill();
+	benchSnapshot();
+	benchExport();
+	benchJournal();
+	benchAutosave();
+	benchAggregates();
+	benchLookup();
+	benchConditional();
+	return 0;
+}
@@ -0,0 +1,185 @@
+#include "celltable.hpp"
+
+#include <utility>
+#include <algorithm>
+
+
+ExprPointer* CellTable::allocTile(size_t t){
+	ExprPointer* tile = new ExprPointer[TILE*TILE];
+	for (size_t i = 0; i < TILE*TILE; i++)
+		tile[i] = blanks[t];
+	tiles[t] = tile;
+	tileIndex[tile] = t;
+	return tile;
+}
+
+void CellTable::reset(size_t width, size_t height, double fill, Layout layout){
+	clear();
+	this->layout = layout;
+	this->width = width;
+	this->height = height;
+	if (layout == SPARSE) {
+		this->fill = fill;
+		tiles.assign(tileColumns() * ((height + TILE - 1) / TILE), nullptr);
+		blanks.assign(tiles.size(), ExprPointer::newNumber(fill));
+		return;
+	}
+	capacity = height;
+	cells = new ExprPointer[width * height];
+	ExprPointer filler = ExprPointer::newNumber(fill);
+	for (size_t i = 0; i < width*height; i++)
+		cells[i] = filler;
+}
+
+void CellTable::assign(const CellTable& src, const EvalContext* context){
+	clear();
+	layout = src.layout;
+	width = src.width;
+	height = src.height;
+	if (layout == SPARSE) {
+		fill = src.fill;
+		tiles.assign(src.tiles.size(), nullptr);
+		blanks = src.blanks;
+		for (size_t t = 0; t < tiles.size(); t++) {
+			if (src.tiles[t] == nullptr)
+				continue;
+			ExprPointer* tile = allocTile(t);
+			for (size_t i = 0; i < TILE*TILE; i++) {
+				if (src.tiles[t][i] == src.blanks[t])
+					continue;
+				tile[i] = src.tiles[t][i];
+				tile[i].bind(context);
+			}
+		}
+		return;
+	}
+	capacity = height;
+	cells = new ExprPointer[width * height];
+	for (size_t i = 0; i < width*height; i++) {
+		cells[i] = src.cells[i];
+		cells[i].bind(context);
+	}
+}
+
+void CellTable::swap(CellTable& table){
+	std::swap(layout, table.layout);
+	std::swap(width, table.width);
+	std::swap(height, table.height);
+	std::swap(capacity, table.capacity);
+	std::swap(cells, table.cells);
+	tiles.swap(table.tiles);
+	tileIndex.swap(table.tileIndex);
+	blanks.swap(table.blanks);
+	std::swap(fill, table.fill);
+}
+
+void CellTable::clear(){
+	delete[] cells;
+	cells = nullptr;
+	for (ExprPointer* tile : tiles)
+		delete[] tile;
+	tiles.clear();
+	blanks.clear();
+	tileIndex.clear();
+	capacity = 0;
+}
+
+bool CellTable::locate(const ExprPointer* cell, size_t& i) const {
+	if (layout == DENSE) {
+		if (cell < cells || cell >= cells + width*height)
+			return false;
+		i = (size_t)(cell - cells);
+		return true;
+	}
+	//a cellát tartalmazó csempe a legnagyobb, a cellánál nem nagyobb kezdőcímű csempe
+	auto it = tileIndex.upper_bound(cell);
+	if (it == tileIndex.begin())
+		return false;
+	--it;
+	size_t offset = (size_t)(cell - it->first);
+	if (offset >= TILE*TILE)
+		return false;
+	size_t row = it->second / tileColumns() * TILE + offset / TILE;
+	size_t col = it->second % tileColumns() * TILE + offset % TILE;
+	if (row >= height || col >= width)
+		return false;
+	i = row*width + col;
+	return true;
+}
+
+void CellTable::resize(size_t width, size_t height, double fill){
+	CellTable resized;
+	if (layout == SPARSE) {
+		resized.reset(width, height, this->fill, SPARSE);
+		//a csempék rácsa nem változik: a régi területbe eső csempék megtartják a kitöltő értéküket,
+		//a teljesen újak a fill értéket kapják
+		ExprPointer filler = ExprPointer::newNumber(fill);
+		size_t columns = resized.tileColumns();
+		for (size_t t = 0; t < resized.tiles.size(); t++) {
+			size_t row0 = t / columns * TILE, col0 = t % columns * TILE;
+			if (row0 < this->height && col0 < this->width)
+				resized.blanks[t] = blanks[row0 / TILE * tileColumns() + col0 / TILE];
+			else
+				resized.blanks[t] = filler;
+		}
+		forEach([&](size_t i, ExprPointer& cell){
+			size_t row = i / this->width, col = i % this->width;
+			if (row < height && col < width && !(cell == blanks[tileOf(i)]))
+				resized.write(row*width + col) = std::move(cell);
+		});
+		//a régi terület határán lévő csempék új részét cellánként töltjük ki
+		for (size_t t = 0; t < resized.tiles.size(); t++) {
+			if (resized.tiles[t] == nullptr && resized.blanks[t] == filler)
+				continue;
+			size_t row0 = t / columns * TILE, col0 = t % columns * TILE;
+			for (size_t row = row0; row < row0 + TILE && row < height; row++)
+				for (size_t col = row < this->height ? std::max(col0, this->width) : col0; col < col0 + TILE && col < width; col++)
+					if (!(resized.at(row*width + col) == filler))
+						resized.write(row*width + col) = filler;
+		}
+	} else {
+		resized.layout = DENSE;
+		resized.width = width;
+		resized.height = height;
+		resized.capacity = height;
+		resized.cells = new ExprPointer[width * height];
+		ExprPointer filler = ExprPointer::newNumber(fill);
+		for (size_t row = 0; row < height; row++) {
+			for (size_t col = 0; col < width; col++) {
+				if (row < this->height && col < this->width)
+					resized.cells[row*width + col] = std::move(cells[row*this->width + col]);
+				else
+					resized.cells[row*width + col] = filler;
+			}
+		}
+	}
+	swap(resized);
+}
+
+void CellTable::appendRow(double fill){
+	if (layout == SPARSE) {
+		ExprPointer filler = ExprPointer::newNumber(fill);
+		if (height % TILE == 0) {
+			tiles.resize(tiles.size() + tileColumns(), nullptr);
+			blanks.resize(tiles.size(), filler);
+		}
+		height++;
+		//a csempék új sorában már a csempe közös cellája van, csak az eltérő kitöltésűekbe írunk
+		for (size_t col = 0; col < width; col++)
+			if (!(blanks[tileOf((height-1)*width + col)] == filler))
+				write((height-1)*width + col) = filler;
+		return;
+	}
+	if (height == capacity) {
+		capacity = capacity < 4 ? 4 : 2*capacity;
+		ExprPointer* grown = new ExprPointer[width * capacity];
+		for (size_t i = 0; i < width*height; i++)
+			grown[i] = std::move(cells[i]);
+		delete[] cells;
+		cells = grown;
+	}
+	ExprPointer filler = ExprPointer::newNumber(fill);
+	for (size_t col = 0; col < width; col++)
+		cells[height*width + col] = filler;
+	height++;
+}
@@ -0,0 +1,140 @@
+#ifndef CELLTABLE_HPP
+#define CELLTABLE_HPP
+
+#include <vector>
+#include <map>
+#include <cstddef>
+
+#include "expressions/expression_core.hpp"
+
+///A tábla celláit (ExprPointer-eit) tároló osztály
+/**
+Sűrű (DENSE) elrendezésben a cellák egyetlen sorfolytonos tömbben vannak, a tömb végén
+tartaléksorokkal, így a tábla aljára fűzött sorok (appendRow) amortizáltan konstans időben
+kerülnek be. Ritka (SPARSE) elrendezésben a tábla TILE×TILE méretű csempékre oszlik, és egy
+csempe csak akkor foglal memóriát, amikor valamelyik celláját írásra kérik (write). A még
+nem írt cellák olvasáskor (at) a csempéjük közös, a kitöltő értéket tartalmazó celláját adják,
+így egy nagy, többnyire üres tábla memóriaigénye a kitöltött területtel arányos, nem a tábla
+méretével. A kitöltő érték csempénként tárolódik, így más kitöltő értékkel nagyobbra méretezve
+csak a régi és az új terület határán lévő csempéket kell lefoglalni. A cellákat mindkét elrendezésben a sorfolytonos indexük (sor*szélesség + oszlop,
+0-tól) azonosítja. A képletcellák kiértékelési környezetét a tulajdonos Sheet adja (ld. assign).
+*/
+class CellTable {
+public:
+	///a cellák elrendezése
+	enum Layout {
+		DENSE, ///<minden cella egyetlen sorfolytonos tömbben
+		SPARSE ///<a cellák csempékben, csak az írt csempék foglalnak memóriát
+	};
+	static const size_t TILE = 64; ///<ritka elrendezésben egy csempe oldalhossza (cellában)
+	static const size_t SPARSE_AREA = (size_t)1 << 22; ///<ekkora cellaszámtól érdemes ritka elrendezést választani
+private:
+	Layout layout = DENSE; ///<a cellák elrendezése
+	size_t width = 0; ///<a tábla szélessége
+	size_t height = 0; ///<a tábla magassága
+	size_t capacity = 0; ///<sűrű elrendezésben a lefoglalt sorok száma (a height utániak tartalékok)
+	ExprPointer* cells = nullptr; ///<sűrű elrendezésben a cellák sorfolytonosan
+	std::vector<ExprPointer*> tiles; ///<ritka elrendezésben a csempék sorfolytonosan (a még nem írtak helyén nullptr)
+	std::map<const ExprPointer*, size_t> tileIndex; ///<ritka elrendezésben a lefoglalt csempék kezdőcíme és sorszáma
+	mutable std::vector<ExprPointer> blanks; ///<ritka elrendezésben csempénként a nem írt cellák közös, a kitöltő értéket tartalmazó cellája
+	double fill = 0; ///<ritka elrendezésben a létrehozáskor megadott kitöltő érték (az átméretezéskor hozzáadott csempéké ettől eltérhet)
+
+	size_t tileColumns() const {return (width + TILE - 1) / TILE;} ///<egy csempesorban lévő csempék száma
+	size_t tileOf(size_t i) const {return i / width / TILE * tileColumns() + i % width / TILE;} ///<adott indexű cella csempéjének sorszáma
+	///adott sorszámú csempe lefoglalása, minden celláját a csempe közös üres cellájával tölti ki
+	ExprPointer* allocTile(size_t t);
+public:
+	CellTable() {} ///<konstruktor üres táblához
+	CellTable(const CellTable&) = delete;
+	CellTable& operator=(const CellTable&) = delete;
+	///adott méretű tábla létrehozása, minden cellája a fill értéket tartalmazza
+	/**A kifejezések az éppen aktív NodeArena-ból foglalnak (ld. NodeArena::Scope).*/
+	void reset(size_t width, size_t height, double fill, Layout layout);
+	///egy másik tábla celláinak átvétele (a kifejezésfákat megosztja, ld. ExprPointer)
+	/**@param context - a képletcellákat ehhez a kiértékelési környezethez köti (ld. ExprPointer::bind)*/
+	void assign(const CellTable& src, const EvalContext* context);
+	void swap(CellTable& table); ///<két tábla tartalmának cseréje
+	void clear(); ///<az összes cella felszabadítása
+	~CellTable() {clear();} ///<destruktor
+
+	Layout getLayout() const {return layout;} ///<az elrendezés lekérdezése
+	double getFill() const {return fill;} ///<ritka elrendezésben a létrehozáskor megadott kitöltő érték
+	size_t tileCount() const {return tileIndex.size();} ///<ritka elrendezésben a lefoglalt csempék száma
+	///adott indexű cella olvasásra (ritka elrendezésben a még nem írt cellák helyett a közös üres cella)
+	ExprPointer& at(size_t i) const {
+		if (layout == DENSE)
+			return cells[i];
+		size_t t = tileOf(i);
+		return tiles[t] ? tiles[t][i / width % TILE * TILE + i % width % TILE] : blanks[t];
+	}
+	///adott indexű cella írásra (ritka elrendezésben szükség esetén lefoglalja a csempét)
+	ExprPointer& write(size_t i) {
+		if (layout == DENSE)
+			return cells[i];
+		size_t row = i / width, col = i % width;
+		size_t t = row / TILE * tileColumns() + col / TILE;
+		ExprPointer* tile = tiles[t] ? tiles[t] : allocTile(t);
+		return tile[row % TILE * TILE + col % TILE];
+	}
+	bool isAllocated(size_t i) const {return layout == DENSE || tiles[tileOf(i)] != nullptr;}
+		///<igaz, ha a cellának saját tárhelye van (ritka elrendezésben a csempéje le van foglalva)
+	///a cellára mutató pointerből kiszámolja a cella indexét
+	/**@return hamis, ha a pointer nem a tábla egy cellájára mutat (pl. a közös üres cellára)*/
+	bool locate(const ExprPointer* cell, size_t& i) const;
+
+	///a cellák bejárásához használt blokkok száma (sűrű elrendezésben a sorok, ritkában a csempék)
+	size_t blocks() const {return layout == DENSE ? height : tiles.size();}
+	///végighalad egy blokk tárolt celláin, és mindegyikre meghívja az fn(index, cella) függvényt
+	/**A ritka elrendezés le nem foglalt csempéit kihagyja.*/
+	template <typename F>
+	void forEachInBlock(size_t b, F fn) const {
+		if (layout == DENSE) {
+			for (size_t i = b*width; i < (b+1)*width; i++)
+				fn(i, cells[i]);
+			return;
+		}
+		ExprPointer* tile = tiles[b];
+		if (tile == nullptr)
+			return;
+		size_t row0 = b / tileColumns() * TILE, col0 = b % tileColumns() * TILE;
+		for (size_t row = row0; row < row0 + TILE && row < height; row++)
+			for (size_t col = col0; col < col0 + TILE && col < width; col++)
+				fn(row*width + col, tile[(row - row0)*TILE + col - col0]);
+	}
+	///végighalad a tábla tárolt celláin (ritka elrendezésben csak a lefoglalt csempékén)
+	template <typename F>
+	void forEach(F fn) const {
+		for (size_t b = 0; b < blocks(); b++)
+			forEachInBlock(b, fn);
+	}
+	///végighalad a tábla azon celláin, amelyek értéke eltérhet a getFill értéktől
+	/**A tárolt cellákon kívül a ritka elrendezés más kitöltő értékű, nem írt csempéinek celláit
+	is bejárja (ezeknél a csempe közös celláját adja), a sorrend ugyanaz, mint a forEach-é.*/
+	template <typename F>
+	void forEachDistinct(F fn) const {
+		ExprPointer base = ExprPointer::newNumber(fill);
+		for (size_t b = 0; b < blocks(); b++) {
+			if (layout == DENSE || tiles[b] != nullptr) {
+				forEachInBlock(b, fn);
+				continue;
+			}
+			if (blanks[b] == base)
+				continue;
+			size_t row0 = b / tileColumns() * TILE, col0 = b % tileColumns() * TILE;
+			for (size_t row = row0; row < row0 + TILE && row < height; row++)
+				for (size_t col = col0; col < col0 + TILE && col < width; col++)
+					fn(row*width + col, blanks[b]);
+		}
+	}
+
+	///a tábla átméretezése, a megmaradó cellák fái a helyükön maradnak, az új cellák értéke fill
+	/**Ritka elrendezésben a teljesen új csempék lefoglalás nélkül kapják a fill kitöltő értéket,
+	cellánként csak a régi terület határán lévő csempék új részét kell beírni.*/
+	void resize(size_t width, size_t height, double fill);
+	///egy új sor hozzáfűzése a tábla aljára, a cellák értéke fill
+	/**Ritka elrendezésben csak azokba a csempékbe ír, amelyek kitöltő értéke eltér a fill-től,
+	a többi új cella a csempéje közös cellája marad (ld. isAllocated).*/
+	void appendRow(double fill);
+};
+
+#endif
@@ -1,7 +1,14 @@
 #include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <utility>
+#include <memory>
 
 #include "console.hpp"
 #include "parser.hpp"
+#include "mappedfile.hpp"
+#include "snapshot.hpp"
+#include "sheetimage.hpp"
 #include "exceptions.hpp"
 
 
@@ -12,10 +19,15 @@ void Console::help(){
 	\t print - print sheet \n\
 	\t set [cell] [expression] - set a given cell in sheet \n\
 	\t pull [cell] [cell] - relative copy of the expression of the first cell until the last \n\
+	\t append [expression] ... - append a row to the bottom of the sheet (expressions until the end of the line) \n\
 	\t show [cell] - display contents of given cell \n\
+	\t index [cell] [cell] - build a summed-area index over the region for fast sum/avg (index off - drop it) \n\
+	\t autosave [filename] [int n] [edits|seconds] - save to csv in the background every n edits or seconds (autosave off - stop) \n\
 	\t export [filename] - exports the values of the sheet in csv format (extension added automatically) \n\
-	\t save [filename] - saves the expressions in the sheet in csv format (extension added automatically) \n\
-	\t load [filename] - loads sheet from csv file (extension added automatically) \n\
+	\t save [filename] - saves the expressions in the sheet in csv format (extension added automatically, repeated saves only append the changes to a journal) \n\
+	\t load [filename] - loads sheet from csv file and its journal (extension added automatically) \n\
+	\t savebin [filename] - saves the sheet with its computed values in binary format (extension added automatically, repeated saves only append the changes to a journal) \n\
+	\t loadbin [filename] - loads sheet from binary file and its journal (extension added automatically) \n\
 	\t help - display available commands \n\
 	\t exit - close program\n";
 }
@@ -23,13 +35,16 @@ void Console::help(){
 void Console::createNew() {
 	size_t w, h;
 	istream >> w >> h;
-	sh = Sheet(w, h);
+	journal.unbind(); //az új tábla még nem tartozik alapfájlhoz
+	autosaveJournal.unbind(); //a célfájl a következő automatikus mentésig a régi táblát írja le
+	sh = Sheet(w, h, 0, w*h >= CellTable::SPARSE_AREA ? CellTable::SPARSE : CellTable::DENSE);
 }
 
 void Console::resize() {
 	size_t w, h;
 	istream >> w >> h;
 	sh.resize(w, h);
+	edited("resize " + std::to_string(w) + " " + std::to_string(h));
 }
 
 void Console::exportValues() {
@@ -37,6 +52,8 @@ void Console::exportValues() {
 	try	{
 		std::string fname;
 		istream >> fname;
+		if (journal.getBase() == fname + ".csv")
+			journal.discard(); //az alapfájlt felülírjuk, a napló már nem hozzá tartozik
 		ofile.open(fname + ".csv");
 		sh.printValues(ofile);
 	} catch (...){
@@ -45,51 +62,199 @@ void Console::exportValues() {
 	ofile.close();
 }
 
-void Console::save() {
-	std::ofstream ofile;
-	try	{
-		std::string fname;
-		istream >> fname;
-		ofile.open(fname + ".csv");
-		sh.printExpr(ofile);
-	} catch (...){
+std::string Console::render(bool binary) {
+	std::ostringstream out(std::ios::out | std::ios::binary);
+	if (binary) {
+		sh.recalculate(); //a pillanatkép a friss értékeket tartalmazza
+		Snapshot::save(sh, out);
+	} else {
+		sh.printExpr(out);
+	}
+	return out.str();
+}
+
+std::function<std::string()> Console::renderLater(bool binary) {
+	if (binary)
+		return [content = render(true)]{return content;};
+	std::shared_ptr<const SheetImage> image = std::make_shared<const SheetImage>(sh);
+	return [image]{
+		std::ostringstream out;
+		image->printExpr(out);
+		return out.str();
+	};
+}
+
+void Console::saveBase(const std::string& path, bool binary) {
+	try {
+		journal.poll();
+		if (journal.getBase() == path && journal.isPending())
+			journal.wait(); //az alapfájl még csak a háttérben készül, a mentés után a lemezen kell lennie
+		if (journal.getBase() == path) {
+			//az alapfájl és a napló együtt a tábla aktuális állapotát írja le
+			journal.flush();
+			if (journal.needsCompaction())
+				journal.compact(renderLater(binary));
+			return;
+		}
+		std::string content = render(binary);
+		journal.unbind();
+		if (autosaveJournal.getBase() == path)
+			autosaveJournal.unbind(); //a fájl ezután a mentett alapfájl, a naplója a journal
+		std::ofstream ofile(path, std::ios::binary);
+		ofile.write(content.data(), (std::streamsize)content.size());
+		ofile.close();
+		if (ofile.fail())
+			throw eval_error("write failed");
+		journal.bind(path, content, false);
+	} catch (...) {
 		ostream << "Export failed\n";
 	}
-	ofile.close();
 }
 
-void Console::load() {
-	std::ifstream ifile;
+void Console::loadBase(const std::string& path, bool binary) {
+	journal.unbind(); //a futó tömörítést megvárjuk, a napló kiürül
+	autosaveJournal.unbind();
+	MappedFile file(path);
+	try {
+		if (!file.isOpen())
+			throw eval_error("file not found");
+		sh = binary ? Snapshot::load(file.view()) : Sheet::fromCsv(file.view());
+		std::vector<std::string> entries;
+		bool valid = Journal::read(path, file.view(), entries);
+		replay(entries);
+		journal.bind(path, file.view(), valid);
+		edits = 0;
+	} catch (...) {
+		ostream << "Load failed\n";
+	}
+}
+
+void Console::replay(const std::vector<std::string>& entries) {
+	//a parancsok az istream helyett a bejegyzésből olvasnak, a napló ilyenkor nincs alapfájlhoz kötve
+	std::ios::iostate state = istream.rdstate();
+	for (const std::string& entry : entries) {
+		std::istringstream line(entry);
+		std::streambuf* input = istream.rdbuf(line.rdbuf());
+		std::string command;
+		istream >> command;
+		if (command == "set")
+			set();
+		else if (command == "pull")
+			pull();
+		else if (command == "resize")
+			resize();
+		else if (command == "append")
+			append();
+		istream.rdbuf(input);
+	}
+	istream.clear(state);
+}
+
+void Console::edited(const std::string& entry) {
+	journal.record(entry);
+	autosaveJournal.record(entry);
+	edits++;
+}
+
+void Console::autosaveIfDue() {
+	if (autosavePath.empty() || edits == 0)
+		return;
+	if (autosaveEdits ? edits < autosaveEdits : std::chrono::steady_clock::now() - lastAutosave < autosavePeriod)
+		return;
+	if (journal.getBase() == autosavePath) {
+		//a célfájl a mentett alapfájl: a naplója már tartalmazza a módosításokat
+		journal.flush();
+		if (journal.needsCompaction())
+			journal.compact(renderLater(false));
+	} else {
+		autosaveJournal.poll();
+		if (autosaveJournal.isCompacting())
+			return; //az előző mentés még fut
+		if (autosaveJournal.getBase() != autosavePath)
+			autosaveJournal.bind(autosavePath); //a napló az első mentés után a célfájlhoz tartozik
+		autosaveJournal.compact(renderLater(false));
+	}
+	edits = 0;
+	lastAutosave = std::chrono::steady_clock::now();
+}
+
+void Console::autosave() {
 	std::string fname;
-	unsigned int w = 0, h = 0;
 	istream >> fname;
-	try	{ifile.open(fname + ".csv");}
-	catch (...) {ostream << "Load failed\n"; return;}
-	//counting lines
-	std::string line, word;
-	if (getline(ifile, line)) h++;
-	std::stringstream linestream(line);
-	while (getline(linestream, word, ',')) {w++;}
-	while (getline(ifile, line)) {h++;}
-	ifile.close();
-	//opening file again
-	try	{ifile.open(fname + ".csv");}
-	catch (...) {ostream << "Load failed\n"; return;}
-	Sheet newsh(w, h, 0);
-	unsigned int row = 0;
-	while (getline(ifile, line) && row < h) {
-		unsigned int col = 0;
-		std::stringstream linestream(line);
-		while (getline(linestream, word, ',') && col < w) {
-			try {Parser(word).parseTo(&newsh, newsh[row][col]);}
-			catch (const syntax_error& err) {}
-			catch (const eval_error& err) {}
-			col++;
+	if (fname == "off") {
+		stopTimer();
+		autosavePath.clear();
+		autosaveJournal.unbind();
+		return;
+	}
+	size_t n;
+	std::string unit;
+	istream >> n >> unit;
+	if (!istream || n == 0 || (unit != "edits" && unit != "seconds")) {
+		istream.clear();
+		ostream << "invalid autosave interval\n";
+		return;
+	}
+	autosavePath = fname + ".csv";
+	autosaveEdits = unit == "edits" ? n : 0;
+	autosavePeriod = std::chrono::seconds(unit == "seconds" ? (std::chrono::seconds::rep)n : 0);
+	lastAutosave = std::chrono::steady_clock::now();
+	if (autosaveJournal.getBase() != autosavePath)
+		autosaveJournal.unbind();
+	if (autosaveEdits == 0)
+		startTimer();
+	else
+		stopTimer();
+}
+
+void Console::startTimer() {
+	if (timer.joinable())
+		return;
+	timerStop = false;
+	timer = std::thread([this]{
+		std::unique_lock<std::mutex> wait(timerMutex);
+		while (!timerWake.wait_for(wait, AUTOSAVE_TICK, [this]{return timerStop;})) {
+			//ha éppen parancs fut, a mentést a parancs végén a readCommand ellenőrzi
+			std::unique_lock<std::mutex> lock(commandMutex, std::try_to_lock);
+			if (lock)
+				autosaveIfDue();
 		}
-		row++;
+	});
+}
+
+void Console::stopTimer() {
+	if (!timer.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> guard(timerMutex);
+		timerStop = true;
 	}
-	ifile.close();
-	sh = newsh;
+	timerWake.notify_one();
+	timer.join();
+}
+
+void Console::save() {
+	std::string fname;
+	istream >> fname;
+	saveBase(fname + ".csv", false);
+}
+
+void Console::load() {
+	std::string fname;
+	istream >> fname;
+	loadBase(fname + ".csv", false);
+}
+
+void Console::saveBinary() {
+	std::string fname;
+	istream >> fname;
+	saveBase(fname + ".bin", true);
+}
+
+void Console::loadBinary() {
+	std::string fname;
+	istream >> fname;
+	loadBase(fname + ".bin", true);
 }
 
 void Console::set() {
@@ -101,6 +266,7 @@ void Console::set() {
 			std::string inp;
 			istream >> inp;
 			Parser(inp).parseTo(&sh, sh[cid.getRow()-1][cid.getColNum()-1]);
+			edited("set " + cellstr + " " + inp);
 		} else {
 			ostream << "index out of range\n";
 		}
@@ -108,18 +274,54 @@ void Console::set() {
 	} catch (const eval_error& err) {ostream << "evaluation error: " << err.what() << std::endl;}
 }
 
+void Console::append() {
+	std::string line, word;
+	std::getline(istream, line);
+	std::stringstream linestream(line);
+	std::vector<std::string> words;
+	while (linestream >> word) {words.push_back(word);}
+	if (words.size() > sh.getWidth()) {
+		ostream << "index out of range\n";
+		return;
+	}
+	Sheet::Row row = sh.appendRow();
+	std::string entry = "append"; //a hibás kifejezések helyén a cella 0 marad
+	sh.beginUpdate();
+	for (size_t col = 0; col < words.size(); col++) {
+		try {
+			Parser(words[col]).parseTo(&sh, row[col]);
+			entry += " " + words[col];
+			continue;
+		}
+		catch (const syntax_error& err) {ostream << "syntax error: " << err.what() << std::endl;}
+		catch (const eval_error& err) {ostream << "evaluation error: " << err.what() << std::endl;}
+		entry += " 0";
+	}
+	sh.endUpdate();
+	edited(entry);
+}
+
 void Console::pull() {
 	std::string cellstr1, cellstr2;
 	istream >> cellstr1 >> cellstr2;
 	try {
-		CellRefExpr start = CellRefExpr(cellstr1, &sh);
-		unsigned int startx = sh.getXCoord(start.getPtr());
-		unsigned int starty = sh.getYCoord(start.getPtr());
-		Range range(new CellRefExpr(cellstr1, &sh), new CellRefExpr(cellstr2, &sh));
-		for (Range::iterator cell = range.begin(); cell != range.end(); cell++) {
-			*cell = (*start.getPtr())->copy();
-			(*cell)->shift(sh.getXCoord(&*cell)-startx, sh.getYCoord(&*cell)-starty);
+		CellId start(cellstr1);
+		ExprPointer* startCell = sh.parseCell(start.getColNum(), start.getRow());
+		unsigned int startx = start.getColNum() - 1;
+		unsigned int starty = start.getRow() - 1;
+		Range range(new CellRefExpr(cellstr1), new CellRefExpr(cellstr2));
+		Range::iterator end = range.end(sh);
+		Range::iterator cell = range.begin(sh);
+		NodeArena::Scope scope(sh.getArena());
+		sh.beginUpdate();
+		for (; cell != end; cell++) {
+			ExprPointer& target = cell.write();
+			target = *startCell;
+			target.shift(sh.getXCoord(&target)-startx, sh.getYCoord(&target)-starty);
+			sh.update(&target);
 		}
+		sh.endUpdate();
+		edited("pull " + cellstr1 + " " + cellstr2);
 	} catch (const syntax_error& err) {ostream << "syntax error: " << err.what() << std::endl;
 	} catch (const eval_error& err) {ostream << "evaluation error: " << err.what() << std::endl;}
 }
@@ -130,8 +332,9 @@ void Console::show() {
 	try	{
 		CellId cid(cellstr);
 		if (sh.checkRow(cid.getRow()) && sh.checkCol(cid.getColNum())){
-			ostream << sh[cid.getRow()-1][cid.getColNum()-1]->show() << " = ";
-			ostream << sh[cid.getRow()-1][cid.getColNum()-1].evalMe() << '\n';
+			ExprPointer* cell = sh.parseCell(cid.getColNum(), cid.getRow());
+			ostream << (*cell)->show() << " = ";
+			ostream << cell->evalMe() << '\n';
 		} else {
 			ostream << "index out of range\n";
 		}
@@ -139,9 +342,30 @@ void Console::show() {
 	} catch (const eval_error& err) {ostream << "evaluation error: " << err.what() << std::endl;}
 }
 
+void Console::index() {
+	std::string cellstr1;
+	istream >> cellstr1;
+	if (cellstr1 == "off") {
+		sh.clearSumIndex();
+		return;
+	}
+	std::string cellstr2;
+	istream >> cellstr2;
+	try	{
+		CellId c1(cellstr1), c2(cellstr2);
+		CellRect region = {std::min(c1.getColNum(), c2.getColNum()), std::min(c1.getRow(), c2.getRow()),
+			std::max(c1.getColNum(), c2.getColNum()), std::max(c1.getRow(), c2.getRow())};
+		if (!sh.setSumIndex(region))
+			ostream << "index out of range\n";
+	} catch (const syntax_error& err) {ostream << "syntax error: " << err.what() << std::endl;}
+}
+
 void Console::readCommand(){
 	std::string command;
 	istream >> command;
+	std::lock_guard<std::mutex> lock(commandMutex);
+	journal.poll(); //a háttérben befejeződött tömörítés után a napló elejét eldobjuk
+	autosaveJournal.poll();
 	if (command == "print") {
 		print();
 	} else if (command == "set") {
@@ -150,12 +374,22 @@ void Console::readCommand(){
 		show();
 	} else if (command == "pull") {
 		pull();
+	} else if (command == "append") {
+		append();
+	} else if (command == "index") {
+		index();
+	} else if (command == "autosave") {
+		autosave();
 	} else if (command == "new") {
 		createNew();
 	} else if (command == "load") {
 		load();
 	} else if (command == "save") {
 		save();
+	} else if (command == "loadbin") {
+		loadBinary();
+	} else if (command == "savebin") {
+		saveBinary();
 	} else if (command == "export") {
 		exportValues();
 	} else if (command == "resize") {
@@ -167,4 +401,5 @@ void Console::readCommand(){
 	} else {
 		ostream << "invalid command\n";
 	}
+	autosaveIfDue();
 }
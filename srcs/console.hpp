@@ -3,7 +3,13 @@
 
 #include <iostream>
 #include <string>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "sheet.hpp"
+#include "journal.hpp"
 
 ///Felhasználói felület biztosítására szolgáló osztály
 /**
@@ -14,48 +20,127 @@ readCommand tagfüggvény értelmezi, és ő hívja meg a megfelelő parancsot l
 tagfüggvényt. Az adott tagfüggvény az inputstreamről beolvassa a parancs paramétereit és
 végrehajtja a azt. Ha a felhasználó szintaktikailag hibás parancsot ad, akkor a konzol kapja
 el a program által generált kivételeket, és hibaüzenetet ír az outputstreamre.
+
+A mentett vagy betöltött fájl (alapfájl) után a módosító parancsokat (set, pull, resize, append)
+a konzol egy naplóba (ld. Journal) is rögzíti, így ugyanarra a fájlra a további mentések csak a
+változásokat írják ki, betöltéskor pedig az alapfájl után a naplót is visszajátsszuk. Az
+automatikus mentés (autosave) a táblát adott számú módosításonként vagy adott időnként a
+háttérben menti egy időpontbeli képéből (ld. SheetImage), így a parancsok végrehajtása nem áll meg.
+Az automatikus mentés célfájljához külön napló tartozik, így nem veszi el a mentett alapfájl
+naplóját. Az időnkénti mentést egy időzítő szál akkor is elindítja, ha nem érkezik parancs; a
+parancsok és az időzítő a tábla elérését egy mutexszel hangolják össze.
 */
 class Console {
 	Sheet sh; ///<a táblázat, amelyen a parancsok végrehajtódnak
 	std::ostream& ostream; ///<a kimenettel rendelkező parancsok kimenetét ide írja a konzol
 	std::istream& istream; ///<a parancsok nevét és paramétereit innen olvassa a konzol
 	bool closed = false; ///<bezárták-e a konzolt
+	Journal journal; ///<az alapfájlhoz tartozó módosításnapló (ld. save, load)
+	Journal autosaveJournal; ///<az automatikus mentés célfájljához tartozó napló (ha az nem azonos az alapfájllal)
+	std::string autosavePath; ///<az automatikus mentés célfájlja (üres, ha ki van kapcsolva)
+	size_t autosaveEdits = 0; ///<ennyi módosításonként ment automatikusan (0, ha időnként)
+	std::chrono::steady_clock::duration autosavePeriod{}; ///<ennyi időnként ment automatikusan (ha autosaveEdits 0)
+	size_t edits = 0; ///<a legutóbbi automatikus mentés óta végrehajtott módosítások száma
+	std::chrono::steady_clock::time_point lastAutosave; ///<a legutóbbi automatikus mentés ideje
+	std::mutex commandMutex; ///<a parancsok végrehajtása és az időzítő által indított mentés kölcsönös kizárása
+	std::thread timer; ///<az időnkénti automatikus mentést a parancsoktól függetlenül ellenőrző szál
+	std::mutex timerMutex; ///<a timerStop védelme
+	std::condition_variable timerWake; ///<az időzítő szál leállításának jelzése
+	bool timerStop = false; ///<le kell-e állnia az időzítő szálnak
+
+	std::string render(bool binary); ///<a tábla teljes tartalma csv (kifejezések) vagy bináris pillanatkép alakban
+	///a tábla aktuális tartalmát később, akár egy háttérszálon előállító függvény (ld. Journal::compact)
+	/**csv esetén a tábla időpontbeli képét (SheetImage) rögzíti, és csak a kiírás marad a függvényre,
+	bináris pillanatképnél a tartalmat azonnal előállítja*/
+	std::function<std::string()> renderLater(bool binary);
+	void edited(const std::string& entry); ///<egy végrehajtott módosítás rögzítése a naplóban és az automatikus mentéshez
+	///ha esedékes, elindítja az automatikus mentést a háttérben (ha az előző még fut, később próbálja újra)
+	/**csak a commandMutex birtokában hívható (ld. readCommand)*/
+	void autosaveIfDue();
+	///elindítja az időzítő szálat, amely AUTOSAVE_TICK időnként ellenőrzi, esedékes-e a mentés
+	/**ha éppen parancs fut, az ellenőrzést kihagyja, azt a parancs végén a readCommand végzi el*/
+	void startTimer();
+	void stopTimer(); ///<leállítja és megvárja az időzítő szálat (a commandMutex birtokában is hívható)
+	///a táblát a megadott alapfájlba menti; ha a napló már ehhez a fájlhoz tartozik, csak a naplót üríti (és szükség esetén tömörít)
+	void saveBase(const std::string& path, bool binary);
+	void loadBase(const std::string& path, bool binary); ///<betölti az alapfájlt, visszajátssza a hozzá tartozó naplót, és hozzá köti a naplót
+	///a napló bejegyzéseit (módosító parancsokat) sorban végrehajtja a táblán
+	/**a bejegyzéseket a parancsokkal azonos módon értelmezi, az istream helyett a bejegyzés szövegéből olvasva*/
+	void replay(const std::vector<std::string>& entries);
 public:
+	static constexpr std::chrono::milliseconds AUTOSAVE_TICK{200}; ///<az időzítő szál ilyen időközönként ellenőrzi az időnkénti mentést
+
 	explicit Console() : ostream(std::cout), istream(std::cin) {}
 		///<alapértelmezett konstruktor, input és outputstream-je a std::cin és std::cout
 	explicit Console(const Sheet& sh, std::ostream& ostream, std::istream& istream) : sh(sh), ostream(ostream), istream(istream) {}
 		///<konstruktor tábla, input- és outputstreamek megadásával
 	explicit Console(std::ostream& ostream, std::istream& istream) : ostream(ostream), istream(istream) {}
 		///<konstruktor csak input- és outputstreamek megadásával
+	Console(const Console&) = delete;
+	Console& operator=(const Console&) = delete;
+	~Console() {stopTimer();} ///<destruktor, leállítja az időzítő szálat (a naplók a saját destruktorukban ürülnek)
 
 	bool isClosed() const {return closed;} ///<visszaadja, bezárták-e a konzolt
+	const Sheet& getSheet() const {return sh;} ///<a konzol táblájának lekérdezése
+	Journal& getJournal() {return journal;} ///<a konzol módosításnaplójának lekérdezése
+	Journal& getAutosaveJournal() {return autosaveJournal;} ///<az automatikus mentés naplójának lekérdezése
 	void help(); ///<kiírja az ostream-re az elérhető parancsokat
 
 	//*** Az alábbi parancsok a tesztelés megkönnyítésének érdekében publikusak, lehetnének privátak
 			///új táblát hoz létre (ha volt előző, azt eldobja)
-			/**paramétereit az istream-ről olvassa: új tábla szélesség és magassága*/
+			/**paramétereit az istream-ről olvassa: új tábla szélesség és magassága. Legalább
+			CellTable::SPARSE_AREA cellánál ritka elrendezésű táblát hoz létre.*/
 			void createNew();
 			///átméretezi a táblát, ha kisebb lesz, a fennmaradó adat elveszik
 			/**paramétereit az istream-ről olvassa: tábla új szélesség és magassága*/
 			void resize();
 			void print() {sh.formattedPrint(ostream);} ///<kiírja az ostream-re a tábla tartalmát oszlop- és sorszámokkal
 			void exportValues(); ///<istream-ről bekért fájlnevű fájlba kiírja a táblában tárolt értékeket vesszővel elválasztva
-			void save(); ///<istream-ről bekért fájlnevű fájlba kiírja a táblában tárolt kifejezéseket vesszővel elválasztva
-			void load(); ///<istream-ről bekért fájlnevű fájlból beolvassa a vesszővel elválasztott kifejezéseket
+			///istream-ről bekért fájlnevű fájlba kiírja a táblában tárolt kifejezéseket vesszővel elválasztva
+			/**Ha a fájl az utoljára mentett vagy betöltött alapfájl, csak a módosításnaplót üríti, a
+			teljes fájlt pedig csak a napló tömörítésekor, a háttérben írja újra (ld. Journal).*/
+			void save();
+			///istream-ről bekért fájlnevű fájlból beolvassa a vesszővel elválasztott kifejezéseket (ld. Sheet::fromCsv), ha nem létezik, hibaüzenetet ír az ostream-re
+			/**a fájlhoz tartozó módosításnaplót is visszajátssza (ld. save)*/
+			void load();
+			///istream-ről bekért fájlnevű fájlba menti a tábla bináris pillanatképét (ld. Snapshot)
+			/**mentés előtt újraszámolja a táblát, így a pillanatkép a friss értékeket tartalmazza;
+			a naplózást a save-hez hasonlóan végzi*/
+			void saveBinary();
+			///istream-ről bekért fájlnevű bináris pillanatképből tölti be a táblát (ld. Snapshot)
+			/**a betöltött tábla újraszámolás nélkül kiírható, ha a fájl nem létezik vagy hibás, hibaüzenetet ír az ostream-re;
+			a fájlhoz tartozó módosításnaplót is visszajátssza*/
+			void loadBinary();
 			void set(); ///<istream-ről bekért cellába beállítja a megadott kifejezést (amennyiben szintaktikailag helyes)
 			///automatikusan kitölti a kezdőcellában található értékkel a cellákat a második paraméterben kapott celláig egy téglalapban
 			/**
 			a kezdőcellában található kifejezést átmásolja a két cella által meghatározott
 			téglalap minden cellájába, ezen felül minden nem abszolút hivatkozást eltol a kezdőcellától
-			vett relatív pozíciójának megfelelően (ld. CellRefExpr::shift)
+			vett relatív pozíciójának megfelelően (ld. ExprPointer::shift). A kitöltött cellák a
+			kezdőcella fáján osztoznak.
 			*/
 			void pull();
+			///a tábla aljára új sort fűz (ld. Sheet::appendRow)
+			/**a sor celláinak kifejezéseit a sor végéig olvassa az istream-ről, szóközzel elválasztva;
+			a kimaradó cellák értéke 0, ha több kifejezést kap, mint a tábla szélessége, nem fűz hozzá sort*/
+			void append();
 			void show(); ///<kiírja az ostream-re a istream-ről olvasott cella tartalmát és értékét
+			///automatikus mentés bekapcsolása: istream-ről bekért fájlnevű csv fájlba ment adott számú módosításonként ("edits") vagy másodpercenként ("seconds")
+			/**A mentés a tábla egy időpontbeli képéből (ld. SheetImage) a háttérben készül, közben a
+			parancsok tovább futhatnak, a mentés óta végrehajtott módosítások a fájl naplójába
+			kerülnek (ld. Journal). Ha a célfájl a mentett alapfájl, annak naplóját üríti, különben külön
+			naplót vezet. Az időnkénti mentést egy időzítő szál a parancsoktól függetlenül is elindítja.
+			"autosave off" paraméterrel kikapcsolja.*/
+			void autosave();
+			///a két megadott cella által meghatározott régióra összegtáblát épít (ld. Sheet::setSumIndex)
+			/**"index off" paraméterrel megszünteti az összegtáblát*/
+			void index();
 			void exit() {closed = true;} ///<bezárja a konzolt
 	// A fenti parancsok a tesztelés megkönnyítésének érdekében publikusak, lehetnének privátak
 
 	///beolvassa és értelmezi az istream-re beírt parancs nevét, és meghívja a megfelelő tagfüggvényt
-	/**ha helytelen parancsnevet kap, hibaüzenetet ír az ostream-re*/
+	/**ha helytelen parancsnevet kap, hibaüzenetet ír az ostream-re; a parancs név beolvasása után
+	a commandMutex-et tartja, így közben az időzítő szál nem kezd mentésbe*/
 	void readCommand();
 };
 
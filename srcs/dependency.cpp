@@ -0,0 +1,173 @@
+#include <algorithm>
+
+#include "dependency.hpp"
+
+
+template <typename F>
+void DependencyGraph::forEachBlock(unsigned int col, unsigned int row1, unsigned int row2, F fn){
+	unsigned long long row = row1;
+	while (row <= row2) {
+		//a lehető legnagyobb, row-ra igazított és a tartományba még beleférő blokk
+		unsigned int level = 0;
+		while (level < 31 && row % (2ull << level) == 0 && row + (2ull << level) - 1 <= row2) {
+			level++;
+		}
+		fn(blockKey(col, level, row >> level), level);
+		row += 1ull << level;
+	}
+}
+
+void DependencyGraph::addEdges(CellKey cell, const std::vector<CellRect>& refs){
+	for (const CellRect& r : refs) {
+		if (r.isSingle()) {
+			cellDependents[key(r.col1, r.row1)].push_back(cell);
+		} else {
+			for (unsigned int col = r.col1; col <= r.col2; col++) {
+				forEachBlock(col, r.row1, r.row2, [&](unsigned long long block, unsigned int level){
+					rangeDependents[block].push_back(cell);
+					if (level > maxLevel)
+						maxLevel = level;
+				});
+			}
+		}
+	}
+}
+
+///törli a vektorból az érték egy előfordulását, és igazat ad vissza, ha a vektor kiürült
+static bool eraseOne(std::vector<DependencyGraph::CellKey>& vec, DependencyGraph::CellKey value){
+	auto pos = std::find(vec.begin(), vec.end(), value);
+	if (pos != vec.end())
+		vec.erase(pos);
+	return vec.empty();
+}
+
+void DependencyGraph::removeEdges(CellKey cell, const std::vector<CellRect>& refs){
+	for (const CellRect& r : refs) {
+		if (r.isSingle()) {
+			auto it = cellDependents.find(key(r.col1, r.row1));
+			if (it != cellDependents.end() && eraseOne(it->second, cell))
+				cellDependents.erase(it);
+		} else {
+			for (unsigned int col = r.col1; col <= r.col2; col++) {
+				forEachBlock(col, r.row1, r.row2, [&](unsigned long long block, unsigned int){
+					auto it = rangeDependents.find(block);
+					if (it != rangeDependents.end() && eraseOne(it->second, cell))
+						rangeDependents.erase(it);
+				});
+			}
+		}
+	}
+}
+
+void DependencyGraph::setPrecedents(CellKey cell, const std::vector<CellRect>& refs){
+	auto it = precedents.find(cell);
+	if (it != precedents.end()) {
+		removeEdges(cell, it->second);
+		precedents.erase(it);
+	}
+	if (!refs.empty()) {
+		addEdges(cell, refs);
+		precedents.emplace(cell, refs);
+	}
+}
+
+const std::vector<CellRect>* DependencyGraph::getPrecedents(CellKey cell) const {
+	auto it = precedents.find(cell);
+	return it == precedents.end() ? nullptr : &it->second;
+}
+
+void DependencyGraph::getDependents(CellKey cell, std::vector<CellKey>& out) const {
+	auto it = cellDependents.find(cell);
+	if (it != cellDependents.end())
+		out.insert(out.end(), it->second.begin(), it->second.end());
+	if (rangeDependents.empty())
+		return;
+	unsigned int col = keyCol(cell);
+	unsigned int row = keyRow(cell);
+	for (unsigned int level = 0; level <= maxLevel; level++) {
+		auto rit = rangeDependents.find(blockKey(col, level, row >> level));
+		if (rit != rangeDependents.end())
+			out.insert(out.end(), rit->second.begin(), rit->second.end());
+	}
+}
+
+void DependencyGraph::findCycles(const std::vector<CellKey>& roots, std::vector<CellKey>& visited, std::vector<CellKey>& cyclic) const {
+	struct Node {
+		size_t index; ///<a bejárás sorrendjében kapott sorszám
+		size_t low; ///<a legkisebb sorszám, ami a csúcsból a veremben elérhető
+		bool onStack; ///<benne van-e a komponensek vermében
+	};
+	struct Frame {
+		CellKey cell;
+		std::vector<CellKey> next; ///<a cellától függő cellák
+		size_t pos; ///<a következő feldolgozandó függő cella indexe
+		bool selfLoop; ///<önmagára hivatkozik-e a cella
+	};
+	std::unordered_map<CellKey, Node> nodes;
+	std::vector<CellKey> components;
+	std::vector<Frame> stack;
+	auto push = [&](CellKey cell){
+		size_t index = nodes.size();
+		nodes[cell] = {index, index, true};
+		components.push_back(cell);
+		visited.push_back(cell);
+		stack.push_back({cell, {}, 0, false});
+		getDependents(cell, stack.back().next);
+	};
+	for (CellKey root : roots) {
+		if (nodes.count(root))
+			continue;
+		push(root);
+		while (!stack.empty()) {
+			Frame& f = stack.back();
+			if (f.pos < f.next.size()) {
+				CellKey next = f.next[f.pos++];
+				auto it = nodes.find(next);
+				if (next == f.cell) {
+					f.selfLoop = true;
+				} else if (it == nodes.end()) {
+					push(next);
+				} else if (it->second.onStack) {
+					Node& n = nodes[f.cell];
+					n.low = std::min(n.low, it->second.index);
+				}
+				continue;
+			}
+			CellKey cell = f.cell;
+			bool selfLoop = f.selfLoop;
+			stack.pop_back();
+			Node& n = nodes[cell];
+			if (n.low == n.index) {
+				//a cella egy erősen összefüggő komponens gyökere: a komponens a verem tetején van
+				size_t begin = components.size();
+				do {
+					begin--;
+					nodes[components[begin]].onStack = false;
+				} while (components[begin] != cell);
+				if (components.size() - begin > 1 || selfLoop)
+					cyclic.insert(cyclic.end(), components.begin() + (long)begin, components.end());
+				components.resize(begin);
+			}
+			if (!stack.empty()) {
+				Node& parent = nodes[stack.back().cell];
+				parent.low = std::min(parent.low, n.low);
+			}
+		}
+	}
+}
+
+std::vector<DependencyGraph::CellKey> DependencyGraph::cells() const {
+	std::vector<CellKey> keys;
+	keys.reserve(precedents.size());
+	for (const auto& p : precedents) {
+		keys.push_back(p.first);
+	}
+	return keys;
+}
+
+void DependencyGraph::clear(){
+	precedents.clear();
+	cellDependents.clear();
+	rangeDependents.clear();
+	maxLevel = 0;
+}
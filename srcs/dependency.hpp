@@ -0,0 +1,85 @@
+#ifndef DEPENDENCY_HPP
+#define DEPENDENCY_HPP
+
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+
+///Cellák egy téglalap alakú tartományát leíró struktúra (oszlop- és sorszámok 1-től indexelve, a határok is beletartoznak)
+/**Egyetlen cellára vonatkozó hivatkozást egy 1×1-es téglalap ír le.*/
+struct CellRect {
+	unsigned int col1; ///<bal szélső oszlop
+	unsigned int row1; ///<felső sor
+	unsigned int col2; ///<jobb szélső oszlop
+	unsigned int row2; ///<alsó sor
+	bool isSingle() const {return col1 == col2 && row1 == row2;} ///<egyetlen cellát jelöl-e a téglalap
+	bool contains(unsigned int col, unsigned int row) const {return col1 <= col && col <= col2 && row1 <= row && row <= row2;}
+		///<benne van-e adott cella a téglalapban
+};
+
+///A cellák közötti hivatkozásokat nyilvántartó gráf
+/**
+Minden képletet tartalmazó cellához eltárolja, hogy mely cellákra, illetve tartományokra
+hivatkozik (előre mutató élek), és ennek megfordítását is (visszafelé mutató élek), így egy
+cella módosítása után gyorsan megtalálhatók a tőle függő cellák. Az egyes cellákra mutató
+hivatkozásokat cellánként, a tartományokat oszloponként tartja nyilván, a tartományokat tehát
+nem bontja fel cellákra: egy oszlopon belül a tartomány sorait legfeljebb 2·32 darab, kettő
+hatvány hosszúságú, igazított blokkra bontja (mint egy szegmensfában), így egy cellát tartalmazó
+tartományok blokkonként egy-egy kereséssel megtalálhatók. A cellákat a tábla méretétől független
+kulccsal azonosítja, így átméretezéskor a kulcsok nem változnak.
+*/
+class DependencyGraph {
+public:
+	typedef unsigned long long CellKey; ///<cellát azonosító kulcs
+private:
+	std::unordered_map<CellKey, std::vector<CellRect>> precedents; ///<előre mutató élek: cella -> hivatkozott téglalapok
+	std::unordered_map<CellKey, std::vector<CellKey>> cellDependents; ///<visszafelé mutató élek egyes cellákra
+	std::unordered_map<unsigned long long, std::vector<CellKey>> rangeDependents;
+		///<visszafelé mutató élek tartományokra, (oszlop, blokkméret, blokk) szerint
+	unsigned int maxLevel = 0; ///<a legnagyobb használt blokkméret kettes alapú logaritmusa
+
+	///egy oszlop adott blokkjának kulcsa
+	static unsigned long long blockKey(unsigned int col, unsigned int level, unsigned long long block)
+		{return (unsigned long long)col << 37 | (unsigned long long)level << 32 | block;}
+	///a tartomány egy oszlopba eső részét blokkokra bontja, és mindegyikre meghívja a függvényt
+	template <typename F>
+	static void forEachBlock(unsigned int col, unsigned int row1, unsigned int row2, F fn);
+
+	void addEdges(CellKey cell, const std::vector<CellRect>& refs); ///<a cella hivatkozásainak felvétele a visszafelé mutató élek közé
+	void removeEdges(CellKey cell, const std::vector<CellRect>& refs); ///<a cella hivatkozásainak törlése a visszafelé mutató élek közül
+public:
+	///beállítja egy cella hivatkozásait, a korábbi hivatkozásait törli
+	/**
+	@param cell - a hivatkozó cella kulcsa
+	@param refs - a cella kifejezésében szereplő hivatkozások (üres, ha a cella nem hivatkozik semmire)
+	*/
+	void setPrecedents(CellKey cell, const std::vector<CellRect>& refs);
+	///visszaadja egy cella hivatkozásait (nullptr, ha nem hivatkozik semmire)
+	const std::vector<CellRect>* getPrecedents(CellKey cell) const;
+	///kigyűjti azokat a cellákat, amelyek közvetlenül hivatkoznak az adott cellára
+	/**
+	@param cell - a hivatkozott cella kulcsa
+	@param out - ehhez a vektorhoz fűzi hozzá a hivatkozó cellák kulcsait
+	*/
+	void getDependents(CellKey cell, std::vector<CellKey>& out) const;
+	///megkeresi a körkörös hivatkozásokat a megadott cellákból a függő cellák felé haladva
+	/**Tarjan algoritmusával a bejárt részgráf erősen összefüggő komponenseit keresi meg,
+	így a futási idő a bejárt cellák és élek számával arányos. Minden körkörös hivatkozás,
+	amely a kiinduló cellák valamelyikétől függő cellát érint, teljes egészében a bejárt
+	részgráfban van.
+	@param roots - kiinduló cellák
+	@param visited - ide kerülnek a bejárt cellák (a kiinduló cellák és a tőlük közvetve vagy közvetlenül függő cellák)
+	@param cyclic - ide kerülnek a bejárt cellák közül azok, amelyek körkörös hivatkozásban vesznek részt
+	*/
+	void findCycles(const std::vector<CellKey>& roots, std::vector<CellKey>& visited, std::vector<CellKey>& cyclic) const;
+	std::vector<CellKey> cells() const; ///<a hivatkozást tartalmazó cellák kulcsai
+	size_t size() const {return precedents.size();} ///<hivatkozást tartalmazó cellák száma
+	void clear(); ///<minden él törlése
+
+	static CellKey key(unsigned int col, unsigned int row) {return (CellKey)row << 32 | col;}
+		///<cellakulcs előállítása oszlop- és sorszámból (1-től indexelve)
+	static unsigned int keyCol(CellKey k) {return (unsigned int)(k & 0xffffffffu);} ///<cellakulcs oszlopszáma
+	static unsigned int keyRow(CellKey k) {return (unsigned int)(k >> 32);} ///<cellakulcs sorszáma
+};
+
+#endif
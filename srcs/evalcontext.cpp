@@ -0,0 +1,5 @@
+#include "evalcontext.hpp"
+
+thread_local const EvalContext* EvalContext::active = nullptr;
+thread_local unsigned int EvalContext::originCol = 0;
+thread_local unsigned int EvalContext::originRow = 0;
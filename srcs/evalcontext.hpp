@@ -0,0 +1,58 @@
+#ifndef EVALCONTEXT_HPP
+#define EVALCONTEXT_HPP
+
+class Sheet;
+
+///Egy tábla kiértékelési környezete, ezen keresztül érik el a képletek hivatkozásai a táblát
+/**
+A kifejezésfák cellahivatkozásai nem tárolnak táblára mutató pointert, csak a hivatkozott
+cella sor- és oszlopszámát, így ugyanaz a fa bármelyik táblában használható, és a tábla
+másolásakor, mozgatásakor nem kell a fákat bejárni. A hivatkozásokat mindig az éppen aktív
+EvalContext táblájában oldjuk fel. Minden Sheet-nek egy saját, dinamikusan foglalt
+EvalContext-je van, a képletcellák erre mutatnak (ld. ExprPointer::bind), és kiértékeléskor
+ezt teszik aktívvá. Mivel az EvalContext címe nem változik, a tábla mozgatásakor elég a
+benne tárolt táblapointert átírni. A táblán kívüli kifejezéseket egy Scope objektummal
+lehet egy tábla környezetében kiértékelni.
+
+A Scope a hivatkozások origóját is beállítja: a nem abszolút hivatkozások az origóhoz képest
+relatívak (R1C1 alak), így az azonos relatív képletű cellák ugyanazt a fát használhatják, csak
+az origójuk (a saját helyük) más (ld. ExprPointer). A táblán kívüli fák origója (0, 0), ezekben
+a hivatkozások a cellák valódi sor- és oszlopszámát tárolják.
+*/
+class EvalContext {
+	const Sheet* sheet; ///<a tábla, amelyben a hivatkozásokat feloldjuk
+	static thread_local const EvalContext* active; ///<az adott szálon aktív környezet (nullptr, ha nincs)
+	static thread_local unsigned int originCol; ///<az adott szálon a relatív hivatkozások origójának oszlopa
+	static thread_local unsigned int originRow; ///<az adott szálon a relatív hivatkozások origójának sora
+public:
+	///az adott szálon a hatókör végéig a megadott környezetben és origóval oldódnak fel a hivatkozások
+	/**nullptr megadásakor a korábban aktív környezet marad érvényben, az origó mindig a megadott*/
+	class Scope {
+		const EvalContext* prev; ///<a korábban aktív környezet
+		unsigned int prevCol; ///<a korábbi origó oszlopa
+		unsigned int prevRow; ///<a korábbi origó sora
+	public:
+		explicit Scope(const EvalContext* context, unsigned int col = 0, unsigned int row = 0) : prev(active), prevCol(originCol), prevRow(originRow) {
+			if (context)
+				active = context;
+			originCol = col;
+			originRow = row;
+		} ///<konstruktor
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+		~Scope() {active = prev; originCol = prevCol; originRow = prevRow;} ///<visszaállítja a korábban aktív környezetet és origót
+	};
+	explicit EvalContext(const Sheet* sheet) : sheet(sheet) {} ///<konstruktor
+	EvalContext(const EvalContext&) = delete;
+	EvalContext& operator=(const EvalContext&) = delete;
+	const Sheet* getSheet() const {return sheet;} ///<a környezet táblájának lekérdezése
+	void setSheet(const Sheet* sh) {sheet = sh;} ///<a környezet táblájának beállítása (a tábla mozgatásakor)
+	static const Sheet* activeSheet() {return active ? active->sheet : nullptr;} ///<az adott szálon aktív tábla (nullptr, ha nincs)
+	///relatív koordináta feloldása az adott szálon aktív origóhoz képest
+	/**Az összeadás előjel nélküli túlcsordulással számol, így az origó előtti cellákra mutató
+	(negatív) eltolások is feloldhatók.*/
+	static unsigned int resolveCol(unsigned int col, bool absolute) {return absolute ? col : originCol + col;}
+	static unsigned int resolveRow(unsigned int row, bool absolute) {return absolute ? row : originRow + row;} ///<ld. resolveCol
+};
+
+#endif
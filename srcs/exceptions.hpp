@@ -2,6 +2,9 @@
 #define EXCEPTION_HPP
 
 #include <exception>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
 
 
 ///Saját exception osztály a szintaktikailag helytelen kifejezések értelmezésénél felmerülő hibákra.
@@ -20,5 +23,46 @@ public:
 	using std::runtime_error::runtime_error;
 };
 
+///Kiértékelési hibát hordozó számértékek kezelése
+/**
+A kiértékelés nem dob kivételt: a hibás cella értéke egy olyan csendes NaN, amelynek a
+bitjeiben egy jelölő és a hiba kódja van. A NaN-ok az aritmetikai műveleteken és az
+összegzésen a bitjeikkel együtt áthaladnak (az előjelük változhat, ezt a vizsgálat
+figyelmen kívül hagyja), így a hiba kivétel nélkül terjed a hivatkozó cellákra. A
+kiíró függvények a hibaértékeket "#ERR"-ként jelenítik meg, kivételt csak a hívó kérésére
+(ld. check, ExprPointer::evalMe) dobunk belőlük.
+*/
+class ErrorValue {
+	static const uint64_t MARK = 0x7FF8E00000000000; ///<a hibaértékek közös bitjei (csendes NaN)
+	static const uint64_t MASK = 0x7FFFFFFFFFFFFF00; ///<a jelölő bitjei (az előjel és a hibakód nélkül)
+	static uint64_t bits(double v) {uint64_t b; std::memcpy(&b, &v, sizeof b); return b;} ///<a szám bitjei
+public:
+	///a hibák fajtái
+	enum Code : unsigned char {
+		UNINITIALIZED = 1, ///<a hivatkozás nem oldható fel (nincs aktív kiértékelési környezet)
+		OUT_OF_RANGE, ///<a hivatkozás kilóg a táblából
+		CYCLIC, ///<körkörös hivatkozás
+		NOT_FOUND ///<a keresett érték nem szerepel a tartományban (ld. Sheet::rangeMatch)
+	};
+	static double make(Code code) {double v; uint64_t b = MARK | code; std::memcpy(&v, &b, sizeof v); return v;} ///<adott kódú hibaérték
+	static bool isError(double v) {return (bits(v) & MASK) == MARK;} ///<igaz, ha az érték hibaérték
+	static Code code(double v) {return (Code)(bits(v) & 0xFF);} ///<a hibaérték kódja
+	///a hiba szöveges leírása (az eval_error üzenete)
+	static const char* message(Code code) {
+		switch (code) {
+			case UNINITIALIZED: return "uninitialized cell";
+			case OUT_OF_RANGE: return "index out of range";
+			case NOT_FOUND: return "value not found";
+			default: return "cyclic reference";
+		}
+	}
+	///hibaérték esetén eval_error kivételt dob, különben visszaadja az értéket
+	static double check(double v) {
+		if (isError(v))
+			throw eval_error(message(code(v)));
+		return v;
+	}
+};
+
 
 #endif
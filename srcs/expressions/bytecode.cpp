@@ -0,0 +1,386 @@
+#include <cstring>
+#include <cstdint>
+#include <string>
+
+#include "bytecode.hpp"
+#include "expression.hpp"
+#include "../sheet.hpp"
+#include "../exceptions.hpp"
+
+
+void Bytecode::emit(OpCode op, unsigned int arg, int stackChange){
+	code.push_back({op, arg});
+	depth = (size_t)((long)depth + stackChange);
+	if (depth > maxDepth)
+		maxDepth = depth;
+}
+
+void Bytecode::pushConstant(double value){
+	constants.push_back(value);
+	emit(PUSH, (unsigned int)constants.size() - 1, 1);
+}
+
+void Bytecode::load(const CellArg& cell){
+	cells.push_back(cell);
+	emit(LOAD, (unsigned int)cells.size() - 1, 1);
+}
+
+void Bytecode::binary(OpCode op){
+	emit(op, 0, -1);
+}
+
+void Bytecode::unary(OpCode op){
+	emit(op, 0, 0);
+}
+
+///két cellahivatkozás azonos-e
+static bool sameCell(const Bytecode::CellArg& a, const Bytecode::CellArg& b){
+	return a.col == b.col && a.row == b.row && a.absCol == b.absCol && a.absRow == b.absRow;
+}
+
+unsigned int Bytecode::addRange(const CellArg& top, const CellArg& bottom){
+	for (size_t i = 0; i < ranges.size(); i++)
+		if (sameCell(ranges[i].top, top) && sameCell(ranges[i].bottom, bottom))
+			return (unsigned int)i;
+	ranges.push_back({top, bottom});
+	return (unsigned int)ranges.size() - 1;
+}
+
+void Bytecode::aggregate(OpCode op, const CellArg& top, const CellArg& bottom){
+	emit(op, addRange(top, bottom), 1);
+}
+
+void Bytecode::lookup(OpCode op, const CellArg& top, const CellArg& bottom){
+	emit(op, addRange(top, bottom), 0);
+}
+
+void Bytecode::condition(OpCode op, const CellArg& top, const CellArg& bottom){
+	emit(op, addRange(top, bottom), 0);
+}
+
+void Bytecode::finish(){
+	accumulated.assign(ranges.size(), false);
+	hasAccumulated = false;
+	for (const Instruction& ins : code) {
+		if (isAggregate(ins.op) && ins.op != SUM && ins.op != AVG) {
+			accumulated[ins.arg] = true;
+			hasAccumulated = true;
+		}
+	}
+}
+
+void Bytecode::evalNode(const Expression* node){
+	nodes.push_back(node);
+	emit(EVAL, (unsigned int)nodes.size() - 1, 1);
+}
+
+CellRect Bytecode::resolve(const RangeArg& range){
+	return {EvalContext::resolveCol(range.top.col, range.top.absCol), EvalContext::resolveRow(range.top.row, range.top.absRow),
+		EvalContext::resolveCol(range.bottom.col, range.bottom.absCol), EvalContext::resolveRow(range.bottom.row, range.bottom.absRow)};
+}
+
+double Bytecode::run() const {
+	if (!hasAccumulated)
+		return execute(nullptr);
+	//a számolók csak összesítést tartalmazó utasítássorozatnál foglalnak helyet
+	Accumulator small[4];
+	std::vector<Accumulator> large;
+	Accumulator* stats = small;
+	if (ranges.size() > 4) {
+		large.resize(ranges.size());
+		stats = large.data();
+	}
+	return execute(stats);
+}
+
+double Bytecode::execute(Accumulator* stats) const {
+	double small[16] = {}; //az értékadás nélkül a Release fordítás maybe-uninitialized figyelmeztetést ad
+	std::vector<double> large;
+	double* stack = small;
+	if (maxDepth > 16) {
+		large.resize(maxDepth);
+		stack = large.data();
+	}
+	size_t top = 0;
+	CellRect where = {0, 0, 0, 0}; //az utolsó feltétel tartománya és feltétele (ld. WHERE_EQ, ..., WHERE_GE)
+	Criterion criterion = {Criterion::EQ, 0};
+	const Sheet* sheet = EvalContext::activeSheet();
+	if (sheet == nullptr && (!cells.empty() || !ranges.empty()))
+		return ErrorValue::make(ErrorValue::UNINITIALIZED);
+	for (const Instruction& ins : code) {
+		switch (ins.op) {
+			case PUSH:
+				stack[top++] = constants[ins.arg];
+				break;
+			case LOAD: {
+				const CellArg& c = cells[ins.arg];
+				stack[top++] = sheet->cellValue(EvalContext::resolveCol(c.col, c.absCol), EvalContext::resolveRow(c.row, c.absRow));
+				break;
+			}
+			case ADD:
+				top--;
+				stack[top-1] = stack[top-1] + stack[top];
+				break;
+			case SUB:
+				top--;
+				stack[top-1] = stack[top-1] - stack[top];
+				break;
+			case MUL:
+				top--;
+				stack[top-1] = stack[top-1] * stack[top];
+				break;
+			case DIV:
+				top--;
+				stack[top-1] = stack[top-1] / stack[top];
+				break;
+			case NEG:
+				stack[top-1] = -stack[top-1];
+				break;
+			case SUM: case AVG: case MIN: case MAX: case COUNT: case PRODUCT: case VAR: case STDDEV: {
+				CellRect r = resolve(ranges[ins.arg]);
+				double count = (double)(r.col2 - r.col1 + 1) * (double)(r.row2 - r.row1 + 1);
+				if (!accumulated[ins.arg]) {
+					double sum = sheet->rangeSum(r);
+					stack[top++] = ins.op == SUM ? sum : sum / count;
+					break;
+				}
+				//a tartományt csak az első rá vonatkozó utasítás járja be
+				Accumulator& acc = stats[ins.arg];
+				if (acc.isEmpty())
+					acc = sheet->rangeAggregate(r);
+				stack[top++] = FunctionExpr::result(FunctionExpr::fromOpCode(ins.op), acc, count);
+				break;
+			}
+			case MATCH: case MATCH_SORTED:
+				stack[top-1] = sheet->rangeMatch(resolve(ranges[ins.arg]), stack[top-1], ins.op == MATCH_SORTED);
+				break;
+			case INDEX:
+				stack[top-1] = sheet->rangeIndex(resolve(ranges[ins.arg]), stack[top-1]);
+				break;
+			case WHERE_EQ: case WHERE_NE: case WHERE_LT: case WHERE_LE: case WHERE_GT: case WHERE_GE:
+				where = resolve(ranges[ins.arg]);
+				criterion = {(Criterion::Op)(ins.op - WHERE_EQ), stack[top-1]};
+				break;
+			case SUMIF: case COUNTIF: case AVGIF: {
+				double sum, count;
+				sheet->rangeSumIf(where, criterion, resolve(ranges[ins.arg]), sum, count);
+				stack[top-1] = ConditionalFunc::result(FunctionExpr::fromOpCode(ins.op), sum, count);
+				break;
+			}
+			case EVAL:
+				stack[top++] = nodes[ins.arg]->eval();
+				break;
+		}
+	}
+	return stack[0];
+}
+
+Bytecode* Bytecode::compile(const Expression& expr){
+	Bytecode* bc = new Bytecode();
+	expr.compile(*bc);
+	bc->finish();
+	return bc;
+}
+
+Expression* Bytecode::decompile(unsigned int col, unsigned int row) const {
+	if (!nodes.empty())
+		throw eval_error("expression cannot be decompiled");
+	//a fát a Parser-hez hasonlóan táblán kívüli alakban (origó: (0, 0)) építjük fel, és a végén toljuk az origóhoz
+	EvalContext::Scope scope(nullptr);
+	auto ref = [col, row](const CellArg& c){
+		return new CellRefExpr(Sheet::colLetter(c.absCol ? c.col : col + c.col), c.absRow ? c.row : row + c.row, c.absCol, c.absRow);
+	};
+	std::vector<Expression*> stack;
+	unsigned int where = 0; //az utolsó feltétel tartományának paramétere
+	for (const Instruction& ins : code) {
+		Expression* rhs = nullptr;
+		if (ins.op == ADD || ins.op == SUB || ins.op == MUL || ins.op == DIV) {
+			rhs = stack.back();
+			stack.pop_back();
+		}
+		switch (ins.op) {
+			case PUSH: stack.push_back(new NumberExpr(constants[ins.arg])); break;
+			case LOAD: stack.push_back(ref(cells[ins.arg])); break;
+			case ADD: stack.back() = new Add(stack.back(), rhs); break;
+			case SUB: stack.back() = new Sub(stack.back(), rhs); break;
+			case MUL: stack.back() = new Mult(stack.back(), rhs); break;
+			case DIV: stack.back() = new Div(stack.back(), rhs); break;
+			case NEG: stack.back() = new Negate(stack.back()); break;
+			case MATCH: case MATCH_SORTED:
+				stack.back() = new LookupFunc(stack.back(), ref(ranges[ins.arg].top), ref(ranges[ins.arg].bottom), ins.op == MATCH_SORTED);
+				break;
+			case INDEX: //a beolvasás ellenőrzi, hogy MATCH után áll
+				static_cast<LookupFunc*>(stack.back())->setResult(ref(ranges[ins.arg].top), ref(ranges[ins.arg].bottom));
+				break;
+			case WHERE_EQ: case WHERE_NE: case WHERE_LT: case WHERE_LE: case WHERE_GT: case WHERE_GE: //a függvényt a következő utasítás állítja be
+				where = ins.arg;
+				stack.back() = new ConditionalFunc(FunctionName::COUNTIF, ref(ranges[ins.arg].top), ref(ranges[ins.arg].bottom),
+					(Criterion::Op)(ins.op - WHERE_EQ), stack.back());
+				break;
+			case SUMIF: case COUNTIF: case AVGIF: { //a beolvasás ellenőrzi, hogy feltétel után áll
+				//a feltétel tartományát összegző (és a countif) utasítás a feltétel paraméterén osztozik
+				bool own = ins.arg == where;
+				static_cast<ConditionalFunc*>(stack.back())->setValues(FunctionExpr::fromOpCode(ins.op),
+					own ? nullptr : ref(ranges[ins.arg].top), own ? nullptr : ref(ranges[ins.arg].bottom));
+				break;
+			}
+			case EVAL: break;
+			default: //tartományon végzett összesítés
+				stack.push_back(FunctionExpr::newFunctionExpr(FunctionExpr::fromOpCode(ins.op), ref(ranges[ins.arg].top), ref(ranges[ins.arg].bottom)));
+				break;
+		}
+	}
+	//a többtagú összeadások a fordításkor egymás utáni ADD utasításokká bomlottak, az egyszerűsítés visszafűzi őket
+	Expression* expr = stack.back()->optimize();
+	expr->shift((int)(0u - col), (int)(0u - row));
+	return expr;
+}
+
+void Bytecode::collectRefs(std::vector<CellRect>& refs) const {
+	for (const Instruction& ins : code) {
+		if (ins.op == LOAD) {
+			const CellArg& c = cells[ins.arg];
+			unsigned int col = EvalContext::resolveCol(c.col, c.absCol), row = EvalContext::resolveRow(c.row, c.absRow);
+			refs.push_back({col, row, col, row});
+		} else if (usesRange(ins.op)) {
+			refs.push_back(resolve(ranges[ins.arg]));
+		}
+	}
+}
+
+///a Bytecode bináris alakjának fejléce
+struct StoredHeader {
+	uint32_t code; ///<utasítások száma
+	uint32_t constants; ///<konstansok száma
+	uint32_t cells; ///<cellahivatkozások száma
+	uint32_t ranges; ///<tartományok száma
+};
+
+///egy utasítás bináris alakja
+struct StoredInstruction {
+	uint32_t op; ///<utasítás típusa
+	uint32_t arg; ///<a paraméter indexe
+};
+
+///egy cellahivatkozás bináris alakja
+struct StoredCell {
+	uint32_t col; ///<oszlopszám vagy eltolás
+	uint32_t row; ///<sorszám vagy eltolás
+	uint32_t flags; ///<1: abszolút oszlop, 2: abszolút sor
+};
+
+///a bináris alak bővítése a [p, p+size) tartomány tartalmával
+static void append(std::string& out, const void* p, size_t size){
+	out.append(static_cast<const char*>(p), size);
+}
+
+///egy bináris rekord beolvasása, csonka adat esetén eval_error kivételt dob
+template <typename T>
+static T take(const char*& p, const char* end){
+	if ((size_t)(end - p) < sizeof(T))
+		throw eval_error("truncated snapshot");
+	T value;
+	std::memcpy(&value, p, sizeof(T));
+	p += sizeof(T);
+	return value;
+}
+
+void Bytecode::write(std::string& out) const {
+	if (!nodes.empty())
+		throw eval_error("expression cannot be saved");
+	StoredHeader header = {(uint32_t)code.size(), (uint32_t)constants.size(), (uint32_t)cells.size(), (uint32_t)ranges.size()};
+	append(out, &header, sizeof header);
+	for (const Instruction& ins : code) {
+		StoredInstruction stored = {ins.op, ins.arg};
+		append(out, &stored, sizeof stored);
+	}
+	append(out, constants.data(), constants.size() * sizeof(double));
+	auto storeCell = [&out](const CellArg& c){
+		StoredCell stored = {c.col, c.row, (uint32_t)c.absCol | (uint32_t)c.absRow << 1};
+		append(out, &stored, sizeof stored);
+	};
+	for (const CellArg& c : cells)
+		storeCell(c);
+	for (const RangeArg& r : ranges) {
+		storeCell(r.top);
+		storeCell(r.bottom);
+	}
+	out.resize((out.size() + 7) / 8 * 8, '\0');
+}
+
+Bytecode* Bytecode::read(const char*& p, const char* end){
+	const char* begin = p;
+	StoredHeader header = take<StoredHeader>(p, end);
+	//a darabszámokat a hátralévő adat méretéhez mérjük, mielőtt foglalnánk
+	if ((size_t)(end - p) / sizeof(StoredInstruction) < header.code || (size_t)(end - p) / sizeof(double) < header.constants
+			|| (size_t)(end - p) / sizeof(StoredCell) < (size_t)header.cells + 2 * (size_t)header.ranges)
+		throw eval_error("truncated snapshot");
+	Bytecode* bc = new Bytecode();
+	try {
+		for (uint32_t i = 0; i < header.code; i++) {
+			StoredInstruction stored = take<StoredInstruction>(p, end);
+			if (stored.op > EVAL)
+				throw eval_error("invalid instruction in snapshot");
+			bc->code.push_back({(OpCode)stored.op, stored.arg});
+		}
+		for (uint32_t i = 0; i < header.constants; i++)
+			bc->constants.push_back(take<double>(p, end));
+		auto readCell = [&](){
+			StoredCell stored = take<StoredCell>(p, end);
+			return CellArg{stored.col, stored.row, (stored.flags & 1) != 0, (stored.flags & 2) != 0};
+		};
+		for (uint32_t i = 0; i < header.cells; i++)
+			bc->cells.push_back(readCell());
+		for (uint32_t i = 0; i < header.ranges; i++) {
+			CellArg top = readCell();
+			bc->ranges.push_back({top, readCell()});
+		}
+		//a végrehajtás nem ellenőriz, ezért itt vizsgáljuk a paraméterindexeket és a veremhasználatot
+		for (size_t i = 0; i < bc->code.size(); i++) {
+			const Instruction& ins = bc->code[i];
+			size_t limit = 0;
+			int stackChange = 1;
+			switch (ins.op) {
+				case PUSH: limit = bc->constants.size(); break;
+				case LOAD: limit = bc->cells.size(); break;
+				case ADD: case SUB: case MUL: case DIV: limit = 1; stackChange = -1; break;
+				case NEG: limit = 1; stackChange = 0; break;
+				case MATCH: case MATCH_SORTED: limit = bc->ranges.size(); stackChange = 0; break;
+				case INDEX: //csak egy keresés eredményéből olvashat ki (ld. decompile)
+					if (i > 0 && (bc->code[i-1].op == MATCH || bc->code[i-1].op == MATCH_SORTED))
+						limit = bc->ranges.size();
+					stackChange = 0;
+					break;
+				case WHERE_EQ: case WHERE_NE: case WHERE_LT: case WHERE_LE: case WHERE_GT: case WHERE_GE:
+					//a feltétel és a feltételes összesítés mindig párban áll
+					if (i + 1 < bc->code.size() && isConditional(bc->code[i+1].op))
+						limit = bc->ranges.size();
+					stackChange = 0;
+					break;
+				case SUMIF: case COUNTIF: case AVGIF:
+					if (i > 0 && isCondition(bc->code[i-1].op))
+						limit = bc->ranges.size();
+					stackChange = 0;
+					break;
+				case SUM: case AVG: case MIN: case MAX: case COUNT: case PRODUCT: case VAR: case STDDEV: limit = bc->ranges.size(); break;
+				case EVAL: break; //nem menthető
+			}
+			if (ins.arg >= limit || bc->depth < (size_t)(stackChange < 1 ? 1 - stackChange : 0))
+				throw eval_error("invalid instruction in snapshot");
+			bc->depth = (size_t)((long)bc->depth + stackChange);
+			if (bc->depth > bc->maxDepth)
+				bc->maxDepth = bc->depth;
+		}
+		if (bc->depth != 1)
+			throw eval_error("invalid instruction in snapshot");
+		bc->finish();
+		size_t size = (size_t)(p - begin);
+		if ((size_t)(end - p) < (8 - size % 8) % 8)
+			throw eval_error("truncated snapshot");
+		p += (8 - size % 8) % 8;
+	} catch (...) {
+		delete bc;
+		throw;
+	}
+	return bc;
+}
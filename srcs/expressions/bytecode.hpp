@@ -0,0 +1,125 @@
+#ifndef BYTECODE_HPP
+#define BYTECODE_HPP
+
+#include <vector>
+#include <cstddef>
+#include <string>
+
+#include "../dependency.hpp"
+
+class Expression;
+class Sheet;
+class Accumulator;
+
+///Kifejezésfából fordított, veremgéppel végrehajtható utasítássorozat
+/**
+A kifejezésfa kiértékelése csomópontonként egy virtuális függvényhívással és a bal, illetve
+jobb oldali operandusokra mutató pointerek követésével jár. A Bytecode a fát egyszer
+postfix sorrendű, tömör utasításlistává fordítja, amit egyetlen ciklus hajt végre egy
+kis veremgépen. Az utasítások paramétereit (konstansok, cellák, tartományok) külön
+tömbökben tárolja, az utasításban csak ezek indexe szerepel. A cellahivatkozások a
+hivatkozott cella tárolt értékét olvassák (ld. ExprPointer::result) az aktív kiértékelési
+környezet táblájából (ld. EvalContext). A nem abszolút hivatkozások az aktív origóhoz képest
+relatívak, így a lefordított alak sem táblához, sem cellához nem kötődik: az azonos relatív
+képletű cellák egyetlen lefordított alakon osztoznak. Az ismeretlen
+típusú csomópontokat a fordító egy, a csomópontot a fában kiértékelő utasítással
+helyettesíti, ezért minden kifejezés lefordítható.
+
+Az azonos tartományra hivatkozó összesítések egy paraméteren osztoznak. Ha egy tartományon
+a sum-on és avg-n kívül más összesítés is van, a végrehajtás a tartományt egyszer járja be
+(ld. Sheet::rangeAggregate), és a többi összesítés ugyanabból a számolóból olvas.
+*/
+class Bytecode {
+public:
+	///az utasítások típusai
+	enum OpCode : unsigned char {
+		PUSH, ///<konstans a verembe
+		LOAD, ///<cella értéke a verembe
+		ADD, SUB, MUL, DIV, ///<a verem két felső elemén végzett művelet
+		NEG, ///<a verem felső elemének ellentettje
+		SUM, AVG, ///<tartomány összege, illetve átlaga a verembe
+		MIN, MAX, COUNT, PRODUCT, VAR, STDDEV, ///<tartomány további összesítései a verembe (ld. Accumulator)
+		MATCH, MATCH_SORTED, ///<a verem felső elemének (kulcs) pontos, illetve közelítő helye a tartományban (ld. Sheet::rangeMatch)
+		INDEX, ///<a tartomány verem felső eleme szerinti helyű cellájának értéke (ld. Sheet::rangeIndex), csak MATCH után állhat
+		WHERE_EQ, WHERE_NE, WHERE_LT, WHERE_LE, WHERE_GT, WHERE_GE,
+			///<feltétel: a tartomány cellái a verem felső eleméhez (küszöbérték) hasonlítva (ld. Criterion), csak SUMIF, COUNTIF vagy AVGIF előtt állhat
+		SUMIF, COUNTIF, AVGIF, ///<az előző feltételt teljesítő cellákhoz tartozó értékek összege, száma, illetve átlaga a tartományból (ld. Sheet::rangeSumIf)
+		EVAL ///<egy csomópont kiértékelése a fában (ismeretlen csomóponttípusokhoz)
+	};
+	///egy utasítás: típus és a paramétertömbbeli index
+	struct Instruction {
+		OpCode op; ///<utasítás típusa
+		unsigned int arg; ///<a paraméter indexe a típusnak megfelelő tömbben
+	};
+	///cellahivatkozás paraméterei (a nem abszolút koordináták az origóhoz képest, ld. EvalContext)
+	struct CellArg {
+		unsigned int col; ///<oszlopszám (1-től indexelve), vagy az origóhoz képesti eltolás
+		unsigned int row; ///<sorszám (1-től indexelve), vagy az origóhoz képesti eltolás
+		bool absCol; ///<abszolút-e az oszlop
+		bool absRow; ///<abszolút-e a sor
+	};
+private:
+	///tartomány paraméterei
+	struct RangeArg {
+		CellArg top; ///<bal felső sarok
+		CellArg bottom; ///<jobb alsó sarok
+	};
+	std::vector<Instruction> code; ///<az utasítások végrehajtási sorrendben
+	std::vector<double> constants; ///<konstansok
+	std::vector<CellArg> cells; ///<cellahivatkozások
+	std::vector<RangeArg> ranges; ///<tartományok
+	std::vector<const Expression*> nodes; ///<a fában kiértékelendő csomópontok
+	std::vector<bool> accumulated; ///<tartományonként: egy bejárással, közös számolóval összesítjük-e (ld. finish)
+	bool hasAccumulated = false; ///<van-e közös számolóval összesített tartomány
+	size_t depth = 0; ///<a verem mélysége a fordítás aktuális pontján
+	size_t maxDepth = 0; ///<a végrehajtáshoz szükséges veremméret
+
+	void emit(OpCode op, unsigned int arg, int stackChange); ///<utasítás hozzáfűzése
+	unsigned int addRange(const CellArg& top, const CellArg& bottom); ///<a tartomány paraméterének indexe (az azonos tartományok egy paraméteren osztoznak)
+	static CellRect resolve(const RangeArg& range); ///<a tartomány feloldása az aktív origóhoz képest
+	static bool isAggregate(OpCode op) {return op >= SUM && op <= STDDEV;} ///<tartományon végzett összesítés-e az utasítás
+	static bool usesRange(OpCode op) {return op >= SUM && op <= AVGIF;} ///<tartomány paraméteres-e az utasítás
+	static bool isCondition(OpCode op) {return op >= WHERE_EQ && op <= WHERE_GE;} ///<feltétel-e az utasítás
+	static bool isConditional(OpCode op) {return op >= SUMIF && op <= AVGIF;} ///<feltételes összesítés-e az utasítás
+	///a fordítás (vagy beolvasás) lezárása: megjelöli a sum-on és avg-n kívül más összesítést is kérő tartományokat
+	void finish();
+	///az utasítások végrehajtása, a megjelölt tartományok számolóit a stats tömbben tartja
+	double execute(Accumulator* stats) const;
+public:
+	void pushConstant(double value); ///<konstans verembe helyezése
+	void load(const CellArg& cell); ///<cella értékének verembe helyezése
+	void binary(OpCode op); ///<kétoperandusú művelet (ADD, SUB, MUL, DIV)
+	void unary(OpCode op); ///<egyoperandusú művelet (NEG)
+	///tartományon végzett függvény (SUM, AVG, MIN, ..., STDDEV), az azonos tartományok egy paraméteren osztoznak
+	void aggregate(OpCode op, const CellArg& top, const CellArg& bottom);
+	void lookup(OpCode op, const CellArg& top, const CellArg& bottom); ///<keresés a tartományban, illetve kiolvasás (MATCH, MATCH_SORTED, INDEX)
+	///feltétel, illetve feltételes összesítés a tartományon (WHERE_EQ, ..., WHERE_GE, majd SUMIF, COUNTIF vagy AVGIF)
+	void condition(OpCode op, const CellArg& top, const CellArg& bottom);
+	void evalNode(const Expression* node); ///<csomópont kiértékelése a fában
+
+	///végrehajtja az utasításokat és visszaadja a verem tetején maradt értéket
+	/**kivételt nem dob, hiba esetén (pl. ha hivatkozás esetén nincs aktív környezet) hibaértéket ad (ld. ErrorValue)*/
+	double run() const;
+	size_t size() const {return code.size();} ///<utasítások száma
+	const std::vector<Instruction>& instructions() const {return code;} ///<utasítások lekérdezése
+
+	static Bytecode* compile(const Expression& expr); ///<kifejezés fordítása dinamikusan foglalt memóriaterületre
+	///visszafejti az utasításokat egy kifejezésfává, amelyet a fordítás (compile) erre az utasítássorozatra képezne
+	/**A fa relatív hivatkozásai a Bytecode-éhoz hasonlóan az origóhoz képest értendők, a megadott
+	origó a tartományok sarkainak sorrendjéhez kell (ld. Range). A fát az aktív NodeArena-ban hozza
+	létre. EVAL utasítást tartalmazó Bytecode nem fejthető vissza, ekkor eval_error kivételt dob.*/
+	Expression* decompile(unsigned int col, unsigned int row) const;
+	///a hivatkozott cellák és tartományok kigyűjtése az aktív origóhoz képest feloldva (ld. Expression::collectRefs)
+	void collectRefs(std::vector<CellRect>& refs) const;
+	///az utasítások és paramétereik bináris alakjának hozzáfűzése a megadott stringhez (ld. Snapshot)
+	/**Az alak egy fejlécből és rögzített méretű rekordokból áll, 8 bájtra kiegészítve, így az azonos
+	utasítássorozatok alakja is azonos. EVAL utasítást tartalmazó Bytecode nem írható ki, ekkor
+	eval_error kivételt dob.*/
+	void write(std::string& out) const;
+	///a write által kiírt bináris alak beolvasása a [p, end) tartományból, p a beolvasott rész után folytatódik
+	/**Az utasításokat ellenőrzi (paraméterindexek, veremhasználat), hibás vagy csonka adat esetén
+	eval_error kivételt dob.*/
+	static Bytecode* read(const char*& p, const char* end);
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "expression_core.hpp"
@@ -15,9 +16,9 @@ class CellId {
 	unsigned int colNum; ///<oszlop sorszáma 1-től indexelve
 	unsigned int row; ///<sorszám 1-től indexelve
 public:
-	explicit CellId(const std::string& col, unsigned int row) : colNum(Sheet::colNumber(col)), row(row) {}
+	explicit CellId(std::string_view col, unsigned int row) : colNum(Sheet::colNumber(col)), row(row) {}
 			///<konstruktor oszlopjelölő betű és sorszám megadásával
-	explicit CellId(const std::string&); ///<konstruktor "[oszlopbetű][sorszám]" formátumú bemenettel
+	explicit CellId(std::string_view); ///<konstruktor "[oszlopbetű][sorszám]" formátumú bemenettel
 	unsigned int getColNum() const {return colNum;} ///<oszlopszám lekérdezése
 	unsigned int getRow() const {return row;} ///<sorszám lekérdezése
 	void setColNum(unsigned int c) {colNum = c;} ///<oszlopszám beállítása
@@ -27,45 +28,54 @@ public:
 
 ///Cellahivatkozást reprezentáló kifejezés osztály.
 /**A hivatkozás egy tábla (Sheet) egy cellájára mutathat oszlop és sor megadásával.
-Mind az oszlopa, mind a sora egymástól független lehetnek abszolútak.*/
+Mind az oszlopa, mind a sora egymástól független lehetnek abszolútak. A hivatkozás nem
+tárolja a táblát, az éppen aktív kiértékelési környezet táblájában oldódik fel (ld. EvalContext).
+A nem abszolút koordinátákat az aktív origóhoz képest értelmezzük: a cellába írt képletek fáiban
+ezek a cellához képesti eltolások, a táblán kívüli fákban (origó: (0, 0)) a valódi sor- és
+oszlopszámok. A lekérdező függvények és a kiíratás a feloldott koordinátákat adják.*/
 class CellRefExpr : public Expression {
-	CellId cell; ///<cellát azonosító sor- és oszlopadat
-	Sheet* refSheet; ///<tábla, amelyre a hivatkozás mutat
+	//a jelzők a vtable pointer mögé kerülnek, így a csomópont 24 bájtos marad
 	bool absCol; ///<oszlopát tekintve abszolút-e a hivatkozás
 	bool absRow; ///<sorát tekintve abszolút-e a hivatkozás
+	CellId cell; ///<cellát azonosító sor- és oszlopadat
 public:
 	///konstruktor oszlopjelölő betű és sorszám megadásával
 	/**
 	@param col - oszlopbetű
 	@param row - sorszám
-	@param refSheet - tábla, amelyre a hivatkozás mutat
 	@param absCol - abszolút hivatkozás-e az oszlop
 	@param absRow - abszolút hivatkozás-e a sor
 	 */
-	explicit CellRefExpr(const std::string& col, unsigned int row, Sheet* refSheet = nullptr, bool absCol=false, bool absRow=false)
-		: cell(CellId(col, row)), refSheet(refSheet), absCol(absCol), absRow(absRow) {}
+	explicit CellRefExpr(std::string_view col, unsigned int row, bool absCol=false, bool absRow=false)
+		: absCol(absCol), absRow(absRow), cell(CellId(col, row)) {}
 
 	///konstruktor "[oszlopbetű][sorszám]" formátumú bemenettel
 	/**
 	@param str - cella jelölője ("[oszlopbetű][sorszám]")
-	@param refSheet - tábla, amelyre a hivatkozás mutat
 	@param absCol - abszolút hivatkozás-e az oszlop
 	@param absRow - abszolút hivatkozás-e a sor
 	 */
-	explicit CellRefExpr(const std::string& str, Sheet* refSheet = nullptr, bool absCol=false, bool absRow=false)
-		: cell(CellId(str)), refSheet(refSheet), absCol(absCol), absRow(absRow) {}
-	std::string getCol() const {return cell.colLetter();} ///<oszlopbetű lekérdezése
-	unsigned int getRow() const {return cell.getRow();} ///<sorszám lekérdezése
-	Sheet* getSheet() const {return refSheet;} ///<hivatkozás által mutatott tábla lekérdezése
+	explicit CellRefExpr(std::string_view str, bool absCol=false, bool absRow=false)
+		: absCol(absCol), absRow(absRow), cell(CellId(str)) {}
+	std::string getCol() const {return Sheet::colLetter(getColNum());} ///<oszlopbetű lekérdezése
+	unsigned int getColNum() const {return EvalContext::resolveCol(cell.getColNum(), absCol);} ///<oszlopszám lekérdezése (az aktív origóhoz képest feloldva)
+	unsigned int getRow() const {return EvalContext::resolveRow(cell.getRow(), absRow);} ///<sorszám lekérdezése (az aktív origóhoz képest feloldva)
+	Bytecode::CellArg operand() const {return {cell.getColNum(), cell.getRow(), absCol, absRow};} ///<a hivatkozás tárolt (feloldatlan) alakja
 
-	///hivatkozás által mutatott cellára mutató pointer lekérdezése
-	ExprPointer* getPtr() const {if (refSheet == nullptr) throw eval_error("uninitialized cell");
-		return refSheet->parseCell(cell.getColNum(), cell.getRow());}
+	///hivatkozás által mutatott cellára mutató pointer lekérdezése az aktív környezet táblájában
+	/**Ha nincs aktív környezet, vagy a cella kilóg a táblából, eval_error kivételt dob.*/
+	ExprPointer* getPtr() const {
+		const Sheet* sh = EvalContext::activeSheet();
+		if (sh == nullptr)
+			throw eval_error("uninitialized cell");
+		return sh->parseCell(getColNum(), getRow());
+	}
 	bool getAbsCol() const {return absCol;} ///<oszlop abszolút voltának lekérdezése
 	bool getAbsRow() const {return absRow;} ///<sor abszolút voltának lekérdezése
-	double eval() const; ///<hivatkozás által mutatott cella kiértékelése
-	void checkCyclic(std::vector<Expression*>) const;
-	std::string show() const {return (absCol?"$":"") + cell.colLetter() + (absRow?"$":"") + std::to_string(cell.getRow());}
+	///hivatkozás által mutatott cella kiértékelése (a cella tárolt értékét használja)
+	/**Ha nincs aktív környezet, vagy a cella kilóg a táblából, hibaértéket ad (ld. ErrorValue).*/
+	double eval() const;
+	std::string show() const {return (absCol?"$":"") + getCol() + (absRow?"$":"") + std::to_string(getRow());}
 	CellRefExpr* copy() const {return new CellRefExpr(*this);}
 
 	///Eltolja a hivatkozást adott sorral és oszloppal, amennyiben a sor/oszlop nem abszolút
@@ -74,7 +84,11 @@ public:
 	@param dy - oszlop eltolásának mértéke (akár negatív)
 	*/
 	void shift(int dx, int dy);
-	void relocate(Sheet* shp) {refSheet = shp;} ///<a cellahivatkozás célpontját áthelyezi egy másik számolótáblára
+	bool hasRefs() const {return true;}
+	void compile(Bytecode& bc) const {bc.load(operand());}
+	void collectRefs(std::vector<CellRect>& refs) const {
+		refs.push_back({getColNum(), getRow(), getColNum(), getRow()});
+	}
 };
 
 
@@ -5,6 +5,17 @@
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <exception>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+
+#include "../exceptions.hpp"
+#include "../dependency.hpp"
+#include "../arena.hpp"
+#include "../evalcontext.hpp"
+#include "bytecode.hpp"
 
 class Sheet;
 
@@ -12,25 +23,38 @@ class Sheet;
 class Expression {
 public:
 	///rekurzívan kiértékeli a kifejezést.
-	/**kiértékelés közben eval_error típusa kivételt dobhat*/
+	/**kivételt nem dob, hiba esetén hibaértéket ad vissza (ld. ErrorValue)*/
 	virtual double eval() const = 0;
-	///ellenőrzi, tartalmaz-e a kifejezés ciklikus referenciát
-	/**amennyiben igen, eval_error kivételt dob
-	@param prevs - a kifejezésben korábban hivatkozott cellák, amire ismét hivatkozva körkörös hivatkozást kapunk
-	*/
-	virtual void checkCyclic(std::vector<Expression*>) const = 0;
-	///rekurzívan kiértékeli a kifejezést, körkörös hivatkozásra is eval_error hibát dob
-  /**
-	@param prevs - a kifejezésben korábban hivatkozott cellák, amire ismét hivatkozva körkörös hivatkozást kapunk
-	*/
-	double safeEval(std::vector<Expression*> prevs) const {checkCyclic(prevs); return eval();}
 	virtual std::string show() const = 0; ///<kifejezés megjelenítése std::string-ként
 	virtual Expression* copy() const = 0; ///<dinamikusan foglalt memóriaterületen visszaadott másolat
 	virtual void shift(int, int) {} ///<rekurzívan minden hivatkozást adott oszlop- és sorszámmal eltol
-	virtual void relocate(Sheet*) {} ///<a kifejezésben található hivatkozások célpontját áthelyezi egy másik számolótáblára
+	virtual void collectRefs(std::vector<CellRect>&) const {} ///<a kifejezésben szereplő cella- és tartományhivatkozások kigyűjtése
+	///a kifejezést postfix sorrendben utasításokká fordítja (alapértelmezetten a csomópontot a fában értékelteti ki)
+	virtual void compile(Bytecode& bc) const {bc.evalNode(this);}
+	virtual bool isConstant() const {return false;} ///<igaz, ha a kifejezés értéke nem függ más celláktól
+	virtual bool hasRefs() const {return false;} ///<igaz, ha a kifejezésben van cella- vagy tartományhivatkozás (ld. shift)
+	///a kifejezés egyszerűsítése (konstansok összevonása, azonosságok elhagyása)
+	/**A hívás átveszi a kifejezés tulajdonjogát: a visszaadott, egyszerűsített kifejezés lehet
+	maga az objektum vagy egy új, dinamikusan foglalt kifejezés, utóbbi esetben az eredeti
+	objektum felszabadul.*/
+	virtual Expression* optimize() {return this;}
+	static void* operator new(size_t size) {return NodeArena::allocate(size);} ///<foglalás az aktív NodeArena-ból (ld. NodeArena::Scope)
+	static void operator delete(void* p, size_t size) {NodeArena::release(p, size);} ///<csomópont felszabadítása
 	virtual ~Expression() {}; ///<destruktor
 };
 
+///Valós számokat tároló kifejezés osztály
+class NumberExpr : public Expression {
+	double value; ///<kifejezés értéke
+public:
+	explicit NumberExpr(double v) : value(v) {} ///<konstruktor
+	double eval() const {return value;} ///<kifejezés kiértékelése - érték visszaadása
+	Expression* copy() const {return new NumberExpr(value);}
+	bool isConstant() const {return true;}
+	void compile(Bytecode& bc) const {bc.pushConstant(value);}
+	std::string show() const {std::ostringstream ss; ss << value; return ss.str();}
+};
+
 ///A kifejezésekre mutató pointerek wrapper osztálya.
 /**
 *Az Expression absztrakt osztályból származtatott osztályok példányait heterogén
@@ -39,37 +63,298 @@ foglalt memóriaterületekre, a pointerek másolására, értékadásra. Az Expr
 osztály ezt hivatott lekezelni, azáltal, hogy a másolja és felszabadítja a pointereket,
 de az eredeti funkciójukat is megtartja. Így minden kifejezést gyakorlatilag sima
 osztálypéldányként tudunk kezelni (pointer helyett).
+
+Az ExprPointer egyetlen 8 bájtos mező (bits), amely vagy közvetlenül egy számot tárol
+(szám cella), vagy egy képletre mutat. A két esetet a NaN értékek kihasználatlan bitjei
+különböztetik meg: a képletre mutató pointert egy olyan negatív NaN hordozza, amely
+számként sosem kerül a mezőbe (a NaN számokat egységes alakra hozzuk). Így a táblák
+leggyakoribb, konstans cellái nem foglalnak kifejezést, és az értékük kiolvasása egy
+bitvizsgálat. A konstruktor a kapott NumberExpr-t is számként tárolja el.
+
+A képlet saját adatai (a gyorsítótárazott érték, a cella helye és a tábla kiértékelési
+környezete) egy külön foglalt Formula rekordban vannak, a kifejezésfa és a lefordított alakja
+pedig egy Body-ban, amelyet a képletek megosztanak egymással (copy-on-write): másoláskor csak a
+Body számlálója nő, a fa akkor klónozódik, ha egy megosztott fát módosítanánk. A megosztott fát
+ezért csak olvasni szabad, a nyíl operátor is konstans kifejezést ad vissza. A Body az utolsó
+rá mutató ExprPointer megszűnésekor szabadul fel.
+
+A fa hivatkozásai a környezet táblájában oldódnak fel (ld. EvalContext), a nem abszolút
+hivatkozások pedig a képlet origójához (a cella helyéhez) képest relatívak (R1C1 alak). Így
+egy képlet eltolása (shift) csak az origót mozgatja, a fához nem nyúl: a lehúzott (pull) vagy
+ismétlődő képletű cellák egyetlen fán és lefordított alakon osztoznak, cellánként csak a
+Formula rekord foglal memóriát. A táblán kívül létrehozott fák origója (0, 0), a táblába
+kerüléskor a tábla a cella helyére teszi át az origót (ld. place), a hivatkozott cellák nem
+változnak.
 */
 class ExprPointer {
-	Expression* content; ///<az osztály által becsomagolt pointer
+	friend class Snapshot;
+	friend class SheetImage;
+public:
+	///a cellában gyorsítótárazott érték lehetséges állapotai
+	enum CacheState {
+		DIRTY, ///<a tárolt érték elavult, a következő lekérdezéskor újra kell számolni
+		EVALUATING, ///<a cella kiértékelése folyamatban van (ha ismét ide érünk, körkörös a hivatkozás)
+		VALID, ///<a tárolt érték érvényes
+		FAILED, ///<a kiértékelés hibával végződött, a tárolt érték hibaérték (ld. ErrorValue)
+		CYCLIC ///<a cella körkörös hivatkozásban vesz részt (ezt a tábla állítja be módosításkor)
+	};
+	///a nyíl operátor visszatérési értéke, szám cella esetén egy ideiglenes NumberExpr-t ad
+	/**A kifejezés végéig él, így a cell->show() alakú hívások szám cellára is működnek. Addig
+	a képlet kiértékelési környezetét és origóját is aktívvá teszi, így a cell->eval() a cella
+	táblájában oldja fel a hivatkozásokat, a cell->show() pedig a cellához képest írja ki őket.*/
+	class Arrow {
+		NumberExpr number; ///<szám cella esetén az értéket tartalmazó ideiglenes kifejezés
+		const Expression* expr; ///<a kifejezés, amelyre a nyíl mutat
+		EvalContext::Scope scope; ///<a képlet környezete és origója a nyíl élettartama alatt
+	public:
+		explicit Arrow(const Expression* p, const EvalContext* context, unsigned int col, unsigned int row)
+			: number(0), expr(p), scope(context, col, row) {} ///<konstruktor képlethez
+		explicit Arrow(double v) : number(v), expr(&number), scope(nullptr) {} ///<konstruktor szám cellához
+		Arrow(const Arrow&) = delete;
+		const Expression* operator->() const {return expr;} ///<a kifejezés tagjainak elérése
+	};
+private:
+	///a képletek között megosztott kifejezésfa és lefordított alakja
+	struct Body {
+		Expression* content; ///<a kifejezésfa gyökere (pillanatképből betöltött képletnél az első használatig nullptr, ld. tree)
+		std::atomic<Bytecode*> code{nullptr}; ///<a kifejezés lefordított alakja (az első kiértékeléskor készül el, akár párhuzamosan)
+		std::atomic<unsigned int> shares{0}; ///<a Body-ra mutató képletek száma (párhuzamos betöltéskor több szálról is változhat)
+		explicit Body(Expression* content) : content(content) {} ///<konstruktor, átveszi a fát
+		~Body() {delete content; delete code.load();} ///<felszabadítja a fát és a lefordított alakot
+	};
+	///egy képlet cella adatai
+	struct Formula {
+		Body* body; ///<a kifejezésfa és a lefordított alak (más ExprPointer-ekkel megosztva)
+		double value = 0; ///<a kifejezés legutóbb kiszámolt értéke
+		CacheState state = DIRTY; ///<a tárolt érték állapota
+		unsigned int col; ///<az origó oszlopa (a cellába írt képletnél a cella oszlopszáma)
+		unsigned int row; ///<az origó sora (a cellába írt képletnél a cella sorszáma)
+		const EvalContext* context; ///<a cellát tartalmazó tábla környezete (nullptr esetén az éppen aktív)
+		explicit Formula(Body* body, const EvalContext* context = nullptr, unsigned int col = 0, unsigned int row = 0)
+			: body(body), col(col), row(row), context(context) {share(body);} ///<konstruktor, a Body-t megosztja
+		~Formula() {release(body);} ///<elengedi a Body-t
+	};
+	static const uint64_t TAG_MASK = 0xFFFF000000000000; ///<a képletet jelölő bitek helye
+	static const uint64_t FORMULA_TAG = 0xFFFC000000000000; ///<a képletet jelölő bitminta (negatív NaN)
+	static const uint64_t CANONICAL_NAN = 0x7FF8000000000000; ///<a szám cellákban tárolt NaN alakja
+
+	uint64_t bits; ///<a tárolt szám bitjei, vagy FORMULA_TAG és a Formula rekord címe
+
+	static uint64_t numberBits(double v) {
+		uint64_t b;
+		std::memcpy(&b, &v, sizeof b);
+		return v != v ? CANONICAL_NAN : b;
+	} ///<a szám tárolt alakja (a NaN-t egységesíti, hogy ne keveredjen a jelölt pointerekkel)
+	static uint64_t formulaBits(Formula* f) {return FORMULA_TAG | (uint64_t)(uintptr_t)f;} ///<a Formula rekord címének tárolt alakja
+	Formula* formula() const {return (Formula*)(uintptr_t)(bits & ~TAG_MASK);} ///<a képlet adatai (szám cellánál nem használható)
+	bool hasFormula() const {return !isNumber() && formula() != nullptr;} ///<igaz, ha az ExprPointer egy képletre mutat
+	static uint64_t copyBits(const ExprPointer& rhs) {
+		if (!rhs.hasFormula())
+			return rhs.bits;
+		const Formula* f = rhs.formula();
+		return formulaBits(new Formula(f->body, f->context, f->col, f->row));
+	} ///<a másik ExprPointer tárolt alakja egy saját Formula rekorddal (a Body-t megosztja)
+	static uint64_t fromExpression(Expression* p); ///<a konstruktornak átadott kifejezés tárolt alakja
+	///a képlet fája, a pillanatképből betöltött képleteknél az első használatkor fejti vissza a lefordított alakból
+	/**A visszafejtés (ld. Bytecode::decompile) nem szálbiztos, csak a tábla módosításakor és a
+	kifejezések kiíratásakor történik, a kiértékelés a lefordított alakot használja.*/
+	static Expression* tree(const Formula* f) {
+		if (f->body->content == nullptr)
+			f->body->content = f->body->code.load()->decompile(f->col, f->row);
+		return f->body->content;
+	}
+	///a Body lefordított alakja, az első híváskor lefordítja a fát (több szálról is hívható)
+	static Bytecode* compiled(Body* b) {
+		Bytecode* code = b->code.load(std::memory_order_acquire);
+		if (code == nullptr) {
+			//a megosztott fát több szál is fordíthatja egyszerre, a vesztes eldobja a sajátját
+			Bytecode* fresh = Bytecode::compile(*b->content);
+			if (b->code.compare_exchange_strong(code, fresh, std::memory_order_acq_rel))
+				code = fresh;
+			else
+				delete fresh;
+		}
+		return code;
+	}
+	static void share(Body* b) {b->shares++;} ///<egy újabb képlet mutat a Body-ra
+	static void release(Body* b) {if (--b->shares == 0) delete b;} ///<egy képlet elengedi a Body-t, az utolsó felszabadítja
+	///módosítás előtt saját példányt készít a fáról, ha azt más ExprPointer is használja, és eldobja a lefordított alakot
+	Expression* own() {
+		Formula* f = formula();
+		if (f->body->shares > 1) {
+			Body* cpy = new Body(tree(f)->copy());
+			release(f->body);
+			f->body = cpy;
+			share(cpy);
+		}
+		Expression* content = tree(f);
+		delete f->body->code.exchange(nullptr);
+		f->state = DIRTY;
+		return content;
+	}
+	void clear() {if (!isNumber()) delete formula();} ///<felszabadítja a képlet adatait
+	double evalFormula() const; ///<a képlet kiértékelése (ld. result)
 public:
-	ExprPointer(Expression* p = nullptr) : content(p) {} ///<konstruktor pointer inicializálásával
-	ExprPointer(const ExprPointer& rhs) : content(rhs.content->copy()) {} ///<másoló konstruktor
-	operator Expression*() const {return content;} ///<castolás Expression*-ra
+	ExprPointer(Expression* p = nullptr) : bits(fromExpression(p)) {}
+		///<konstruktor pointer inicializálásával, átveszi a fát (NumberExpr esetén csak az értékét tartja meg), az origó (0, 0)
+	static ExprPointer newNumber(double v) {ExprPointer ep; ep.bits = numberBits(v); return ep;} ///<szám cella létrehozása
+	ExprPointer(const ExprPointer& rhs) : bits(copyBits(rhs)) {}
+		///<másoló konstruktor, a fát, az origót és a környezetet átveszi (a fát megosztja), a gyorsítótárat nem másolja
+	ExprPointer(ExprPointer&& rhs) noexcept : bits(rhs.bits) {rhs.bits = FORMULA_TAG;}
+		///<mozgató konstruktor, a fát és a gyorsítótárat is átveszi, a másik ExprPointer üres marad
+	operator const Expression*() const {return hasFormula() ? tree(formula()) : nullptr;}
+		///<castolás (konstans) Expression*-ra, szám cella esetén nullptr (a relatív hivatkozások feloldásához ld. operator->)
 	ExprPointer& operator=(const ExprPointer& rhs) {
 		if (&rhs != this) {
-			delete content;
-			content = rhs.content->copy();
+			if (!rhs.hasFormula()) {
+				clear();
+				bits = rhs.bits;
+			} else if (hasFormula()) {
+				Formula* f = formula();
+				share(rhs.formula()->body);
+				release(f->body);
+				f->body = rhs.formula()->body;
+				f->col = rhs.formula()->col;
+				f->row = rhs.formula()->row;
+				f->state = DIRTY;
+			} else {
+				bits = copyBits(rhs);
+			}
 		}
 		return *this;
-	} ///<értékadás a másik kifejezés rekurzív másolásával
-	bool operator==(const ExprPointer& rhs) const {return content == rhs.content;} ///<egyenlőség másik ExprPointer-el
-	bool operator==(Expression* p) {return content == p;} ///<egyenlőség Expression*-al
-	Expression* operator->() const {return content;} ///<becsomagolt pointer adatainak és függvényeinek elérése nyíllal
-	double evalMe() {return content->safeEval({content});}
-		///<kiértékeli az adott kifejezést úgy, hogy, a körkörös hivatkozások keresése tőle indul
-	~ExprPointer() {delete content;} ///<felszabadítja a pointert
+	} ///<értékadás a másik kifejezés fájának megosztásával és origójának átvételével, a tárolt értéket érvényteleníti (a saját környezet megmarad)
+	ExprPointer& operator=(ExprPointer&& rhs) noexcept {
+		if (&rhs != this) {
+			clear();
+			bits = rhs.bits;
+			rhs.bits = FORMULA_TAG;
+		}
+		return *this;
+	} ///<mozgató értékadás, a fát és a gyorsítótárat is átveszi, a másik ExprPointer üres marad
+	bool isNumber() const {return (bits & TAG_MASK) != FORMULA_TAG;} ///<igaz, ha a cella közvetlenül egy számot tárol
+	double getNumber() const {double v; std::memcpy(&v, &bits, sizeof v); return v;} ///<szám cella értéke
+	///a kifejezés nem abszolút hivatkozásainak eltolása (ld. Expression::shift)
+	/**Csak az origót mozgatja, a fa (és a megosztása) változatlan marad.*/
+	void shift(int dx, int dy) {
+		if (hasFormula() && (dx != 0 || dy != 0) && tree(formula())->hasRefs()) {
+			Formula* f = formula();
+			f->col += (unsigned int)dx;
+			f->row += (unsigned int)dy;
+			f->state = DIRTY;
+		}
+	}
+	///a képlet origóját a megadott cellára teszi úgy, hogy a hivatkozott cellák nem változnak
+	/**A fa relatív hivatkozásait az origók különbségével tolja el (megosztott fa esetén előbb
+	klónoz). A tábla minden cellába írt képletet a cella helyére tesz, így az azonos relatív
+	képletek fái azonos alakúak lesznek (ld. shareBody).*/
+	void place(unsigned int col, unsigned int row) {
+		if (!hasFormula())
+			return;
+		Formula* f = formula();
+		if ((f->col != col || f->row != row) && tree(f)->hasRefs())
+			own()->shift((int)(f->col - col), (int)(f->row - row));
+		f->col = col;
+		f->row = row;
+	}
+	///a képlet a másik ExprPointer fáját és lefordított alakját használja tovább (a saját origója megmarad)
+	/**Csak azonos relatív képletek között szabad hívni (pl. azonos canonical() alak esetén).*/
+	void shareBody(const ExprPointer& rhs) {
+		if (hasFormula() && rhs.hasFormula() && formula()->body != rhs.formula()->body) {
+			share(rhs.formula()->body);
+			release(formula()->body);
+			formula()->body = rhs.formula()->body;
+		}
+	}
+	///a képlet cellától független (R1C1) alakja szövegesen, az azonos relatív képleteké azonos
+	/**Szám cella esetén üres. A relatív hivatkozásokat egy rögzített, a tábla celláitól távoli
+	origóhoz képest írja ki, így azok nem keveredhetnek az abszolút hivatkozásokkal.*/
+	std::string canonical() const {
+		if (!hasFormula())
+			return "";
+		EvalContext::Scope scope(nullptr, CANONICAL_ORIGIN, CANONICAL_ORIGIN);
+		return tree(formula())->show();
+	}
+	static const unsigned int CANONICAL_ORIGIN = 0x80000000; ///<a canonical() által használt origó
+	///a képletet egy tábla környezetéhez köti, a hivatkozásai ebben a táblában oldódnak fel (szám cellánál nincs hatása)
+	/**Új környezet esetén a tárolt érték elavul.*/
+	void bind(const EvalContext* context) {
+		if (hasFormula() && formula()->context != context) {
+			formula()->context = context;
+			formula()->state = DIRTY;
+		}
+	}
+	bool operator==(const ExprPointer& rhs) const {
+		if (!hasFormula() || !rhs.hasFormula())
+			return bits == rhs.bits;
+		const Formula* f = formula();
+		const Formula* g = rhs.formula();
+		return f->body == g->body && f->col == g->col && f->row == g->row;
+	} ///<egyenlőség másik ExprPointer-el (azonos szám, vagy azonos fa azonos origóval)
+	bool operator==(const Expression* p) const {return (const Expression*)*this == p;} ///<egyenlőség Expression*-al
+	///becsomagolt pointer adatainak és függvényeinek elérése nyíllal
+	Arrow operator->() const {
+		if (isNumber())
+			return Arrow(getNumber());
+		const Formula* f = formula();
+		return Arrow(tree(f), f->context, f->col, f->row);
+	}
+	bool shared() const {return hasFormula() && formula()->body->shares > 1;}
+		///<igaz, ha a fát más ExprPointer is használja
+	///kiértékeli az adott kifejezést, az eredményt eltárolja, kivételt nem dob
+	/**Szám cella esetén egyszerűen visszaadja a számot. Képletnél, amíg a cellát nem
+	érvénytelenítik (invalidate), a további hívások a tárolt értéket adják vissza, így minden
+	cellát legfeljebb egyszer számolunk ki. A képleteket az első kiértékeléskor
+	utasítássorozattá fordítja (ld. Bytecode), és a továbbiakban azt hajtja végre; a lefordított
+	alakon a fát megosztó képletek is osztoznak. Hiba esetén az eredmény hibaérték (ld.
+	ErrorValue), ezt is eltárolja (FAILED állapot). A körkörös hivatkozásokat a tábla a cellák
+	módosításakor deríti fel (ld. Sheet::update), az ilyen cellák értéke a CYCLIC hibaérték; ha
+	a táblát megkerülve mégis körbeérnénk, a kiértékelés alatt álló cellához visszatérve szintén
+	ezt kapjuk.*/
+	double result() const {
+		if (isNumber())
+			return getNumber();
+		Formula* f = formula();
+		return f->state == VALID || f->state == FAILED ? f->value : evalFormula();
+	}
+	///kiértékeli az adott kifejezést (ld. result), hibaérték esetén eval_error kivételt dob
+	double evalMe() const {return ErrorValue::check(result());}
+	///a tárolt értéket elavulttá teszi (a körkörösnek jelölt cellák jelölése megmarad)
+	void invalidate() const {if (!isNumber() && formula()->state != CYCLIC) formula()->state = DIRTY;}
+	///körkörösnek jelöli a cellát, vagy törli a jelölést (szám cella nem lehet körkörös)
+	void setCyclic(bool cyclic) const {if (!isNumber()) formula()->state = cyclic ? CYCLIC : DIRTY;}
+	CacheState getState() const {return isNumber() ? VALID : formula()->state;} ///<a tárolt érték állapotának lekérdezése (szám cella mindig érvényes)
+	~ExprPointer() {clear();} ///<elengedi a Body-t (az utolsó ExprPointer felszabadítja)
 };
 
-///Valós számokat tároló kifejezés osztály
-class NumberExpr : public Expression {
-	double value; ///<kifejezés értéke
-public:
-	explicit NumberExpr(double v) : value(v) {} ///<konstruktor
-	double eval() const {return value;} ///<kifejezés kiértékelése - érték visszaadása
-	void checkCyclic(std::vector<Expression*>) const {}
-	Expression* copy() const {return new NumberExpr(value);}
-	std::string show() const {std::ostringstream ss; ss << value; return ss.str();}
-};
+inline uint64_t ExprPointer::fromExpression(Expression* p) {
+	if (p == nullptr)
+		return FORMULA_TAG;
+	if (p->isConstant()) {
+		double v = p->eval();
+		delete p;
+		return numberBits(v);
+	}
+	return formulaBits(new Formula(new Body(p)));
+}
+
+inline double ExprPointer::evalFormula() const {
+	Formula* f = formula();
+	switch (f->state) {
+		case VALID:
+		case FAILED:
+			return f->value;
+		case EVALUATING:
+		case CYCLIC:
+			return ErrorValue::make(ErrorValue::CYCLIC);
+		default:
+			break;
+	}
+	f->state = EVALUATING;
+	EvalContext::Scope scope(f->context, f->col, f->row);
+	f->value = compiled(f->body)->run();
+	f->state = ErrorValue::isError(f->value) ? FAILED : VALID;
+	return f->value;
+}
+
 
 #endif
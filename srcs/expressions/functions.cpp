@@ -2,44 +2,189 @@
 #include "../exceptions.hpp"
 
 //FunctionExpr fuctions ------------------------------------------------------
-void FunctionExpr::checkCyclic(std::vector<Expression*> prevs) const {
-	for (Range::iterator cell = range.begin(); cell != range.end(); cell++) {
-		for (Expression* exprP : prevs) {
-			if (*cell ==  exprP) {
-				throw eval_error("cyclic reference");
-			}
-		}
-		prevs.push_back((Expression*)*cell);
-		(*cell)->checkCyclic(prevs);
-		prevs.pop_back();
-	}
-}
+///a függvények nevei a FunctionName sorrendjében
+static const char* const functionNames[] = {"avg", "sum", "min", "max", "count", "product", "var", "stddev", "match", "lookup",
+	"sumif", "countif", "avgif"};
+///a függvényeknek megfelelő utasítások a FunctionName sorrendjében (a keresésnél és a feltételes összesítésnél az utolsó utasítás)
+static const Bytecode::OpCode functionOps[] = {Bytecode::AVG, Bytecode::SUM, Bytecode::MIN, Bytecode::MAX,
+	Bytecode::COUNT, Bytecode::PRODUCT, Bytecode::VAR, Bytecode::STDDEV, Bytecode::MATCH, Bytecode::INDEX,
+	Bytecode::SUMIF, Bytecode::COUNTIF, Bytecode::AVGIF};
 
 FunctionExpr* FunctionExpr::newFunctionExpr(FunctionName fname, CellRefExpr* topCell, CellRefExpr* bottomCell){
-	switch (fname) {
-		case AVG:
-			return new AvgFunc(topCell, bottomCell);
-		case SUM:
-			return new SumFunc(topCell, bottomCell);
-		default:
-			return nullptr;
-	}
+	if (isLookup(fname) || isConditional(fname))
+		return nullptr;
+	return new FunctionExpr(fname, topCell, bottomCell);
 }
 
-double AvgFunc::eval() const {
-	size_t db = 0;
-	double sum = 0;
-	for (Range::iterator cell = range.begin(); cell != range.end(); cell++) {
-		sum += (*cell)->eval();
-		db++;
-	}
-	return sum/(double)db;
+const char* FunctionExpr::nameOf(FunctionName fn){
+	return functionNames[fn];
+}
+
+Bytecode::OpCode FunctionExpr::opCode(FunctionName fn){
+	return functionOps[fn];
 }
 
-double SumFunc::eval() const {
-	double sum = 0;
-	for (Range::iterator cell = range.begin(); cell != range.end(); cell++) {
-		sum += (*cell)->eval();
+FunctionName FunctionExpr::fromOpCode(Bytecode::OpCode op){
+	for (size_t i = 0; i < sizeof functionOps / sizeof functionOps[0]; i++)
+		if (functionOps[i] == op)
+			return (FunctionName)i;
+	throw eval_error("not a function instruction");
+}
+
+std::optional<FunctionName> FunctionExpr::parseFname(std::string_view name){
+	for (size_t i = 0; i < sizeof functionNames / sizeof functionNames[0]; i++)
+		if (name == functionNames[i])
+			return (FunctionName)i;
+	return {};
+}
+
+double FunctionExpr::result(FunctionName fn, const Accumulator& acc, double cells){
+	switch (fn) {
+		case AVG: return acc.mean(cells);
+		case SUM: return acc.sum();
+		case MIN: return acc.min();
+		case MAX: return acc.max();
+		case COUNT: return acc.count();
+		case PRODUCT: return acc.product();
+		case VAR: return acc.variance();
+		default: return acc.stddev();
 	}
-	return sum;
+}
+
+double FunctionExpr::eval() const {
+	const Sheet* sh = EvalContext::activeSheet();
+	if (sh == nullptr)
+		return ErrorValue::make(ErrorValue::UNINITIALIZED);
+	CellRect r = range.rect();
+	double cells = (double)(r.col2 - r.col1 + 1) * (double)(r.row2 - r.row1 + 1);
+	if (fname == SUM)
+		return sh->rangeSum(r);
+	if (fname == AVG)
+		return sh->rangeSum(r) / cells;
+	return result(fname, sh->rangeAggregate(r), cells);
+}
+
+//LookupFunc functions ------------------------------------------------------
+LookupFunc::LookupFunc(Expression* key, CellRefExpr* topCell, CellRefExpr* bottomCell, bool sorted,
+		CellRefExpr* resultTop, CellRefExpr* resultBottom)
+	: FunctionExpr(resultTop ? LOOKUP : MATCH, topCell, bottomCell), key(key),
+	result(resultTop ? new Range(resultTop, resultBottom) : nullptr), sorted(sorted) {}
+
+void LookupFunc::setResult(CellRefExpr* resultTop, CellRefExpr* resultBottom){
+	delete result;
+	result = new Range(resultTop, resultBottom);
+	fname = LOOKUP;
+}
+
+double LookupFunc::eval() const {
+	const Sheet* sh = EvalContext::activeSheet();
+	if (sh == nullptr)
+		return ErrorValue::make(ErrorValue::UNINITIALIZED);
+	double position = sh->rangeMatch(range.rect(), key->eval(), sorted);
+	return result ? sh->rangeIndex(result->rect(), position) : position;
+}
+
+std::string LookupFunc::show() const {
+	std::string text = std::string(nameOf(fname)) + "(" + key->show() + ";" + range.show();
+	if (result)
+		text += ";" + result->show();
+	return text + (sorted ? ";1)" : ")");
+}
+
+void LookupFunc::compile(Bytecode& bc) const {
+	key->compile(bc);
+	bc.lookup(sorted ? Bytecode::MATCH_SORTED : Bytecode::MATCH, range.top().operand(), range.bottom().operand());
+	if (result)
+		bc.lookup(Bytecode::INDEX, result->top().operand(), result->bottom().operand());
+}
+
+void LookupFunc::shift(int dx, int dy){
+	key->shift(dx, dy);
+	range.shift(dx, dy);
+	if (result)
+		result->shift(dx, dy);
+}
+
+void LookupFunc::collectRefs(std::vector<CellRect>& refs) const {
+	key->collectRefs(refs);
+	refs.push_back(range.rect());
+	if (result)
+		refs.push_back(result->rect());
+}
+
+LookupFunc::~LookupFunc(){
+	delete key;
+	delete result;
+}
+
+//ConditionalFunc functions ------------------------------------------------------
+///az összehasonlítások jelei a Criterion::Op sorrendjében
+static const char* const comparisonSymbols[] = {"=", "<>", "<", "<=", ">", ">="};
+
+ConditionalFunc::ConditionalFunc(FunctionName fn, CellRefExpr* topCell, CellRefExpr* bottomCell, Criterion::Op op, Expression* threshold,
+		CellRefExpr* valuesTop, CellRefExpr* valuesBottom)
+	: FunctionExpr(fn, topCell, bottomCell), op(op), threshold(threshold),
+	values(valuesTop ? new Range(valuesTop, valuesBottom) : nullptr) {}
+
+void ConditionalFunc::setValues(FunctionName fn, CellRefExpr* valuesTop, CellRefExpr* valuesBottom){
+	delete values;
+	values = valuesTop ? new Range(valuesTop, valuesBottom) : nullptr;
+	fname = fn;
+}
+
+const char* ConditionalFunc::symbolOf(Criterion::Op op){
+	return comparisonSymbols[op];
+}
+
+double ConditionalFunc::result(FunctionName fn, double sum, double count){
+	if (fn == SUMIF)
+		return sum;
+	if (fn == COUNTIF)
+		return count;
+	if (count == 0)
+		return ErrorValue::make(ErrorValue::NOT_FOUND);
+	return sum / count;
+}
+
+double ConditionalFunc::eval() const {
+	const Sheet* sh = EvalContext::activeSheet();
+	if (sh == nullptr)
+		return ErrorValue::make(ErrorValue::UNINITIALIZED);
+	double sum, count;
+	sh->rangeSumIf(range.rect(), {op, threshold->eval()}, values ? values->rect() : range.rect(), sum, count);
+	return result(fname, sum, count);
+}
+
+std::string ConditionalFunc::show() const {
+	//az elhagyható egyenlőségjelet is kiírjuk, így a feltétel egyértelműen olvasható
+	std::string text = std::string(nameOf(fname)) + "(" + range.show() + ";" + symbolOf(op) + threshold->show();
+	if (values)
+		text += ";" + values->show();
+	return text + ")";
+}
+
+void ConditionalFunc::compile(Bytecode& bc) const {
+	threshold->compile(bc);
+	bc.condition((Bytecode::OpCode)(Bytecode::WHERE_EQ + op), range.top().operand(), range.bottom().operand());
+	const Range& summed = values ? *values : range;
+	bc.condition(opCode(fname), summed.top().operand(), summed.bottom().operand());
+}
+
+void ConditionalFunc::shift(int dx, int dy){
+	threshold->shift(dx, dy);
+	range.shift(dx, dy);
+	if (values)
+		values->shift(dx, dy);
+}
+
+void ConditionalFunc::collectRefs(std::vector<CellRect>& refs) const {
+	threshold->collectRefs(refs);
+	refs.push_back(range.rect());
+	if (values)
+		refs.push_back(values->rect());
+}
+
+ConditionalFunc::~ConditionalFunc(){
+	delete threshold;
+	delete values;
 }
@@ -2,56 +2,145 @@
 #define  FUNC_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
 
 #include "expression_core.hpp"
 #include "range.hpp"
+#include "../accumulator.hpp"
+#include "../valueplane.hpp"
 
 ///elérhető függvények nevei
 enum FunctionName {
-	AVG, SUM
+	AVG, SUM, MIN, MAX, COUNT, PRODUCT, VAR, STDDEV, ///<tartományon végzett összesítések
+	MATCH, LOOKUP, ///<keresések (ld. LookupFunc)
+	SUMIF, COUNTIF, AVGIF ///<feltételes összesítések (ld. ConditionalFunc)
 };
 
-///Tartományon elvégezhető függvénykifejezések absztrakt osztálya
+///Tartományon elvégezhető összesítő függvények osztálya
+/**
+A függvények egy közös, egymenetes számolóra (Accumulator) épülnek, a függvény neve csak azt
+dönti el, melyik összesítést olvassuk ki belőle. A sum és az avg a gyorsabb, csak összegző
+bejárást használja (ld. Sheet::rangeSum), ha nem osztozhat egy másik összesítés bejárásán. A
+var és a stddev a korrigált (mintabeli) szórásnégyzet, illetve szórás, a count a nem hibás
+cellák száma, a többi függvény a tartomány hibaértékét adja tovább.
+*/
 class FunctionExpr : public Expression {
 protected:
+	FunctionName fname; ///<a függvény neve
 	Range range; ///<tartomány, melyen a függvény végrehajtódik
 public:
-	explicit FunctionExpr(const Range& r) : range(r) {} ///<konstruktor
-	explicit FunctionExpr(CellRefExpr* topCell, CellRefExpr* bottomCell) : range(topCell, bottomCell) {} ///<konstruktor
-	void checkCyclic(std::vector<Expression*>) const;
+	explicit FunctionExpr(FunctionName fn, const Range& r) : fname(fn), range(r) {} ///<konstruktor
+	explicit FunctionExpr(FunctionName fn, CellRefExpr* topCell, CellRefExpr* bottomCell) : fname(fn), range(topCell, bottomCell) {} ///<konstruktor
+	FunctionName getName() const {return fname;} ///<a függvény nevének lekérdezése
+	///a függvény értéke az aktív környezet táblájában, aktív környezet nélkül hibaérték
+	double eval() const;
+	std::string show() const {return std::string(nameOf(fname)) + "(" + range.show() + ")";}
+	void compile(Bytecode& bc) const {bc.aggregate(opCode(fname), range.top().operand(), range.bottom().operand());}
+	Expression* copy() const {return new FunctionExpr(fname, range);}
 	void shift(int dx, int dy) {range.shift(dx, dy);}
-	void relocate(Sheet* shp) {range.relocate(shp);}
+	void collectRefs(std::vector<CellRect>& refs) const {refs.push_back(range.rect());}
+	bool hasRefs() const {return true;}
 	virtual ~FunctionExpr(){}
+	static const char* nameOf(FunctionName fn); ///<a függvény neve szövegesen
+	static Bytecode::OpCode opCode(FunctionName fn); ///<a függvénynek megfelelő utasítás (ld. Bytecode::aggregate)
+	static FunctionName fromOpCode(Bytecode::OpCode op); ///<az utasításnak megfelelő függvény
+	///a függvény eredménye a tartomány összesítéséből
+	/**@param cells - a tartomány celláinak száma (az avg ezzel oszt)*/
+	static double result(FunctionName fn, const Accumulator& acc, double cells);
+	static bool isLookup(FunctionName fn) {return fn == MATCH || fn == LOOKUP;} ///<keresés-e a függvény (ld. LookupFunc)
+	static bool isConditional(FunctionName fn) {return fn == SUMIF || fn == COUNTIF || fn == AVGIF;} ///<feltételes összesítés-e a függvény (ld. ConditionalFunc)
 	///értelmezi a függvények neveit (case sensitive)
-	static std::optional<FunctionName> parseFname(const std::string& name){
-		if (name == "avg") return AVG;
-		if (name == "sum") return SUM;
-		return {};
-	}
-	///létrehoz egy megfelelő típusú függvényt a neve alapján
+	static std::optional<FunctionName> parseFname(std::string_view name);
+	///létrehoz egy megfelelő típusú összesítő függvényt a neve alapján (keresésre és feltételes összesítésre nullptr-t ad)
 	static FunctionExpr* newFunctionExpr(FunctionName fn, CellRefExpr* topCell, CellRefExpr* bottomCell);
 };
 
-///Tartomány átlagát vevő függvény osztály
-class AvgFunc : public FunctionExpr {
+///Kulcsot egy egyoszlopos tartományban kereső függvények (match, lookup) osztálya
+/**
+A match(kulcs;tartomány) a kulcs helyét (1-től) adja a tartományban, a
+lookup(kulcs;tartomány;eredménytartomány) pedig az eredménytartomány ugyanilyen helyű
+celláját. Egy harmadik (lookup-nál negyedik) 1 paraméterrel a keresés közelítő: a legnagyobb,
+a kulcsnál nem nagyobb értéket keresi (0 vagy a paraméter elhagyása: pontos keresés). A
+keresést a tábla lustán épített indexei végzik (ld. Sheet::rangeMatch), így egy keresés
+konstans, illetve logaritmikus idejű. Ha nincs találat, a NOT_FOUND hibaértéket adja.
+*/
+class LookupFunc : public FunctionExpr {
+	Expression* key; ///<a keresett értéket adó kifejezés
+	Range* result; ///<lookup esetén az eredménytartomány (match esetén nullptr)
+	bool sorted; ///<közelítő-e a keresés
 public:
-	explicit AvgFunc(const Range& r) : FunctionExpr(r) {}
-	explicit AvgFunc(CellRefExpr* topCell, CellRefExpr* bottomCell) : FunctionExpr(topCell, bottomCell) {}
+	///konstruktor, átveszi a kulcs és a hivatkozások tulajdonjogát
+	/**@param resultTop, resultBottom - az eredménytartomány sarkai (match esetén nullptr)*/
+	LookupFunc(Expression* key, CellRefExpr* topCell, CellRefExpr* bottomCell, bool sorted,
+		CellRefExpr* resultTop = nullptr, CellRefExpr* resultBottom = nullptr);
+	LookupFunc(const LookupFunc& f) : FunctionExpr(f.fname, f.range), key(f.key->copy()),
+		result(f.result ? new Range(*f.result) : nullptr), sorted(f.sorted) {} ///<másoló konstruktor
+	LookupFunc& operator=(const LookupFunc&) = delete;
 	double eval() const;
-	std::string show() const {return "avg(" + range.show() + ")";}
-	Expression* copy() const {return new AvgFunc(range);}
+	std::string show() const;
+	void compile(Bytecode& bc) const;
+	Expression* copy() const {return new LookupFunc(*this);}
+	void shift(int dx, int dy);
+	void collectRefs(std::vector<CellRect>& refs) const;
+	Expression* optimize() {key = key->optimize(); return this;}
+	///a match keresést lookup-pá alakítja a megadott eredménytartománnyal (ld. Bytecode::decompile)
+	void setResult(CellRefExpr* resultTop, CellRefExpr* resultBottom);
+	~LookupFunc();
 };
 
-///Tartományt összegző függvény osztály
-class SumFunc : public FunctionExpr {
+///Feltételt teljesítő cellákon végzett összesítések (sumif, countif, avgif) osztálya
+/**
+A sumif(tartomány;feltétel;összegtartomány) az összegtartomány azon celláinak összegét adja,
+amelyeknek a tartományban azonos helyű cellája teljesíti a feltételt, az avgif ezek átlagát, a
+countif(tartomány;feltétel) pedig a feltételt teljesítő cellák számát. A feltétel egy
+összehasonlító jel (=, <>, <, <=, >, >=, elhagyva =) és egy tetszőleges kifejezés, a
+küszöbérték (pl. sumif(a1:a100;>=b1;c1:c100)). Az összegtartomány elhagyásakor magát a
+tartományt összegzi, megadva a tartománnyal azonos méretűnek kell lennie. A kiértékelést a tábla
+zónatérképei gyorsítják (ld. Sheet::rangeSumIf). Ha egy cella sem teljesíti a feltételt, az
+avgif a NOT_FOUND hibaértéket adja.
+*/
+class ConditionalFunc : public FunctionExpr {
+	Criterion::Op op; ///<az összehasonlítás
+	Expression* threshold; ///<a küszöbértéket adó kifejezés
+	Range* values; ///<az összegtartomány (nullptr: maga a tartomány)
 public:
-	explicit SumFunc(const Range& r) : FunctionExpr(r) {}
-	explicit SumFunc(CellRefExpr* topCell, CellRefExpr* bottomCell) : FunctionExpr(topCell, bottomCell) {}
+	///konstruktor, átveszi a küszöbérték és a hivatkozások tulajdonjogát
+	/**@param valuesTop, valuesBottom - az összegtartomány sarkai (elhagyva maga a tartomány)*/
+	ConditionalFunc(FunctionName fn, CellRefExpr* topCell, CellRefExpr* bottomCell, Criterion::Op op, Expression* threshold,
+		CellRefExpr* valuesTop = nullptr, CellRefExpr* valuesBottom = nullptr);
+	ConditionalFunc(const ConditionalFunc& f) : FunctionExpr(f.fname, f.range), op(f.op), threshold(f.threshold->copy()),
+		values(f.values ? new Range(*f.values) : nullptr) {} ///<másoló konstruktor
+	ConditionalFunc& operator=(const ConditionalFunc&) = delete;
 	double eval() const;
-	std::string show() const {return "sum(" + range.show() + ")";}
-	Expression* copy() const {return new SumFunc(range);}
+	std::string show() const;
+	void compile(Bytecode& bc) const;
+	Expression* copy() const {return new ConditionalFunc(*this);}
+	void shift(int dx, int dy);
+	void collectRefs(std::vector<CellRect>& refs) const;
+	Expression* optimize() {threshold = threshold->optimize(); return this;}
+	///a függvény és az összegtartomány beállítása (ld. Bytecode::decompile)
+	/**@param valuesTop, valuesBottom - az összegtartomány sarkai (nullptr: maga a tartomány)*/
+	void setValues(FunctionName fn, CellRefExpr* valuesTop, CellRefExpr* valuesBottom);
+	///a függvény eredménye a feltételt teljesítő értékek összegéből és számából (ld. Sheet::rangeSumIf)
+	static double result(FunctionName fn, double sum, double count);
+	static const char* symbolOf(Criterion::Op op); ///<az összehasonlítás jele
+	~ConditionalFunc();
+};
+
+///Tartomány átlagát vevő függvény (rövidítés az avg FunctionExpr-hez)
+class AvgFunc : public FunctionExpr {
+public:
+	explicit AvgFunc(const Range& r) : FunctionExpr(AVG, r) {}
+	explicit AvgFunc(CellRefExpr* topCell, CellRefExpr* bottomCell) : FunctionExpr(AVG, topCell, bottomCell) {}
+};
+
+///Tartományt összegző függvény (rövidítés a sum FunctionExpr-hez)
+class SumFunc : public FunctionExpr {
+public:
+	explicit SumFunc(const Range& r) : FunctionExpr(SUM, r) {}
+	explicit SumFunc(CellRefExpr* topCell, CellRefExpr* bottomCell) : FunctionExpr(SUM, topCell, bottomCell) {}
 };
 
 
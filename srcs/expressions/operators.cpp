@@ -1,3 +1,5 @@
+#include <cmath>
+
 #include "operators.hpp"
 #include "../exceptions.hpp"
 
@@ -26,3 +28,192 @@ Operator* Operator::operandFromToken(Token_type ttype, Expression* lhs, Expressi
 			return nullptr;
 	}
 }
+
+Expression* Operator::foldOperands(){
+	lhs = lhs->optimize();
+	rhs = rhs->optimize();
+	if (lhs->isConstant() && rhs->isConstant()) {
+		double value = eval();
+		delete this;
+		return new NumberExpr(value);
+	}
+	return nullptr;
+}
+
+Expression* Operator::takeOperand(Expression*& operand){
+	Expression* taken = operand;
+	operand = nullptr;
+	delete this;
+	return taken;
+}
+
+///igaz, ha a kifejezés az adott értékű konstans
+static bool isNumber(const Expression* expr, double value){
+	return expr->isConstant() && expr->eval() == value;
+}
+
+Expression* Mult::optimize(){
+	if (Expression* folded = foldOperands())
+		return folded;
+	if (isNumber(rhs, 1))
+		return takeOperand(lhs);
+	if (isNumber(lhs, 1))
+		return takeOperand(rhs);
+	if (isNumber(lhs, -1))
+		return (new Negate(takeOperand(rhs)))->optimize();
+	if (isNumber(rhs, -1))
+		return (new Negate(takeOperand(lhs)))->optimize();
+	return this;
+}
+
+Expression* Div::optimize(){
+	if (Expression* folded = foldOperands())
+		return folded;
+	if (isNumber(rhs, 1))
+		return takeOperand(lhs);
+	return this;
+}
+
+Expression* Sub::optimize(){
+	if (Expression* folded = foldOperands())
+		return folded;
+	if (isNumber(rhs, 0))
+		return takeOperand(lhs);
+	//a 0-x nem írható -x alakban: x = +0 esetén 0-0 = +0, de -(+0) = -0
+	return this;
+}
+
+void Add::takeTerms(Expression* expr, std::vector<Expression*>& terms){
+	//csak a bal oldali ágat bontjuk ki: a jobb oldali (zárójelezett) összeadás egy tag marad, így a tagok sorrendje és zárójelezése nem változik
+	if (Add* add = dynamic_cast<Add*>(expr)) {
+		takeTerms(add->lhs, terms);
+		terms.push_back(add->rhs);
+		add->lhs = add->rhs = nullptr;
+		delete add;
+	} else if (AddChain* chain = dynamic_cast<AddChain*>(expr)) {
+		terms.insert(terms.end(), chain->terms.begin(), chain->terms.end());
+		chain->terms.clear();
+		delete chain;
+	} else {
+		terms.push_back(expr);
+	}
+}
+
+Expression* Add::optimize(){
+	if (Expression* folded = foldOperands())
+		return folded;
+	std::vector<Expression*> terms;
+	takeTerms(lhs, terms);
+	terms.push_back(rhs);
+	lhs = rhs = nullptr;
+	delete this;
+	return AddChain::build(terms);
+}
+
+Negate& Negate::operator=(const Negate& neg){
+	if (&neg != this) {
+		delete operand;
+		operand = neg.operand->copy();
+	}
+	return *this;
+}
+
+Expression* Negate::optimize(){
+	operand = operand->optimize();
+	if (operand->isConstant()) {
+		double value = eval();
+		delete this;
+		return new NumberExpr(value);
+	}
+	if (Negate* inner = dynamic_cast<Negate*>(operand)) {
+		Expression* taken = inner->operand;
+		inner->operand = nullptr;
+		delete this;
+		return taken;
+	}
+	return this;
+}
+
+AddChain::AddChain(const AddChain& chain) : Expression() {
+	for (const Expression* t : chain.terms)
+		terms.push_back(t->copy());
+}
+
+AddChain& AddChain::operator=(const AddChain& chain){
+	if (&chain != this) {
+		for (Expression* t : terms)
+			delete t;
+		terms.clear();
+		for (const Expression* t : chain.terms)
+			terms.push_back(t->copy());
+	}
+	return *this;
+}
+
+double AddChain::eval() const {
+	double sum = terms[0]->eval();
+	for (size_t i = 1; i < terms.size(); i++)
+		sum += terms[i]->eval();
+	return sum;
+}
+
+std::string AddChain::show() const {
+	std::string outp = "(" + terms[0]->show();
+	for (size_t i = 1; i < terms.size(); i++)
+		outp += "+" + terms[i]->show();
+	return outp + ")";
+}
+
+void AddChain::compile(Bytecode& bc) const {
+	terms[0]->compile(bc);
+	for (size_t i = 1; i < terms.size(); i++) {
+		terms[i]->compile(bc);
+		bc.binary(Bytecode::ADD);
+	}
+}
+
+Expression* AddChain::optimize(){
+	std::vector<Expression*> optimized;
+	for (Expression* t : terms)
+		optimized.push_back(t->optimize());
+	terms.clear();
+	delete this;
+	return build(optimized);
+}
+
+///negatív nulla-e a konstans tag (az x + -0 minden x-re pontosan x, a +0 viszont a -0-t +0-vá tenné)
+static bool isNegativeZero(const Expression* t){
+	double v = t->eval();
+	return v == 0 && std::signbit(v);
+}
+
+Expression* AddChain::build(const std::vector<Expression*>& terms){
+	std::vector<Expression*> kept;
+	size_t i = 0;
+	//csak az elején álló konstansokat vonjuk össze: a balról jobbra haladó kiértékelés is ezeket adja össze először
+	if (terms[0]->isConstant()) {
+		double constant = terms[0]->eval();
+		delete terms[0];
+		for (i = 1; i < terms.size() && terms[i]->isConstant(); i++) {
+			constant += terms[i]->eval();
+			delete terms[i];
+		}
+		kept.push_back(new NumberExpr(constant));
+	}
+	for (; i < terms.size(); i++)
+		kept.push_back(terms[i]);
+	//a -0 tagok elhagyhatók (egy csupa -0 összeg -0 marad), a többi konstans a helyén marad
+	for (size_t j = 0; j < kept.size() && kept.size() > 1;) {
+		if (kept[j]->isConstant() && isNegativeZero(kept[j])) {
+			delete kept[j];
+			kept.erase(kept.begin() + (long)j);
+		} else {
+			j++;
+		}
+	}
+	if (kept.size() == 1)
+		return kept[0];
+	if (kept.size() == 2)
+		return new Add(kept[0], kept[1]);
+	return new AddChain(kept);
+}
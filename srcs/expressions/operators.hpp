@@ -14,6 +14,12 @@ class Operator : public Expression {
 protected:
 	Expression* lhs; ///<bal oldali operandus
 	Expression* rhs; ///<jobb oldali operandus
+
+	///egyszerűsíti az operandusokat, és ha mindkettő konstans, a műveletet konstanssá értékeli ki
+	/**@return a konstans kifejezés (ekkor az objektum felszabadul), különben nullptr*/
+	Expression* foldOperands();
+	///kiveszi az adott operandust a műveletből, a műveletet pedig felszabadítja
+	Expression* takeOperand(Expression*& operand);
 public:
 	///konstruktor
 	/**
@@ -21,11 +27,11 @@ public:
 	@param rhs - jobb oldali operandus
 	*/
 	explicit Operator(Expression* lhs, Expression* rhs) : lhs(lhs), rhs(rhs) {}
-	Operator(const Operator& op) : lhs(op.lhs->copy()), rhs(op.rhs->copy()) {} ///<másoló konstruktor
+	Operator(const Operator& op) : Expression(), lhs(op.lhs->copy()), rhs(op.rhs->copy()) {} ///<másoló konstruktor
 	Operator& operator=(const Operator& op); ///<értékadás operátor
-	void checkCyclic(std::vector<Expression*> prevs) const {lhs->checkCyclic(prevs); rhs->checkCyclic(prevs);}
 	void shift(int dx, int dy) {lhs->shift(dx, dy); rhs->shift(dx, dy);}
-	void relocate(Sheet* shp) {lhs->relocate(shp); rhs->relocate(shp);}
+	void collectRefs(std::vector<CellRect>& refs) const {lhs->collectRefs(refs); rhs->collectRefs(refs);}
+	bool hasRefs() const {return lhs->hasRefs() || rhs->hasRefs();}
 	///felszabadítja az operandusait
 	virtual ~Operator(){
 		delete lhs;
@@ -41,7 +47,9 @@ public:
 	explicit Mult(Expression* lhs, Expression* rhs) : Operator(lhs, rhs) {}
 	double eval() const {return lhs->eval() * rhs->eval();}
 	std::string show() const {return "(" + lhs->show() + "*" + rhs->show() + ")";}
+	void compile(Bytecode& bc) const {lhs->compile(bc); rhs->compile(bc); bc.binary(Bytecode::MUL);}
 	Expression* copy() const {return new Mult(lhs->copy(), rhs->copy());}
+	Expression* optimize();
 };
 
 ///Osztás műveletet reprezentáló osztály
@@ -50,16 +58,21 @@ public:
 	explicit Div(Expression* lhs, Expression* rhs) : Operator(lhs, rhs) {}
 	double eval() const {return lhs->eval() / rhs->eval();}
 	std::string show() const {return "(" + lhs->show() + "/" + rhs->show() + ")";}
+	void compile(Bytecode& bc) const {lhs->compile(bc); rhs->compile(bc); bc.binary(Bytecode::DIV);}
 	Expression* copy() const {return new Div(lhs->copy(), rhs->copy());}
+	Expression* optimize();
 };
 
 ///Összeadás műveletet reprezentáló osztály
 class Add : public Operator {
+	static void takeTerms(Expression* expr, std::vector<Expression*>& terms); ///<a kifejezés összeadandóinak kigyűjtése
 public:
 	explicit Add(Expression* lhs, Expression* rhs) : Operator(lhs, rhs) {}
 	double eval() const {return lhs->eval() + rhs->eval();}
 	std::string show() const {return "(" + lhs->show() + "+" + rhs->show() + ")";}
+	void compile(Bytecode& bc) const {lhs->compile(bc); rhs->compile(bc); bc.binary(Bytecode::ADD);}
 	Expression* copy() const {return new Add(lhs->copy(), rhs->copy());}
+	Expression* optimize();
 };
 
 ///Kivonás műveletet reprezentáló osztály
@@ -68,7 +81,55 @@ public:
 	explicit Sub(Expression* lhs, Expression* rhs) : Operator(lhs, rhs) {}
 	double eval() const {return lhs->eval() - rhs->eval();}
 	std::string show() const {return "(" + lhs->show() + "-" + rhs->show() + ")";}
+	void compile(Bytecode& bc) const {lhs->compile(bc); rhs->compile(bc); bc.binary(Bytecode::SUB);}
 	Expression* copy() const {return new Sub(lhs->copy(), rhs->copy());}
+	Expression* optimize();
+};
+
+///Ellentettképzést reprezentáló osztály
+class Negate : public Expression {
+	Expression* operand; ///<az operandus
+public:
+	explicit Negate(Expression* operand) : operand(operand) {}
+	Negate(const Negate& neg) : Expression(), operand(neg.operand->copy()) {} ///<másoló konstruktor
+	Negate& operator=(const Negate& neg); ///<értékadás operátor
+	double eval() const {return -operand->eval();}
+	std::string show() const {return "-" + operand->show();}
+	Expression* copy() const {return new Negate(operand->copy());}
+	void shift(int dx, int dy) {operand->shift(dx, dy);}
+	void collectRefs(std::vector<CellRect>& refs) const {operand->collectRefs(refs);}
+	bool hasRefs() const {return operand->hasRefs();}
+	void compile(Bytecode& bc) const {operand->compile(bc); bc.unary(Bytecode::NEG);}
+	Expression* optimize();
+	~Negate() {delete operand;} ///<felszabadítja az operandust
+};
+
+///Többtagú összeadást reprezentáló osztály
+/**Az egymásba ágyazott (balról zárójelezett) összeadásokat az egyszerűsítés egyetlen csomóponttá
+fűzi össze, így a kiértékelés tagonként egy virtuális hívással jár. A tagokat balról jobbra adja össze.*/
+class AddChain : public Expression {
+	friend class Add;
+	std::vector<Expression*> terms; ///<az összeadandók (legalább három)
+public:
+	explicit AddChain(const std::vector<Expression*>& terms) : terms(terms) {}
+	AddChain(const AddChain& chain); ///<másoló konstruktor
+	AddChain& operator=(const AddChain& chain); ///<értékadás operátor
+	double eval() const;
+	std::string show() const;
+	Expression* copy() const {return new AddChain(*this);}
+	void shift(int dx, int dy) {for (Expression* t : terms) t->shift(dx, dy);}
+	void collectRefs(std::vector<CellRect>& refs) const {for (const Expression* t : terms) t->collectRefs(refs);}
+	bool hasRefs() const {for (const Expression* t : terms) if (t->hasRefs()) return true; return false;}
+	void compile(Bytecode& bc) const;
+	Expression* optimize();
+	size_t size() const {return terms.size();} ///<tagok száma
+	///összeadandókból a legegyszerűbb összeadást építi fel
+	/**Az elején álló konstans tagokat egyetlen taggá vonja össze, a -0 tagokat elhagyja, a nem konstans
+	tagok közötti konstansokat a helyükön hagyja, így az eredmény a balról jobbra haladó összeadással
+	bitre azonos; egy tagnál magát a tagot, kettőnél egy Add, legalább három tagnál egy AddChain
+	objektumot ad vissza. A tagok tulajdonjogát átveszi.*/
+	static Expression* build(const std::vector<Expression*>& terms);
+	~AddChain() {for (Expression* t : terms) delete t;} ///<felszabadítja a tagokat
 };
 
 #endif
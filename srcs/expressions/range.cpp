@@ -4,20 +4,20 @@
 
 //Range fuctions ---------------------------------------------------------------
 Range::Range(CellRefExpr* top, CellRefExpr* bottom) {
-	std::string topCol = top->getCol();
-	std::string bottomCol = bottom->getCol();
+	unsigned int topCol = top->getColNum();
+	unsigned int bottomCol = bottom->getColNum();
 	unsigned int topRow = top->getRow();
 	unsigned int bottomRow = bottom->getRow();
-	std::string minCol = topCol <= bottomCol ? topCol : bottomCol;
+	std::string minCol = topCol <= bottomCol ? top->getCol() : bottom->getCol();
 	bool minColAbs = topCol <= bottomCol ? top->getAbsCol() : bottom->getAbsCol();
-	std::string maxCol = topCol > bottomCol ? topCol : bottomCol;
+	std::string maxCol = topCol > bottomCol ? top->getCol() : bottom->getCol();
 	bool maxColAbs = topCol > bottomCol ? top->getAbsCol() : bottom->getAbsCol();
 	unsigned int minRow = topRow <= bottomRow ? topRow : bottomRow;
 	bool minRowAbs = topRow <= bottomRow ? top->getAbsRow() : bottom->getAbsRow();
 	unsigned int maxRow = topRow > bottomRow ? topRow : bottomRow;
 	bool maxRowAbs = topRow > bottomRow ? top->getAbsRow() : bottom->getAbsRow();
-	topCell = new CellRefExpr(minCol, minRow, top->getSheet(), minColAbs, minRowAbs);
-	bottomCell = new CellRefExpr(maxCol, maxRow, top->getSheet(), maxColAbs, maxRowAbs); //assuming both cells are on the same sheet
+	topCell = new CellRefExpr(minCol, minRow, minColAbs, minRowAbs);
+	bottomCell = new CellRefExpr(maxCol, maxRow, maxColAbs, maxRowAbs);
 	delete top;
 	delete bottom;
 }
@@ -32,31 +32,25 @@ Range& Range::operator=(const Range& r){
 	return *this;
 }
 
-Range::iterator Range::begin() const{
-	Sheet* sh = topCell->getSheet();
-	ExprPointer* beginp = topCell->getPtr();
-	ExprPointer* endp = bottomCell->getPtr();
-	size_t rangeWidth = (endp - beginp) % (int)(sh->getWidth());
-	return iterator(rangeWidth, sh->getWidth(), beginp);
+Range::iterator Range::begin(Sheet& sh) const{
+	sh.parseCell(bottomCell->getColNum(), bottomCell->getRow()); //kivételt dob, ha a tartomány kilóg a táblából
+	sh.parseCell(topCell->getColNum(), topCell->getRow());
+	return iterator(&sh, topCell->getColNum() - 1, bottomCell->getColNum() - 1, topCell->getRow() - 1);
 }
 
-Range::iterator Range::end() const{
-	Sheet* sh = topCell->getSheet();
-	ExprPointer* beginp = topCell->getPtr();
-	ExprPointer* endp = bottomCell->getPtr();
-	size_t rangeWidth = (endp - beginp) % (int)sh->getWidth();
-	return iterator(rangeWidth, sh->getWidth(), endp-rangeWidth+sh->getWidth());
+Range::iterator Range::end(Sheet& sh) const{
+	sh.parseCell(bottomCell->getColNum(), bottomCell->getRow());
+	sh.parseCell(topCell->getColNum(), topCell->getRow());
+	return iterator(&sh, topCell->getColNum() - 1, bottomCell->getColNum() - 1, bottomCell->getRow());
 }
 
 //Range iterator fuctions ------------------------------------------------------
 Range::iterator& Range::iterator::operator++() {//preinkremens
-	if (actCell == nullptr)
-		throw std::runtime_error("empty iterator");
-	if (actCell + 1 <= actRow+rangeWidth) {
-		++actCell;
+	if (col < lastCol) {
+		++col;
 	} else {
-		actRow += tableWidth;
-		actCell = actRow;
+		col = firstCol;
+		++row;
 	}
 	return *this;
 }
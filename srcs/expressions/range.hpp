@@ -28,14 +28,18 @@ public:
 	///másoló konstruktor
 	Range(const Range& r) : topCell(r.topCell->copy()), bottomCell(r.bottomCell->copy()) {}
 	Range& operator=(const Range& r); ///<értékadás operátor
-	iterator begin() const; ///<tartomány első cellájára mutató iterátor visszaadása
-	iterator end() const; ///<tartomány utolsó cellája utáni cellára mutató iterátor visszaadása
+	///tartomány első cellájára mutató iterátor visszaadása a megadott táblában
+	/**ha a tartomány kilóg a táblából, eval_error kivételt dob*/
+	iterator begin(Sheet& sh) const;
+	iterator end(Sheet& sh) const; ///<tartomány utolsó cellája utáni cellára mutató iterátor visszaadása a megadott táblában
 	///tartomány megjelenítése std::string-ként "a1:c4" formátumban
 	std::string show() const {return topCell->show() + ":" + bottomCell->show();}
 	///eltolja a taromány sarokcelláit adott sorral és oszloppal, amennyiben a sor/oszlop nem abszolút
 	void shift(int dx, int dy) {topCell->shift(dx, dy); bottomCell->shift(dx, dy);}
-	///a taromány sarokcelláinak célpontját áthelyezi egy másik számolótáblára
-	void relocate(Sheet* shp) {topCell->relocate(shp); bottomCell->relocate(shp);}
+	const CellRefExpr& top() const {return *topCell;} ///<a bal felső sarokcella hivatkozása
+	const CellRefExpr& bottom() const {return *bottomCell;} ///<a jobb alsó sarokcella hivatkozása
+	///a tartományt leíró téglalap (a sarokcellák alapján, az aktív origóhoz képest feloldva)
+	CellRect rect() const {return {topCell->getColNum(), topCell->getRow(), bottomCell->getColNum(), bottomCell->getRow()};}
 	///sarokcella hivatkozások felszabadítása
 	~Range(){
 		delete topCell;
@@ -43,27 +47,33 @@ public:
 	}
 
 	///Tartományt sorfolytonosan bejáró iterátor
+	/**A cellákat sor- és oszlopszámuk alapján éri el, így a tábla elrendezésétől függetlenül
+	működik. Olvasáskor a Sheet::parseCell-t használja, így ritka elrendezésben a nem írt
+	cellák csempéit nem foglalja le, írásra a write tagfüggvény adja a cellát (ld. Sheet::operator[]).*/
 	class iterator {
-		size_t rangeWidth; ///<tartomány szélessége (bejáráshoz szükséges)
-		size_t tableWidth; ///<tábla szélessége (bejáráshoz szükséges)
-		ExprPointer* actRow; ///<aktuális sor kezdőcellájára mutató pointer
-		ExprPointer* actCell; ///<aktuális cellára mutató pointer
+		Sheet* sheet; ///<a bejárt tábla
+		size_t firstCol; ///<a tartomány első oszlopa (0-tól indexelve)
+		size_t lastCol; ///<a tartomány utolsó oszlopa (0-tól indexelve)
+		size_t col; ///<az aktuális cella oszlopa (0-tól indexelve)
+		size_t row; ///<az aktuális cella sora (0-tól indexelve)
 	public:
 		///konstruktor
 		/**
 		csak a tartománybeli sorok elejéről lehet indítani az iterátort
-		@param rangeWidth - a bejárandó tartomány szélessége
-		@param tableWidth - a bejárandó tartományt taralmazó tábla szélessége
-		@param beginPtr - a cella, melyre az iterátor kezdetben mutat
+		@param sheet - a bejárandó tábla
+		@param firstCol - a tartomány első oszlopa (0-tól indexelve)
+		@param lastCol - a tartomány utolsó oszlopa (0-tól indexelve)
+		@param row - a sor, amelynek elejére az iterátor kezdetben mutat (0-tól indexelve)
 		*/
-		iterator(size_t rangeWidth, size_t tableWidth, ExprPointer* beginPtr)
-			: rangeWidth(rangeWidth), tableWidth(tableWidth), actRow(beginPtr), actCell(beginPtr) {}
+		iterator(Sheet* sheet, size_t firstCol, size_t lastCol, size_t row)
+			: sheet(sheet), firstCol(firstCol), lastCol(lastCol), col(firstCol), row(row) {}
 		///iterátor tartalmának kiolvasása
-		ExprPointer& operator*() const {return *actCell;}
-		ExprPointer* operator->() const {return actCell;} ///<iterátor tartalmának tagjainak elérése
-		bool operator==(const ExprPointer* ep) const {return actCell == ep;} ///<egyenlőség ExprPointer*-el
-		bool operator==(const iterator& it) const {return actCell == it.actCell;} ///<egyenlőség egy másik iterátorral
-		bool operator!=(const iterator& it) const {return actCell != it.actCell;} ///<egyenlőtlenség egy másik iterátorral
+		const ExprPointer& operator*() const {return *sheet->parseCell((unsigned int)col + 1, (unsigned int)row + 1);}
+		const ExprPointer* operator->() const {return &**this;} ///<iterátor tartalmának tagjainak elérése
+		ExprPointer& write() const {return (*sheet)[row][col];} ///<az aktuális cella írásra (szükség esetén lefoglalja a csempéjét)
+		bool operator==(const ExprPointer* ep) const {return &**this == ep;} ///<egyenlőség ExprPointer*-el
+		bool operator==(const iterator& it) const {return col == it.col && row == it.row;} ///<egyenlőség egy másik iterátorral
+		bool operator!=(const iterator& it) const {return !(*this == it);} ///<egyenlőtlenség egy másik iterátorral
 		iterator& operator++(); ///<preinkremens
 		iterator operator++(int); ///<posztinkremens
 	};
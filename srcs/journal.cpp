@@ -0,0 +1,229 @@
+#include <cstdio>
+#include <sstream>
+#include <filesystem>
+#include <utility>
+#include <algorithm>
+
+#include "journal.hpp"
+#include "mappedfile.hpp"
+
+
+uint64_t Journal::hash(std::string_view content){
+	uint64_t h = 14695981039346656037ull;
+	for (char c : content) {
+		h ^= (unsigned char)c;
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+std::string Journal::header() const {
+	return "journal " + std::to_string(baseSize) + " " + std::to_string(baseHash) + "\n";
+}
+
+size_t Journal::entriesStart(const std::string& base, std::string_view journal, std::string_view content){
+	size_t end = journal.find('\n');
+	if (end == std::string_view::npos)
+		return std::string_view::npos;
+	std::istringstream head(std::string(journal.substr(0, end)));
+	std::string magic;
+	size_t size;
+	uint64_t h;
+	if (!(head >> magic >> size >> h) || magic != "journal")
+		return std::string_view::npos;
+	uint64_t contentHash = hash(content);
+	if (size == content.size() && h == contentHash)
+		return end + 1;
+	//az új alapfájl már a helyén van, de a napló még a régihez tartozik: a tömörítés indítása
+	//előtti bejegyzéseket az új alapfájl már tartalmazza
+	MappedFile marker(markerFor(base));
+	std::istringstream line{std::string(marker.view())};
+	size_t oldSize, newSize, from;
+	uint64_t oldHash, newHash;
+	if (!(line >> magic >> oldSize >> oldHash >> newSize >> newHash >> from) || magic != "compact"
+			|| oldSize != size || oldHash != h || newSize != content.size() || newHash != contentHash)
+		return std::string_view::npos;
+	return std::min(std::max(from, end + 1), journal.size());
+}
+
+bool Journal::read(const std::string& base, std::string_view content, std::vector<std::string>& entries){
+	MappedFile journal(pathFor(base));
+	std::string_view text = journal.view();
+	size_t begin = entriesStart(base, text, content);
+	if (!journal.isOpen() || begin == std::string_view::npos)
+		return false;
+	//a csonka utolsó sort (sorvége nélkül) elhagyjuk
+	for (size_t end; (end = text.find('\n', begin)) != std::string_view::npos; begin = end + 1)
+		entries.emplace_back(text.substr(begin, end - begin));
+	return true;
+}
+
+void Journal::bind(const std::string& base, std::string_view content, bool keep){
+	unbind();
+	this->base = base;
+	baseSize = content.size();
+	baseHash = hash(content);
+	size_t size = 0, start = std::string_view::npos, headerEnd = 0;
+	std::string rest;
+	if (keep) {
+		MappedFile journal(pathFor(base));
+		std::string_view text = journal.view();
+		size = text.size();
+		length = text.rfind('\n') + 1;
+		start = entriesStart(base, text, content);
+		headerEnd = text.find('\n') + 1;
+		if (start != std::string_view::npos && start != headerEnd)
+			rest = std::string(text.substr(start, length - start));
+	}
+	if (start == std::string_view::npos) {
+		std::remove(pathFor(base).c_str());
+		length = 0;
+	} else if (start != headerEnd) {
+		rewrite(rest); //a megszakadt tömörítés után a napló az új alapfájl fejlécét kapja
+	} else if (length < size) {
+		std::filesystem::resize_file(pathFor(base), length); //a csonka sort levágjuk, hogy az új bejegyzés új sorban kezdődjön
+	}
+	std::remove(markerFor(base).c_str());
+}
+
+void Journal::bind(const std::string& base){
+	unbind();
+	this->base = base;
+	baseSize = 0;
+	baseHash = 0;
+	pendingBase = true;
+	std::remove(pathFor(base).c_str());
+	std::remove(markerFor(base).c_str());
+}
+
+void Journal::unbind(){
+	wait();
+	flush();
+	file.close();
+	base.clear();
+	length = 0;
+	pendingBase = false;
+}
+
+void Journal::discard(){
+	wait();
+	file.close();
+	if (!base.empty()) {
+		std::remove(pathFor(base).c_str());
+		std::remove(markerFor(base).c_str());
+	}
+	base.clear();
+	length = 0;
+	pending = 0;
+	pendingBase = false;
+}
+
+void Journal::record(const std::string& entry){
+	if (base.empty())
+		return;
+	if (!file.is_open()) {
+		if (length == 0) {
+			std::string h = header();
+			file.open(pathFor(base), std::ios::binary | std::ios::trunc);
+			file << h;
+			length = h.size();
+		} else {
+			file.open(pathFor(base), std::ios::binary | std::ios::app);
+		}
+	}
+	file << entry << '\n';
+	length += entry.size() + 1;
+	if (++pending >= batch)
+		flush();
+}
+
+void Journal::flush(){
+	if (file.is_open())
+		file.flush();
+	pending = 0;
+}
+
+void Journal::compact(std::function<std::string()> render){
+	if (base.empty() || compactor.joinable())
+		return;
+	flush();
+	compactFrom = length;
+	renderer = std::move(render);
+	compacted = false;
+	compactor = std::thread([this, path = base, oldSize = baseSize, oldHash = baseHash, from = compactFrom]{
+		//előbb ideiglenes fájlba írunk, így leállás esetén a régi alapfájl és a napló érvényes marad
+		std::string tmp = path + ".tmp";
+		try {
+			std::string content = renderer();
+			newSize = content.size();
+			newHash = hash(content);
+			std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+			out.write(content.data(), (std::streamsize)content.size());
+			out.close();
+			//az átnevezés után a régi fejlécű napló a jelzőfájl alapján az új alapfájlhoz is érvényes
+			std::ofstream marker(markerFor(path), std::ios::binary | std::ios::trunc);
+			marker << "compact " << oldSize << " " << oldHash << " " << newSize << " " << newHash << " " << from << "\n";
+			marker.close();
+			compactOk = !out.fail() && !marker.fail() && std::rename(tmp.c_str(), path.c_str()) == 0;
+		} catch (...) {
+			compactOk = false;
+		}
+		if (!compactOk) {
+			std::remove(tmp.c_str());
+			std::remove(markerFor(path).c_str());
+		}
+		compacted.store(true, std::memory_order_release);
+	});
+}
+
+bool Journal::poll(){
+	if (!compactor.joinable() || !compacted.load(std::memory_order_acquire))
+		return false;
+	compactor.join();
+	install();
+	return true;
+}
+
+void Journal::wait(){
+	if (compactor.joinable()) {
+		compactor.join();
+		install();
+	}
+}
+
+void Journal::install(){
+	renderer = nullptr; //a rögzített tábla a hívó szálon szűnik meg
+	if (!compactOk) {
+		if (pendingBase)
+			discard(); //alapfájl nélkül a napló nem használható
+		return; //a régi alapfájl a helyén maradt, a napló továbbra is hozzá tartozik
+	}
+	flush();
+	file.close();
+	std::string rest; //a tömörítés indítása óta érkezett bejegyzések (a fejléc nélkül)
+	if (length > compactFrom) {
+		MappedFile journal(pathFor(base));
+		size_t from = std::max(compactFrom, journal.view().find('\n') + 1);
+		rest = std::string(journal.view().substr(from, length - from));
+	}
+	baseSize = newSize;
+	baseHash = newHash;
+	pendingBase = false;
+	rewrite(rest);
+	std::remove(markerFor(base).c_str());
+}
+
+void Journal::rewrite(const std::string& rest){
+	if (rest.empty()) {
+		std::remove(pathFor(base).c_str());
+		length = 0;
+		return;
+	}
+	std::string h = header();
+	std::string tmp = pathFor(base) + ".tmp";
+	std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+	out << h << rest;
+	out.close();
+	std::rename(tmp.c_str(), pathFor(base).c_str());
+	length = h.size() + rest.size();
+}
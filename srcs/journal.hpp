@@ -0,0 +1,106 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+///Egy alapfájlhoz (csv vagy bináris pillanatkép) tartozó, csak hozzáfűzhető módosításnapló
+/**
+A napló az alapfájl mellett, annak nevéhez ".journal"-t fűzve található. Első sora a fejléc
+("journal <méret> <hash>"), amely az alapfájl méretét és tartalmának hash-ét rögzíti, így egy
+másik (pl. azóta felülírt) alapfájlhoz tartozó naplót betöltéskor nem játszunk vissza. A többi
+sor egy-egy módosító konzolparancs a paramétereivel (pl. "set a1 b2+1"), ezeket betöltéskor az
+alapfájl után sorban végre kell hajtani (ld. Console::load). A csonka utolsó sort (pl. írás
+közbeni leállás után) elhagyjuk.
+
+A bejegyzéseket a napló batch darabonként üríti a fájlba, egy mentés így csak a változások
+kiírásába kerül. Ha a napló az alapfájlhoz képest túl nagyra nő (ld. COMPACT_RATIO), a
+tömörítés (compact) egy háttérszálon új alapfájlt ír, majd a naplóban csak az azóta érkezett
+bejegyzések maradnak meg. Amíg az új alapfájl nincs a helyén, a régi alapfájl és a teljes
+napló együtt érvényes marad. Az új alapfájl átnevezése előtt egy jelzőfájl (ld. markerFor)
+rögzíti a régi és az új alapfájl adatait, valamint a tömörítés indításakor érvényes naplóhosszt:
+ha a program az átnevezés után, de a napló átírása előtt áll le, a régi fejlécű napló ennek
+alapján az új alapfájlhoz is betölthető. A napló egy még ki nem írt alapfájlhoz is köthető, ekkor az
+alapfájlt az első tömörítés írja ki (pl. automatikus mentéskor, ld. Console::autosave).
+*/
+class Journal {
+	std::string base; ///<az alapfájl neve (üres, ha a napló nincs alapfájlhoz kötve)
+	size_t baseSize = 0; ///<az alapfájl mérete bájtokban
+	uint64_t baseHash = 0; ///<az alapfájl tartalmának hash-e
+	std::ofstream file; ///<a naplófájl (az első bejegyzéskor nyílik meg)
+	size_t length = 0; ///<a naplófájl érvényes hossza bájtokban (0, ha még nem létezik)
+	size_t pending = 0; ///<a legutóbbi ürítés óta rögzített bejegyzések száma
+	size_t batch; ///<ennyi bejegyzésenként ürítjük a naplót
+	bool pendingBase = false; ///<az alapfájl még nincs kiírva (az első tömörítés írja ki)
+
+	std::thread compactor; ///<az új alapfájlt író háttérszál
+	std::function<std::string()> renderer; ///<az új alapfájl tartalmát előállító függvény (a háttérszálon fut, de a fő szálon szűnik meg)
+	std::atomic<bool> compacted{false}; ///<a háttérszál végzett-e
+	bool compactOk = false; ///<sikerült-e az új alapfájl kiírása
+	size_t compactFrom = 0; ///<a naplóban a tömörítés indításakor rögzített hossz
+	size_t newSize = 0; ///<az új alapfájl mérete
+	uint64_t newHash = 0; ///<az új alapfájl tartalmának hash-e
+
+	std::string header() const; ///<a napló fejléce az aktuális alapfájlhoz
+	///a napló első, az adott tartalmú alapfájlra vonatkozó bejegyzésének helye
+	/**@return std::string_view::npos, ha a napló nem ehhez az alapfájlhoz tartozik (a fejléce sem,
+	és a befejezetlen tömörítés jelzőfájlja szerint sem)*/
+	static size_t entriesStart(const std::string& base, std::string_view journal, std::string_view content);
+	void install(); ///<befejezett tömörítés után a napló elejét eldobja (csak a fő szálról hívható)
+	void rewrite(const std::string& rest); ///<a naplót az aktuális fejléccel és a megadott bejegyzésekkel írja újra (üres bejegyzéseknél törli)
+public:
+	static const size_t COMPACT_RATIO = 2; ///<tömörítünk, ha a napló mérete ennyiszerese eléri az alapfájlét
+
+	explicit Journal(size_t batch = 1) : batch(batch) {} ///<konstruktor, a napló batch bejegyzésenként ürül
+	Journal(const Journal&) = delete;
+	Journal& operator=(const Journal&) = delete;
+
+	static std::string pathFor(const std::string& base) {return base + ".journal";} ///<az alapfájlhoz tartozó napló neve
+	static std::string markerFor(const std::string& base) {return pathFor(base) + ".compact";} ///<a befejezetlen tömörítés jelzőfájljának neve
+	static uint64_t hash(std::string_view content); ///<tartalom hash-e (64 bites FNV-1a)
+	///beolvassa az alapfájlhoz tartozó napló bejegyzéseit
+	/**Ha a tömörítés az új alapfájl átnevezése után szakadt meg, a régi fejlécű napló tömörítés
+	után érkezett bejegyzéseit adja.
+	@return hamis, ha nincs napló, vagy az nem a megadott tartalmú alapfájlhoz tartozik*/
+	static bool read(const std::string& base, std::string_view content, std::vector<std::string>& entries);
+
+	///a naplót a megadott tartalmú alapfájlhoz köti
+	/**@param keep - igaz, ha a meglévő napló (ld. read) ehhez az alapfájlhoz tartozik és folytatjuk
+	(a megszakadt tömörítés után a naplót az új fejléccel átírja), különben a régi naplót töröljük,
+	és az első bejegyzéssel új kezdődik*/
+	void bind(const std::string& base, std::string_view content, bool keep);
+	///a naplót egy még ki nem írt alapfájlhoz köti, az alapfájlt a következő tömörítés írja ki
+	/**ha a tömörítés nem sikerül, a naplót eldobja (ld. discard)*/
+	void bind(const std::string& base);
+	void unbind(); ///<megvárja a tömörítést, üríti és lezárja a naplót
+	void discard(); ///<lezárja és törli a naplót (pl. ha az alapfájlt más tartalom írta felül)
+	const std::string& getBase() const {return base;} ///<az alapfájl neve (üres, ha nincs)
+	bool isPending() const {return pendingBase;} ///<igaz, ha az alapfájl még csak a háttérben készül
+	bool isCompacting() const {return compactor.joinable();} ///<igaz, ha fut (vagy feldolgozatlan) tömörítés
+	size_t size() const {return length;} ///<a napló mérete bájtokban
+	void setBatch(size_t n) {batch = n == 0 ? 1 : n;} ///<ennyi bejegyzésenként ürüljön a napló
+
+	void record(const std::string& entry); ///<egy módosítás rögzítése (ha a napló alapfájlhoz van kötve)
+	void flush(); ///<a rögzített bejegyzések kiírása a fájlba
+
+	///igaz, ha a napló elég nagy a tömörítéshez, és nem fut már tömörítés
+	bool needsCompaction() const {return length > 0 && length * COMPACT_RATIO >= baseSize && !compactor.joinable();}
+	///egy háttérszálon új alapfájlt ír a render által előállított tartalommal (ideiglenes fájlba, majd átnevezi)
+	/**A tartalomnak a napló eddigi bejegyzéseit tartalmazó táblát kell leírnia (pl. egy
+	SheetImage-ből), a hívás után érkező bejegyzések a naplóban maradnak (ld. poll). A render
+	függvényt a napló a tömörítés feldolgozásakor a hívó szálon szünteti meg.*/
+	void compact(std::function<std::string()> render);
+	///ha a háttérben futó tömörítés végzett, a naplót az új alapfájlhoz igazítja
+	/**@return igaz, ha befejezett tömörítést dolgozott fel*/
+	bool poll();
+	void wait(); ///<megvárja és feldolgozza a futó tömörítést
+	~Journal() {unbind();} ///<destruktor, a naplót üríti
+};
+
+#endif
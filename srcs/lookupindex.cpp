@@ -0,0 +1,100 @@
+#include "lookupindex.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+///indexelhető-e az érték (a hibaértékek és a NaN-ok nem egyenlők semmivel)
+static bool indexable(double v){
+	return !std::isnan(v);
+}
+
+LookupIndex::LookupIndex(const std::vector<double>& values, bool ordered){
+	if (ordered) {
+		sorted.reserve(values.size());
+		for (size_t i = 0; i < values.size(); i++)
+			if (indexable(values[i]))
+				sorted.emplace_back(values[i], (unsigned int)i);
+		std::sort(sorted.begin(), sorted.end());
+		return;
+	}
+	first.reserve(values.size());
+	for (size_t i = 0; i < values.size(); i++)
+		if (indexable(values[i]))
+			first.emplace(values[i], (unsigned int)i); //a már szereplő értéket nem írja felül
+}
+
+long LookupIndex::find(double key) const {
+	auto it = first.find(key);
+	return it == first.end() ? NOT_FOUND : (long)it->second;
+}
+
+long LookupIndex::findBelow(double key) const {
+	//az első, a kulcsnál nagyobb érték előtti érték a legnagyobb nem nagyobb, ennek keressük az első előfordulását
+	auto it = std::upper_bound(sorted.begin(), sorted.end(), key,
+		[](double k, const std::pair<double, unsigned int>& e){return k < e.first;});
+	if (it == sorted.begin())
+		return NOT_FOUND;
+	double value = std::prev(it)->first;
+	it = std::lower_bound(sorted.begin(), sorted.end(), value,
+		[](const std::pair<double, unsigned int>& e, double v){return e.first < v;});
+	return (long)it->second;
+}
+
+long LookupIndex::scan(const std::vector<double>& values, double key, bool ordered){
+	long found = NOT_FOUND;
+	for (size_t i = 0; i < values.size(); i++) {
+		if (!indexable(values[i]))
+			continue;
+		if (!ordered && values[i] == key)
+			return (long)i;
+		if (ordered && values[i] <= key && (found == NOT_FOUND || values[i] > values[(size_t)found]))
+			found = (long)i;
+	}
+	return found;
+}
+
+std::shared_ptr<const LookupIndex> LookupIndexes::get(const CellRect& r, bool ordered){
+	if (empty)
+		return nullptr;
+	std::lock_guard<std::mutex> lock(mutex);
+	auto col = columns.find(r.col1);
+	if (col == columns.end())
+		return nullptr;
+	auto it = col->second.find({r.row1, r.row2});
+	if (it == col->second.end())
+		return nullptr;
+	return ordered ? it->second.ordered : it->second.exact;
+}
+
+void LookupIndexes::put(const CellRect& r, bool ordered, std::shared_ptr<const LookupIndex> index){
+	std::lock_guard<std::mutex> lock(mutex);
+	Entry& entry = columns[r.col1][{r.row1, r.row2}];
+	(ordered ? entry.ordered : entry.exact) = std::move(index);
+	empty = false;
+}
+
+void LookupIndexes::invalidate(unsigned int col, unsigned int row){
+	if (empty)
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = columns.find(col);
+	if (it == columns.end())
+		return;
+	std::map<std::pair<unsigned int, unsigned int>, Entry>& ranges = it->second;
+	for (auto r = ranges.begin(); r != ranges.end();) {
+		if (r->first.first <= row && row <= r->first.second)
+			r = ranges.erase(r);
+		else
+			++r;
+	}
+	if (ranges.empty())
+		columns.erase(it);
+	empty = columns.empty();
+}
+
+void LookupIndexes::clear(){
+	std::lock_guard<std::mutex> lock(mutex);
+	columns.clear();
+	empty = true;
+}
@@ -0,0 +1,64 @@
+#ifndef LOOKUPINDEX_HPP
+#define LOOKUPINDEX_HPP
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#include "dependency.hpp"
+
+///Egy oszloptartomány értékeinek keresőindexe (ld. Sheet::rangeMatch)
+/**
+Pontos kereséshez hash táblát épít, amely minden értékhez az első előfordulásának helyét
+tárolja, közelítő kereséshez pedig az (érték, hely) párok rendezett tömbjét, amelyben a
+legnagyobb, a kulcsnál nem nagyobb érték bináris kereséssel megtalálható. A közelítő keresés
+így nem feltételezi, hogy a tartomány rendezett. A hibaértékeket és a NaN-okat nem indexeli.
+A helyeket a tartomány elejétől, 0-tól számolja.
+*/
+class LookupIndex {
+	std::unordered_map<double, unsigned int> first; ///<pontos kereséshez: érték -> első előfordulás
+	std::vector<std::pair<double, unsigned int>> sorted; ///<közelítő kereséshez: (érték, hely) párok növekvő sorrendben
+public:
+	static const long NOT_FOUND = -1; ///<a keresés sikertelen
+	///index építése a tartomány értékeiből
+	/**@param ordered - igaz, ha közelítő kereséshez (rendezett tömb), hamis, ha pontos kereséshez (hash tábla) készül*/
+	LookupIndex(const std::vector<double>& values, bool ordered);
+	long find(double key) const; ///<a kulccsal egyenlő első érték helye (pontos keresés)
+	long findBelow(double key) const; ///<a legnagyobb, a kulcsnál nem nagyobb érték első előfordulásának helye (közelítő keresés)
+	///ugyanezek a keresések index nélkül, a tartomány egyszeri bejárásával (kis tartományokhoz)
+	static long scan(const std::vector<double>& values, double key, bool ordered);
+};
+
+///A tábla oszloptartományaihoz lustán épített keresőindexek nyilvántartása
+/**
+Az indexek oszloponként, a tartomány sorai szerint tárolódnak, és a tartomány egy cellájának
+módosításakor (vagy elavulásakor) eldobódnak, a következő keresés építi újra őket. A
+keresések több szálról is érkezhetnek (ld. Sheet::recalculate): az indexet a hívó a zár
+nélkül építi fel, mert az építés képletcellákat értékelhet ki, amelyek maguk is keresést
+végezhetnek. A kész indexeket megosztott pointerként adjuk ki, így egy közben eldobott index
+a keresés végéig érvényes marad.
+*/
+class LookupIndexes {
+	///egy tartomány két indexe
+	struct Entry {
+		std::shared_ptr<const LookupIndex> exact; ///<pontos kereséshez
+		std::shared_ptr<const LookupIndex> ordered; ///<közelítő kereséshez
+	};
+	std::map<unsigned int, std::map<std::pair<unsigned int, unsigned int>, Entry>> columns; ///<oszloponként a tartományok (első, utolsó sor) szerint
+	std::mutex mutex; ///<a columns védelme
+	std::atomic<bool> empty{true}; ///<nincs tárolt index (a módosításokat ekkor zár nélkül átengedjük)
+public:
+	static const unsigned int MIN_ROWS = 64; ///<ennél rövidebb tartományt index nélkül, bejárással keresünk
+
+	///a tartomány indexe (nullptr, ha még nem épült fel)
+	std::shared_ptr<const LookupIndex> get(const CellRect& r, bool ordered);
+	void put(const CellRect& r, bool ordered, std::shared_ptr<const LookupIndex> index); ///<egy felépült index tárolása
+	void invalidate(unsigned int col, unsigned int row); ///<az adott cellát tartalmazó tartományok indexeinek eldobása
+	void clear(); ///<minden index eldobása
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include <fstream>
+#include <iterator>
+
+#include "mappedfile.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP
+#endif
+
+
+MappedFile::MappedFile(const std::string& fname){
+	if (map(fname)) {
+		opened = true;
+		return;
+	}
+	std::ifstream ifile(fname, std::ios::binary);
+	if (!ifile)
+		return;
+	buffer.assign(std::istreambuf_iterator<char>(ifile), std::istreambuf_iterator<char>());
+	data = buffer.data();
+	length = buffer.size();
+	opened = true;
+}
+
+bool MappedFile::map(const std::string& fname){
+#ifdef HAVE_MMAP
+	int fd = ::open(fname.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	void* p = MAP_FAILED;
+	//üres fájlt nem lehet leképezni, azt a buffer kezeli
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); //a leképezés a fájlleíró nélkül is megmarad
+	if (p == MAP_FAILED)
+		return false;
+	data = static_cast<const char*>(p);
+	length = (size_t)st.st_size;
+	mapped = true;
+	return true;
+#else
+	(void)fname;
+	return false;
+#endif
+}
+
+MappedFile::~MappedFile(){
+#ifdef HAVE_MMAP
+	if (mapped)
+		munmap(const_cast<char*>(data), length);
+#endif
+}
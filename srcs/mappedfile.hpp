@@ -0,0 +1,30 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <string>
+#include <string_view>
+
+///Egy fájl teljes tartalmát olvasásra elérhetővé tevő osztály
+/**
+Ahol lehet, a fájlt a memóriába képezi le (mmap), így a tartalmát nem kell átmásolni, és a
+betöltés több szálról is olvashatja egyszerre. Ha a leképezés nem lehetséges (pl. üres fájl,
+vagy nem POSIX rendszer), a fájlt egyben beolvassa egy saját bufferbe.
+*/
+class MappedFile {
+	const char* data = nullptr; ///<a fájl tartalmának eleje (a leképezésben vagy a bufferben)
+	size_t length = 0; ///<a fájl hossza bájtokban
+	bool mapped = false; ///<a tartalom leképezés-e (különben a bufferben van)
+	bool opened = false; ///<sikerült-e megnyitni a fájlt
+	std::string buffer; ///<a beolvasott tartalom, ha a leképezés nem lehetséges
+
+	bool map(const std::string& fname); ///<megpróbálja a memóriába képezni a fájlt
+public:
+	explicit MappedFile(const std::string& fname); ///<konstruktor, megnyitja a fájlt (ld. isOpen)
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	bool isOpen() const {return opened;} ///<igaz, ha a fájlt sikerült megnyitni
+	std::string_view view() const {return std::string_view(data, length);} ///<a fájl tartalma (az objektum élettartamáig érvényes)
+	~MappedFile(); ///<megszünteti a leképezést
+};
+
+#endif
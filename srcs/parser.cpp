@@ -1,65 +1,50 @@
 #include <cctype>
+#include <charconv>
 #include "parser.hpp"
 #include "exceptions.hpp"
 
 
 void Parser::addToken(Token_type type){
-	tokens.push_back(new Token(type));
+	tokens.emplace_back(type);
 }
 
-void Parser::addToken(const std::string& s){
-	tokens.push_back(new DataToken<std::string>(STRING, s));
+void Parser::addToken(std::string_view s){
+	tokens.emplace_back(STRING, s);
 }
 
 void Parser::addToken(double num){
-	tokens.push_back(new DataToken<double>(NUMBER, num));
+	tokens.emplace_back(NUMBER, std::string_view(), num);
 }
 
-void Parser::addTokenFromStr(std::string& str_buffer){
-	if (!str_buffer.empty()) {
-		try	{
-			size_t pos;
-			double num = std::stod(str_buffer, &pos);
-			if (pos < str_buffer.size()) {
-				addToken(str_buffer);
-			} else {
-				addToken(num);
-			}
-		} catch (const std::invalid_argument& ia){
-			addToken(str_buffer);
-		}
-		str_buffer = "";
-	}
+void Parser::addTokenFromStr(std::string_view str){
+	if (str.empty())
+		return;
+	double num;
+	std::from_chars_result res = std::from_chars(str.data(), str.data() + str.size(), num);
+	if (res.ec == std::errc() && res.ptr == str.data() + str.size())
+		tokens.emplace_back(NUMBER, str, num);
+	else
+		tokens.emplace_back(STRING, str);
 }
 
-Parser::Parser(const std::string& input){
-	std::string str_buffer = "";
-	for (const char& c : input) {
-		if (std::isspace(c))
+Parser::Parser(std::string_view input){
+	tokens.reserve(input.size() / 2 + 2); //a szokásos képletekhez elég egyetlen foglalás
+	size_t start = 0; //az éppen olvasott szó eleje
+	for (size_t i = 0; i < input.size(); i++) {
+		char c = input[i];
+		if (std::isspace((unsigned char)c)) {
+			addTokenFromStr(input.substr(start, i - start));
+			start = i + 1;
 			continue;
-		Token_type type = Token::parseTokenType(c);
-		if (type == STRING) {
-			str_buffer.append(1, c);
-		} else {
-			addTokenFromStr(str_buffer);
-			addToken(type);
 		}
-	}
-	addTokenFromStr(str_buffer);
-}
-
-Parser& Parser::operator=(const Parser& p){
-	if (&p != this) {
-		for (size_t i = 0; i < tokens.size(); i++) {
-			delete tokens[i];
-		}
-		tokens.resize(0);
-		for (Token* t : p.tokens) {
-			tokens.push_back(t->copy());
+		Token_type type = Token::parseTokenType(c);
+		if (type != STRING) {
+			addTokenFromStr(input.substr(start, i - start));
+			tokens.emplace_back(type, input.substr(i, 1));
+			start = i + 1;
 		}
-		current = p.current;
 	}
-	return *this;
+	addTokenFromStr(input.substr(start));
 }
 
 bool Parser::match(Token_type ttype){
@@ -71,21 +56,21 @@ bool Parser::match(Token_type ttype){
 	return false;
 }
 
-Token* Parser::consume(Token_type ttype, const char* msg){
+const Token& Parser::consume(Token_type ttype, const char* msg){
 	if (match(ttype))
 		return prev();
 	throw syntax_error(msg);
 }
 
-Expression* Parser::expression(Sheet* shptr){
-	Expression* expr = factor(shptr);
+Expression* Parser::expression(){
+	Expression* expr = factor();
 	if (expr == nullptr)
 		throw syntax_error("not enough arguments");
 	while (match(MINUS) || match(PLUS)){
-		Token_type operand = prev()->getType();
+		Token_type operand = prev().getType();
 		Expression* rhs;
 		try {
-			rhs = factor(shptr);
+			rhs = factor();
 		} catch (const std::runtime_error&){
 			delete expr;
 			throw;
@@ -99,15 +84,15 @@ Expression* Parser::expression(Sheet* shptr){
 	return expr;
 }
 
-Expression* Parser::factor(Sheet* shptr){
-	Expression* expr = unary(shptr);
+Expression* Parser::factor(){
+	Expression* expr = unary();
 	if (expr == nullptr)
 		throw syntax_error("not enough arguments");
 	while (match(SLASH) || match(STAR)){
-		Token_type operand = prev()->getType();
+		Token_type operand = prev().getType();
 		Expression* rhs;
 		try {
-			rhs = unary(shptr);
+			rhs = unary();
 		} catch (const std::runtime_error&) {
 			delete expr;
 			throw;
@@ -121,32 +106,35 @@ Expression* Parser::factor(Sheet* shptr){
 	return expr;
 }
 
-Expression* Parser::unary(Sheet* shptr){
+Expression* Parser::unary(){
 	Expression* expr = nullptr;
-	if (match(MINUS) && (expr = unary(shptr))) {
+	if (match(MINUS) && (expr = unary())) {
 		return new Mult(new NumberExpr(-1), expr);
-	} else if ((expr = function(shptr))) {
+	} else if ((expr = function())) {
 		return expr;
-	} else if ((expr = primary(shptr))){
+	} else if ((expr = primary())){
 		return expr;
 	}
 	return expr;
 }
 
-Expression* Parser::function(Sheet* shptr){
+Expression* Parser::function(){
 	size_t c = current;
 	if (match(STRING)) {
-		std::string fnameStr = dynamic_cast<DataToken<std::string>*>(prev())->getContent(); //bad cast
-		std::optional<FunctionName> fname = FunctionExpr::parseFname(fnameStr);
+		std::optional<FunctionName> fname = FunctionExpr::parseFname(prev().getText());
 		if (match(LEFT_BR)) {
 			if (!fname)
 				throw syntax_error("invalid function name");
+			if (FunctionExpr::isLookup(fname.value()))
+				return lookup(fname.value());
+			if (FunctionExpr::isConditional(fname.value()))
+				return conditional(fname.value());
 			CellRefExpr* c1 = nullptr;
 			CellRefExpr* c2 = nullptr;
 			try {
-				c1 = cell(shptr);
+				c1 = cell();
 				consume(COLON, "invalid range in function");
-				c2 = cell(shptr);
+				c2 = cell();
 				consume(RIGHT_BR, "mismatched brackets");
 			} catch (const std::runtime_error&){
 				delete c1;
@@ -165,17 +153,85 @@ Expression* Parser::function(Sheet* shptr){
 	return nullptr;
 }
 
-Expression* Parser::primary(Sheet* shptr){
+Expression* Parser::lookup(FunctionName fname){
+	Expression* key = expression();
+	CellRefExpr* cells[4] = {nullptr, nullptr, nullptr, nullptr};
+	bool sorted = false;
+	try {
+		consume(SEMICOLON, "not enough arguments");
+		range(cells[0], cells[1], "invalid range in function");
+		if (fname == LOOKUP) {
+			consume(SEMICOLON, "not enough arguments");
+			range(cells[2], cells[3], "invalid range in function");
+		}
+		if (match(SEMICOLON)) {
+			double mode = consume(NUMBER, "invalid match mode").getNumber();
+			if (mode != 0 && mode != 1)
+				throw syntax_error("invalid match mode");
+			sorted = mode == 1;
+		}
+		consume(RIGHT_BR, "mismatched brackets");
+		for (int i = 0; i < 4; i += 2) {
+			//az eltolás után is egyoszlopos marad, ha a két oszlop azonos és egyformán abszolút vagy relatív
+			if (cells[i] && (cells[i]->operand().col != cells[i+1]->operand().col || cells[i]->operand().absCol != cells[i+1]->operand().absCol))
+				throw syntax_error("lookup range must be a single column");
+		}
+	} catch (const std::runtime_error&) {
+		delete key;
+		for (CellRefExpr* c : cells)
+			delete c;
+		throw;
+	}
+	return new LookupFunc(key, cells[0], cells[1], sorted, cells[2], cells[3]);
+}
+
+Expression* Parser::conditional(FunctionName fname){
+	CellRefExpr* cells[4] = {nullptr, nullptr, nullptr, nullptr};
+	Expression* threshold = nullptr;
+	Criterion::Op op = Criterion::EQ;
+	try {
+		range(cells[0], cells[1], "invalid range in function");
+		consume(SEMICOLON, "not enough arguments");
+		op = comparison();
+		threshold = expression();
+		if (fname != COUNTIF && match(SEMICOLON))
+			range(cells[2], cells[3], "invalid range in function");
+		consume(RIGHT_BR, "mismatched brackets");
+	} catch (const std::runtime_error&) {
+		delete threshold;
+		for (CellRefExpr* c : cells)
+			delete c;
+		throw;
+	}
+	return new ConditionalFunc(fname, cells[0], cells[1], op, threshold, cells[2], cells[3]);
+}
+
+Criterion::Op Parser::comparison(){
+	if (match(LESS)) {
+		if (match(EQUAL))
+			return Criterion::LE;
+		return match(GREATER) ? Criterion::NE : Criterion::LT;
+	}
+	if (match(GREATER))
+		return match(EQUAL) ? Criterion::GE : Criterion::GT;
+	match(EQUAL);
+	return Criterion::EQ;
+}
+
+void Parser::range(CellRefExpr*& topCell, CellRefExpr*& bottomCell, const char* msg){
+	if (!(topCell = cell()))
+		throw syntax_error(msg);
+	consume(COLON, msg);
+	if (!(bottomCell = cell()))
+		throw syntax_error(msg);
+}
+
+Expression* Parser::primary(){
 	Expression* expr = nullptr;
 	if (match(NUMBER)) {
-		try {
-			DataToken<double>* numToken = dynamic_cast<DataToken<double>*>(prev());
-			return new NumberExpr(numToken->getContent());
-		} catch (const std::bad_cast&){
-			throw std::runtime_error("tokenization error");
-		}
+		return new NumberExpr(prev().getNumber());
 	} else if (match(LEFT_BR)){
-		expr = expression(shptr);
+		expr = expression();
 		try {
 			consume(RIGHT_BR, "mismatched brackets");
 		} catch (const std::runtime_error&){
@@ -183,54 +239,52 @@ Expression* Parser::primary(Sheet* shptr){
 			throw;
 		}
 		return expr;
-	} else if ((expr = cell(shptr))){
+	} else if ((expr = cell())){
 		return expr;
 	}
 	return nullptr;
 }
 
-CellRefExpr* Parser::cell(Sheet* shptr){
+CellRefExpr* Parser::cell(){
 	CellRefExpr* expr = nullptr;
 	bool absCol = false;
 	if (match(DOLLAR))
 		absCol = true;
-	std::string colstr;
 	if (match(STRING)) {
-		try	{
-			colstr = dynamic_cast<DataToken<std::string>*>(prev())->getContent();
-		} catch (const std::bad_cast&) {throw std::runtime_error("tokenization error");}
+		std::string_view colstr = prev().getText();
 		if (match(DOLLAR)) {//col and row are separated, row is absolute
 			if (match(NUMBER)) {
-				try	{
-					unsigned int n = (unsigned int)dynamic_cast<DataToken<double>*>(prev())->getContent();
-					return new CellRefExpr(colstr, n, shptr, absCol, true);
-				} catch (const std::bad_cast& bc) {throw std::runtime_error("tokenization error");}
+				return new CellRefExpr(colstr, (unsigned int)prev().getNumber(), absCol, true);
 			} else {
 				throw syntax_error("invalid cell syntax");
 			}
 		} else {//row isn't absolute
-			return new CellRefExpr(colstr, shptr, absCol, false);
+			return new CellRefExpr(colstr, absCol, false);
 		}
 	}
 	return expr;
 }
 
-Expression* Parser::parse(Sheet* shptr){
+Expression* Parser::parse(){
 	current = 0;
-	return expression(shptr);
+	return expression();
 }
 
 void Parser::parseTo(Sheet* shptr, ExprPointer& target){
-	Expression* expr = parse(shptr);
+	NodeArena::Scope scope(shptr && shptr->contains(&target) ? shptr->getArena() : nullptr);
+	Expression* expr = parse();
 	if (expr) {
+		expr = expr->optimize();
 		target = expr;
+		if (shptr)
+			shptr->update(&target);
 	}
 }
 
 std::string Parser::show(){
 	std::string outp = "";
-	for (Token*& t : tokens) {
-		outp += t->show() + ", ";
+	for (const Token& t : tokens) {
+		outp += t.show() + ", ";
 	}
 	return outp;
 }
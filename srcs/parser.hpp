@@ -2,6 +2,7 @@
 #define PARSER_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
 
@@ -13,6 +14,10 @@
 ///Kifejezéseket értelmező osztály
 /**
 A parser osztályt egy std::string-el inicializáljuk, amit a Parser konstruktora tokenekre bont.
+A tokenek értéktípusok, egyetlen tömbben tárolódnak, és a bemenet szeleteire mutatnak (ld.
+Token), ezért a bemenetnek a Parser élettartama alatt érvényesnek kell maradnia. A számokat
+std::from_chars olvassa ki, így a tokenizálás kivételt nem dob, és tokenenként nem foglal
+memóriát.
 Parser a parse tagfüggvényének segítségével megpróbálja értelmezni az adott kifejezést, és
 amennyiben ez lehetséges (azaz a kifejezés szintaktikailag helyes), létre is hozza a kifejezést
 dinamikus memóriaterületen, különben syntax_error típusú kivételt dob. A kifejezés értelmezése az
@@ -20,7 +25,10 @@ alábbi szabályok alapján zajlik:\n
 	expression     → factor ( ( "-" | "+" ) factor )* ;\n
 	factor         → unary ( ( "/" | "*" ) unary )* ;\n
 	unary          → "-" unary | function | primary;\n
-	function       → STRING "(" cell ":" cell ")";\n
+	function       → STRING "(" range ")" | STRING "(" expression ";" range (";" range)? (";" NUMBER)? ")"
+	                 | STRING "(" range ";" criterion (";" range)? ")";\n
+	criterion      → ( "=" | "<>" | "<" | "<=" | ">" | ">=" )? expression;\n
+	range          → cell ":" cell;\n
 	cell           → ('$')? STRING ('$' NUMBER)?;\n
 	primary        → NUMBER | "(" expression ")" | cell;\n
 Minden ilyen fent leírt szabályhoz tartozik egy-egy tagfüggvény, amelyeknek feladata, hogy a
@@ -34,15 +42,29 @@ Crafting Interpreters c. könyvéből merít ihletet, amely az alábbi linken el
 https://craftinginterpreters.com.
 
 Megj.: az "-" unary mintára illeszkedő egy -1-el való szorzásra fordítja a parser, minden
-más mintának saját osztálya van
+más mintának saját osztálya van. A parse az így kapott fát változatlanul adja vissza, a parseTo
+viszont a cellába írás előtt egyszerűsíti is (ld. Expression::optimize): összevonja a csak
+konstansokat tartalmazó részfákat, a -1-el való szorzást ellentettképzéssé (Negate) alakítja,
+elhagyja a *1, /1, -0 azonosságokat (a +0-t nem, mert a -0+0 értéke +0), az egymásba ágyazott
+összeadásokat pedig egyetlen többtagú összeadássá (AddChain) fűzi. Az egyszerűsített kifejezés
+értéke bitre azonos az eredetiével: az összeadás tagjainak sorrendje és zárójelezése megmarad,
+csak az elején álló konstans tagok vonódnak össze.
+
+A függvények paramétereit pontosvessző választja el (pl. lookup(b1;$a$1:$a$100;$c$1:$c$100)),
+mert a vessző a csv fájlokban a cellákat választja el. A második szabály csak a keresőfüggvényekre
+(match, lookup) illeszkedik: a kulcs tetszőleges kifejezés, a tartományok egyoszloposak, a
+harmadik tartomány csak a lookup-hoz tartozik, a záró szám pedig a keresés módja (0: pontos,
+1: közelítő). A harmadik szabály a feltételes összesítésekre (sumif, countif, avgif) illeszkedik:
+az első tartomány celláit a feltétel küszöbértékéhez hasonlítjuk, az elhagyható második tartomány
+(a countif-nél nem adható meg) pedig az összegzett értékeké (pl. sumif(a1:a100;>=10;b1:b100)).
 */
 class Parser {
-	std::vector<Token*> tokens; ///<az értelmezni kívánt kifejezés tokenizált alakban
+	std::vector<Token> tokens; ///<az értelmezni kívánt kifejezés tokenizált alakban
 	size_t current = 0; ///<az éppen feldolgozás alatt álló token indexe
 
 	bool atEnd() const {return current >= tokens.size();} ///<ellenőrzi, hogy a feldolgozás végén járunk-e
-	Token* prev() const {return tokens[current-1];} ///visszaadja az előző tokent
-	bool check(Token_type ttype) const {return !atEnd() && tokens[current]->getType()==ttype;}
+	const Token& prev() const {return tokens[current-1];} ///<visszaadja az előző tokent
+	bool check(Token_type ttype) const {return !atEnd() && tokens[current].getType()==ttype;}
 		///<ellenőrzi a jelenlegi token egy adott típusú-e
 	bool match(Token_type ttype);
 		///<ellenőrzi a jelenlegi token egy adott típusú-e, ha igen, akkor tovább lépteti a feldolgozást
@@ -51,46 +73,43 @@ class Parser {
 	@param ttype - elfogyasztani kívánt tokentípus
 	@param msg - ha a jelenlegi token nem az adott típusú ez az üzenet kerül a syntax_error belsejébe
 	*/
-	Token* consume(Token_type ttype, const char* msg);
+	const Token& consume(Token_type ttype, const char* msg);
 
-	Expression* expression(Sheet* shptr = nullptr);
-	Expression* factor(Sheet* shptr = nullptr);
-	Expression* unary(Sheet* shptr = nullptr);
-	Expression* function(Sheet* shptr = nullptr);
-	Expression* primary(Sheet* shptr = nullptr);
-	CellRefExpr* cell(Sheet* shptr = nullptr);
+	Expression* expression();
+	Expression* factor();
+	Expression* unary();
+	Expression* function();
+	Expression* lookup(FunctionName fname); ///<keresőfüggvény (match, lookup) paramétereinek értelmezése a nyitó zárójel után
+	Expression* conditional(FunctionName fname); ///<feltételes összesítés (sumif, countif, avgif) paramétereinek értelmezése a nyitó zárójel után
+	Criterion::Op comparison(); ///<a feltétel elején álló (elhagyható) összehasonlító jel értelmezése
+	void range(CellRefExpr*& topCell, CellRefExpr*& bottomCell, const char* msg); ///<egy tartomány értelmezése, hiba esetén msg üzenetű syntax_error
+	Expression* primary();
+	CellRefExpr* cell();
 public:
-	explicit Parser(const std::string& input); ///<konstruktor: a megadott stringet tokenlistává alakítja
-	Parser& operator=(const Parser& p); ///<értékadó operátor
-	Parser(const Parser& p) {*this = p;} ///<másoló konstruktor
+	explicit Parser(std::string_view input); ///<konstruktor: a megadott stringet tokenlistává alakítja (a bemenetet nem másolja)
 
 	void addToken(Token_type t); ///<hozzáad a tokenek listájához egy megadott típusú tokent
-	void addToken(const std::string& s);
-		///<hozzáad a tokenek listájához egy STRING típusú adattokent a paraméterként megadott stringgel mint belső adat
+	void addToken(std::string_view s);
+		///<hozzáad a tokenek listájához egy STRING típusú tokent a paraméterként megadott szöveggel (nem másolja)
 	void addToken(double n);
-		///<hozzáad a tokenek listájához egy NUMBER típusú adattokent a paraméterként megadott számmal mint belső adat
-	void addTokenFromStr(std::string& str_buffer);
-		///<megpróbál kiolvasni egy számot a kapott stringből, ha sikeresen, akkor hozzádja NUMBER tokenként, ha nem akkor STRING tokenként
+		///<hozzáad a tokenek listájához egy NUMBER típusú tokent a paraméterként megadott számmal
+	void addTokenFromStr(std::string_view str);
+		///<megpróbál kiolvasni egy számot a kapott szövegből, ha sikeresen, akkor hozzádja NUMBER tokenként, ha nem akkor STRING tokenként
 
 	///kifejezés értelmezése
 	/**
-	megpróbálja értelmezni a kifejezést az elejétől, ha sikertelen, syntax_error kivételt dob
-	@param shptr - ha a kifejezés taralmaz referenciákat, akkor erre a táblára fognak vonatkozni */
-	Expression* parse(Sheet* shptr = nullptr);
+	megpróbálja értelmezni a kifejezést az elejétől, ha sikertelen, syntax_error kivételt dob.
+	A hivatkozások nem kötődnek táblához, a kiértékeléskor aktív környezetben oldódnak fel (ld. EvalContext).*/
+	Expression* parse();
 	/**
-	ha sikeres, akkor az adott tábla adott cellájába berakja a kifejezést
-	@param shptr - ha a kifejezés taralmaz referenciákat, akkor erre a táblára fognak vonatkozni
+	ha sikeres, akkor az adott tábla adott cellájába berakja az egyszerűsített kifejezést, és frissíti a tábla
+	függőségi gráfját (ld. Sheet::update)
+	@param shptr - a cellát tartalmazó tábla, a kifejezés hivatkozásai erre a táblára fognak vonatkozni
 	@param target - az értelmezett kifejezés ebbe a cellába kerül
 	*/
 	void parseTo(Sheet* shptr, ExprPointer& target);
 		///<megpróbálja értelmezni a kifejezést az elejétől, ha sikertelen, syntax_error kivételt dob
 	std::string show(); ///<kiírja a tokenlistáját egy std::stringbe
-
-	~Parser() {
-		for (size_t i = 0; i < tokens.size(); i++) {
-			delete tokens[i];
-		} ///<tokenlista felszabadítása
-	}
 };
 
 #endif
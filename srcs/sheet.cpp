@@ -1,42 +1,79 @@
 #include "sheet.hpp"
+#include "parser.hpp"
 #include "exceptions.hpp"
 
 
 #include <cctype>
+#include <charconv>
 #include <iomanip>
+#include <algorithm>
+#include <utility>
+#include <unordered_map>
+#include <numeric>
 
-Sheet::Sheet(const Sheet& sh): width(sh.width), height(sh.height){
-	table = new ExprPointer[sh.width * sh.height];
-	for (size_t i = 0; i < width*height; i++) {
-		table[i] = sh.table[i];
-		table[i]->relocate(this);
+Sheet::Sheet(const Sheet& sh): arena(new NodeArena), context(new EvalContext(this)), width(sh.width), height(sh.height), deps(sh.deps), cyclic(sh.cyclic), plane(sh.plane){
+	NodeArena::Scope scope(arena);
+	table.assign(sh.table, context);
+	for (DependencyGraph::CellKey key : cyclic) {
+		parseCell(DependencyGraph::keyCol(key), DependencyGraph::keyRow(key))->setCyclic(true);
 	}
 }
 
-Sheet::Sheet(size_t width, size_t height, double fill) : width(width), height(height){
-	table = new ExprPointer[width * height];
-	for (size_t i = 0; i < width*height; i++) {
-		table[i] = new NumberExpr(fill);
-	}
+Sheet::Sheet(size_t width, size_t height, double fill, CellTable::Layout layout) : arena(new NodeArena), context(new EvalContext(this)), width(width), height(height){
+	NodeArena::Scope scope(arena);
+	table.reset(width, height, fill, layout);
+	rebuildPlane();
 }
 
 Sheet& Sheet::operator=(const Sheet& sh){
-	height = sh.height;
-	width = sh.width;
 	if (&sh != this){
-		delete[] table;
-		table = new ExprPointer[sh.width * sh.height];
-		for (size_t i = 0; i < width*height; i++) {
-			table[i] = sh.table[i];
-			table[i]->relocate(this);
+		height = sh.height;
+		width = sh.width;
+		deps = sh.deps;
+		cyclic = sh.cyclic;
+		plane = sh.plane;
+		lookups.clear();
+		//az új tartalom új NodeArena-ba kerül, a régi fák memóriája egyben szabadul fel
+		//(a más táblákkal megosztott fák a régi NodeArena-t addig életben tartják)
+		NodeArena* oldArena = arena;
+		arena = new NodeArena;
+		CellTable old;
+		old.swap(table);
+		{
+			NodeArena::Scope scope(arena);
+			table.assign(sh.table, context);
+		}
+		oldArena->retire();
+		old.clear();
+		for (DependencyGraph::CellKey key : cyclic) {
+			parseCell(DependencyGraph::keyCol(key), DependencyGraph::keyRow(key))->setCyclic(true);
 		}
 	}
 	return *this;
 }
 
+void Sheet::swap(Sheet& sh){
+	if (&sh == this)
+		return;
+	std::swap(arena, sh.arena);
+	std::swap(context, sh.context);
+	context->setSheet(this);
+	sh.context->setSheet(&sh);
+	table.swap(sh.table);
+	std::swap(width, sh.width);
+	std::swap(height, sh.height);
+	std::swap(deps, sh.deps);
+	cyclic.swap(sh.cyclic);
+	std::swap(updateDepth, sh.updateDepth);
+	pendingCycleCheck.swap(sh.pendingCycleCheck);
+	plane.swap(sh.plane);
+	lookups.clear(); //az indexek a táblák tartalmához tartoztak
+	sh.lookups.clear();
+}
+
 ExprPointer* Sheet::parseCell(unsigned int col, unsigned int row) const {
 	if (checkRow(row) && checkCol(col)) {
-		return &(table[(row-1)*width + col -1]); //indexing from 0
+		return &table.at((row-1)*width + col - 1); //indexing from 0
 	}
 	throw eval_error("index out of range");
 }
@@ -47,75 +84,698 @@ ExprPointer* Sheet::parseCell(const std::string& col, unsigned int row) const {
 }
 
 unsigned int Sheet::getYCoord(ExprPointer* cell) const {
-	return (unsigned int)((cell - table) / width);
+	size_t i;
+	if (!table.locate(cell, i))
+		throw eval_error("index out of range");
+	return (unsigned int)(i / width);
 }
 unsigned int Sheet::getXCoord(ExprPointer* cell) const {
-	return (unsigned int)(cell - getYCoord(cell) * width - table);
+	size_t i;
+	if (!table.locate(cell, i))
+		throw eval_error("index out of range");
+	return (unsigned int)(i % width);
 }
 
 void Sheet::copyTo(Sheet& sh) const {
 	size_t minw = sh.width < width ? sh.width : width;
 	size_t minh = sh.height < height ? sh.height : height;
+	NodeArena::Scope scope(sh.arena);
 	for (size_t row = 0; row < minh; row++){
 		for (size_t col = 0; col < minw; col++){
-			sh[row][col] = table[row*width + col];
-			sh[row][col]->relocate(&sh);
+			sh[row][col] = table.at(row*width + col);
+			sh[row][col].bind(sh.context);
 		}
 	}
+	sh.rebuildDependencies();
 }
 
 void Sheet::resize(size_t width, size_t height, double fill){
-	Sheet sh = Sheet(width, height, fill);
-	copyTo(sh);
-	*this = sh;
+	//a megmaradó cellák fáit csak megosztjuk: a hivatkozások továbbra is erre a táblára mutatnak
+	NodeArena::Scope scope(arena);
+	table.resize(width, height, fill);
+	this->width = width;
+	this->height = height;
+	rebuildDependencies();
+}
+
+Sheet::Row Sheet::appendRow(double fill){
+	NodeArena::Scope scope(arena);
+	table.appendRow(fill);
+	height++;
+	if (table.getLayout() == CellTable::DENSE)
+		plane.appendRow();
+	beginUpdate();
+	for (size_t col = 0; col < width; col++) {
+		if (table.isAllocated((height-1)*width + col))
+			update(&table.at((height-1)*width + col));
+		else
+			invalidateDependents(DependencyGraph::key((unsigned int)col + 1, (unsigned int)height));
+	}
+	endUpdate();
+	return Row(this, height-1);
+}
+
+void Sheet::invalidate(){
+	table.forEach([](size_t, ExprPointer& cell){
+		cell.invalidate();
+	});
+	rebuildPlane();
+	lookups.clear();
+}
+
+void Sheet::rebuildPlane(){
+	if (table.getLayout() != CellTable::DENSE) {
+		plane.reset(0, 0);
+		return;
+	}
+	plane.reset(width, height);
+	for (size_t i = 0; i < width*height; i++) {
+		refreshPlane(i);
+	}
+}
+
+double Sheet::rangeSum(const CellRect& r) const {
+	if (!checkCol(r.col1) || !checkCol(r.col2) || !checkRow(r.row1) || !checkRow(r.row2))
+		return ErrorValue::make(ErrorValue::OUT_OF_RANGE);
+	if (table.getLayout() != CellTable::DENSE)
+		return sparseRangeSum(r);
+	double sum = 0;
+	bool hasFormulas;
+	if (plane.indexedSum(r, sum, hasFormulas)) {
+		//az összegtábla csak a konstans cellákat tartalmazza, a képletcellákat külön adjuk hozzá
+		for (unsigned int col = r.col1 - 1; hasFormulas && col < r.col2; col++) {
+			const std::set<unsigned int>& formulas = plane.formulas(col);
+			for (auto it = formulas.lower_bound(r.row1 - 1); it != formulas.end() && *it < r.row2; ++it)
+				sum += table.at(*it*width + col).result();
+		}
+		return sum;
+	}
+	for (unsigned int col = r.col1 - 1; col < r.col2; col++) {
+		const double* values = plane.column(col);
+		const std::set<unsigned int>& formulas = plane.formulas(col);
+		unsigned int row = r.row1 - 1;
+		//a képletcellák közötti konstans szakaszokat egyben összegezzük
+		for (auto it = formulas.lower_bound(row); it != formulas.end() && *it < r.row2; ++it) {
+			sum += ValuePlane::sum(values + row, *it - row);
+			sum += table.at(*it*width + col).result();
+			row = *it + 1;
+		}
+		sum += ValuePlane::sum(values + row, r.row2 - row);
+	}
+	return sum;
+}
+
+double Sheet::sparseRangeSum(const CellRect& r) const {
+	const size_t TILE = CellTable::TILE;
+	double sum = 0;
+	//a tartományt a csempék határai mentén daraboljuk, a nem írt csempék része egyben számolható
+	for (size_t row0 = r.row1 - 1; row0 < r.row2; row0 = (row0 / TILE + 1) * TILE) {
+		size_t row1 = std::min<size_t>(r.row2, (row0 / TILE + 1) * TILE);
+		for (size_t col0 = r.col1 - 1; col0 < r.col2; col0 = (col0 / TILE + 1) * TILE) {
+			size_t col1 = std::min<size_t>(r.col2, (col0 / TILE + 1) * TILE);
+			if (!table.isAllocated(row0*width + col0)) {
+				sum += table.at(row0*width + col0).result() * (double)((row1 - row0) * (col1 - col0));
+				continue;
+			}
+			for (size_t row = row0; row < row1; row++)
+				for (size_t col = col0; col < col1; col++)
+					sum += table.at(row*width + col).result();
+		}
+	}
+	return sum;
+}
+
+Accumulator Sheet::rangeAggregate(const CellRect& r) const {
+	Accumulator acc;
+	if (!checkCol(r.col1) || !checkCol(r.col2) || !checkRow(r.row1) || !checkRow(r.row2)) {
+		acc.failRange(ErrorValue::make(ErrorValue::OUT_OF_RANGE));
+		return acc;
+	}
+	if (aggregates.find(r, acc))
+		return acc;
+	if (table.getLayout() != CellTable::DENSE) {
+		sparseRangeAggregate(r, acc);
+	} else {
+		for (unsigned int col = r.col1 - 1; col < r.col2; col++) {
+			const double* values = plane.column(col);
+			const std::set<unsigned int>& formulas = plane.formulas(col);
+			unsigned int row = r.row1 - 1;
+			for (auto it = formulas.lower_bound(row); it != formulas.end() && *it < r.row2; ++it) {
+				acc.addRun(values + row, *it - row);
+				acc.add(table.at(*it*width + col).result());
+				row = *it + 1;
+			}
+			acc.addRun(values + row, r.row2 - row);
+		}
+	}
+	aggregates.store(r, acc);
+	return acc;
+}
+
+void Sheet::sparseRangeAggregate(const CellRect& r, Accumulator& acc) const {
+	const size_t TILE = CellTable::TILE;
+	for (size_t row0 = r.row1 - 1; row0 < r.row2; row0 = (row0 / TILE + 1) * TILE) {
+		size_t row1 = std::min<size_t>(r.row2, (row0 / TILE + 1) * TILE);
+		for (size_t col0 = r.col1 - 1; col0 < r.col2; col0 = (col0 / TILE + 1) * TILE) {
+			size_t col1 = std::min<size_t>(r.col2, (col0 / TILE + 1) * TILE);
+			if (!table.isAllocated(row0*width + col0)) {
+				acc.addRepeated(table.at(row0*width + col0).result(), (row1 - row0) * (col1 - col0));
+				continue;
+			}
+			for (size_t row = row0; row < row1; row++)
+				for (size_t col = col0; col < col1; col++)
+					acc.add(table.at(row*width + col).result());
+		}
+	}
+}
+
+double Sheet::rangeMatch(const CellRect& r, double key, bool sorted) const {
+	if (ErrorValue::isError(key))
+		return key;
+	if (!checkCol(r.col1) || r.col1 != r.col2 || !checkRow(r.row1) || !checkRow(r.row2))
+		return ErrorValue::make(ErrorValue::OUT_OF_RANGE);
+	std::shared_ptr<const LookupIndex> index;
+	if (r.row2 - r.row1 + 1 >= LookupIndexes::MIN_ROWS)
+		index = lookups.get(r, sorted);
+	long position;
+	if (index) {
+		position = sorted ? index->findBelow(key) : index->find(key);
+	} else {
+		//az értékeket zár nélkül olvassuk ki, a képletcellák kiértékelése maga is kereshet
+		std::vector<double> values(r.row2 - r.row1 + 1);
+		for (unsigned int row = r.row1; row <= r.row2; row++)
+			values[row - r.row1] = table.at((row-1)*width + r.col1 - 1).result();
+		if (values.size() < LookupIndexes::MIN_ROWS) {
+			position = LookupIndex::scan(values, key, sorted);
+		} else {
+			index = std::make_shared<const LookupIndex>(values, sorted);
+			lookups.put(r, sorted, index);
+			position = sorted ? index->findBelow(key) : index->find(key);
+		}
+	}
+	if (position == LookupIndex::NOT_FOUND)
+		return ErrorValue::make(ErrorValue::NOT_FOUND);
+	return (double)(position + 1);
+}
+
+double Sheet::rangeIndex(const CellRect& r, double position) const {
+	if (ErrorValue::isError(position))
+		return position;
+	if (!checkCol(r.col1) || r.col1 != r.col2 || !checkRow(r.row1) || !checkRow(r.row2)
+			|| !(position >= 1 && position <= r.row2 - r.row1 + 1) || position != std::floor(position))
+		return ErrorValue::make(ErrorValue::OUT_OF_RANGE);
+	return table.at((r.row1 - 1 + (size_t)position - 1)*width + r.col1 - 1).result();
+}
+
+void Sheet::rangeSumIf(const CellRect& criteria, const Criterion& c, const CellRect& values, double& sum, double& count) const {
+	if (ErrorValue::isError(c.value)) {
+		sum = count = c.value;
+		return;
+	}
+	if (!checkCol(criteria.col1) || !checkCol(criteria.col2) || !checkRow(criteria.row1) || !checkRow(criteria.row2)
+			|| !checkCol(values.col1) || !checkCol(values.col2) || !checkRow(values.row1) || !checkRow(values.row2)
+			|| criteria.col2 - criteria.col1 != values.col2 - values.col1 || criteria.row2 - criteria.row1 != values.row2 - values.row1) {
+		sum = count = ErrorValue::make(ErrorValue::OUT_OF_RANGE);
+		return;
+	}
+	sum = 0;
+	size_t matched = 0;
+	if (table.getLayout() != CellTable::DENSE) {
+		sparseRangeSumIf(criteria, c, values, sum, matched);
+		count = (double)matched;
+		return;
+	}
+	long shift = (long)values.row1 - (long)criteria.row1;
+	for (unsigned int col = criteria.col1 - 1; col < criteria.col2; col++) {
+		unsigned int valueCol = values.col1 - criteria.col1 + col;
+		//a két oszlop képletcellái közötti konstans szakaszokat a zónatérkép alapján dolgozzuk fel
+		const std::set<unsigned int>& formulas = plane.formulas(col);
+		const std::set<unsigned int>& valueFormulas = plane.formulas(valueCol);
+		auto it = formulas.lower_bound(criteria.row1 - 1);
+		auto vit = valueFormulas.lower_bound(values.row1 - 1);
+		unsigned int row = criteria.row1 - 1;
+		for (;;) {
+			unsigned int next = criteria.row2; //a következő, valamelyik oszlopban képletcellát tartalmazó sor
+			if (it != formulas.end() && *it < next)
+				next = *it;
+			if (vit != valueFormulas.end() && (unsigned int)((long)*vit - shift) < next)
+				next = (unsigned int)((long)*vit - shift);
+			plane.conditionalSum(col, valueCol, shift, row, next, c, sum, matched);
+			if (next == criteria.row2)
+				break;
+			if (c.matches(table.at(next*width + col).result())) {
+				sum += table.at((size_t)((long)next + shift)*width + valueCol).result();
+				matched++;
+			}
+			if (it != formulas.end() && *it == next)
+				++it;
+			if (vit != valueFormulas.end() && (long)*vit - shift == (long)next)
+				++vit;
+			row = next + 1;
+		}
+	}
+	count = (double)matched;
+}
+
+void Sheet::sparseRangeSumIf(const CellRect& criteria, const Criterion& c, const CellRect& values, double& sum, size_t& count) const {
+	const size_t TILE = CellTable::TILE;
+	size_t dx = (size_t)values.col1 - criteria.col1, dy = (size_t)values.row1 - criteria.row1; //előjel nélküli túlcsordulással negatív is lehet
+	for (size_t row0 = criteria.row1 - 1; row0 < criteria.row2; row0 = (row0 / TILE + 1) * TILE) {
+		size_t row1 = std::min<size_t>(criteria.row2, (row0 / TILE + 1) * TILE);
+		for (size_t col0 = criteria.col1 - 1; col0 < criteria.col2; col0 = (col0 / TILE + 1) * TILE) {
+			size_t col1 = std::min<size_t>(criteria.col2, (col0 / TILE + 1) * TILE);
+			//a nem írt csempe minden cellája a kitöltő értéket tartalmazza: vagy mind teljesíti a feltételt, vagy egyik sem
+			bool whole = !table.isAllocated(row0*width + col0);
+			if (whole && !c.matches(table.at(row0*width + col0).result()))
+				continue;
+			for (size_t row = row0; row < row1; row++) {
+				for (size_t col = col0; col < col1; col++) {
+					if (whole || c.matches(table.at(row*width + col).result())) {
+						sum += table.at((row + dy)*width + col + dx).result();
+						count++;
+					}
+				}
+			}
+		}
+	}
+}
+
+void Sheet::invalidate(ExprPointer* cell){
+	cell->invalidate();
+	DependencyGraph::CellKey key = cellKey(cell);
+	lookups.invalidate(DependencyGraph::keyCol(key), DependencyGraph::keyRow(key));
+	invalidateDependents(key);
 }
 
-void Sheet::formattedPrint(std::ostream& os) const {
+void Sheet::invalidateDependents(DependencyGraph::CellKey key){
+	std::vector<DependencyGraph::CellKey> stack = {key};
+	std::vector<DependencyGraph::CellKey> dependents;
+	while (!stack.empty()) {
+		DependencyGraph::CellKey key = stack.back();
+		stack.pop_back();
+		dependents.clear();
+		deps.getDependents(key, dependents);
+		for (DependencyGraph::CellKey dep : dependents) {
+			ExprPointer* depCell = parseCell(DependencyGraph::keyCol(dep), DependencyGraph::keyRow(dep));
+			ExprPointer::CacheState state = depCell->getState();
+			if (state == ExprPointer::VALID || state == ExprPointer::FAILED) {
+				depCell->invalidate();
+				lookups.invalidate(DependencyGraph::keyCol(dep), DependencyGraph::keyRow(dep));
+				stack.push_back(dep);
+			}
+		}
+	}
+}
+
+void Sheet::update(ExprPointer* cell){
+	size_t i;
+	if (!table.locate(cell, i))
+		return;
+	DependencyGraph::CellKey key = cellKey(cell);
+	cell->bind(context);
+	cell->place(DependencyGraph::keyCol(key), DependencyGraph::keyRow(key));
+	std::vector<CellRect> refs;
+	if (!cell->isNumber())
+		(*cell)->collectRefs(refs);
+	deps.setPrecedents(key, refs);
+	refreshPlane(i);
+	invalidate(cell);
+	//új kör csak hivatkozást tartalmazó cellán keresztül jöhet létre, régi kör pedig csak körkörös cellán keresztül szűnhet meg
+	if (!refs.empty() || cyclic.count(key)) {
+		if (updateDepth > 0)
+			pendingCycleCheck.push_back(key);
+		else
+			markCycles({key});
+	}
+}
+
+void Sheet::endUpdate(){
+	if (updateDepth > 0 && --updateDepth == 0) {
+		std::vector<DependencyGraph::CellKey> roots;
+		roots.swap(pendingCycleCheck);
+		markCycles(roots);
+	}
+}
+
+void Sheet::markCycles(const std::vector<DependencyGraph::CellKey>& roots){
+	std::vector<DependencyGraph::CellKey> visited, found;
+	deps.findCycles(roots, visited, found);
+	//a bejárt cellákon kívül eső körök nem változhattak, a bejártak jelölését újraszámoljuk
+	std::vector<ExprPointer*> changed;
+	for (DependencyGraph::CellKey key : visited) {
+		if (cyclic.erase(key)) {
+			ExprPointer* cell = parseCell(DependencyGraph::keyCol(key), DependencyGraph::keyRow(key));
+			cell->setCyclic(false);
+			changed.push_back(cell);
+		}
+	}
+	for (DependencyGraph::CellKey key : found) {
+		ExprPointer* cell = parseCell(DependencyGraph::keyCol(key), DependencyGraph::keyRow(key));
+		cyclic.insert(key);
+		cell->setCyclic(true);
+		changed.push_back(cell);
+	}
+	for (ExprPointer* cell : changed) {
+		invalidate(cell);
+	}
+}
+
+void Sheet::rebuildDependencies(){
+	deps.clear();
+	lookups.clear();
+	std::vector<CellRect> refs;
+	table.forEach([&](size_t i, ExprPointer& cell){
+		if (cell.isNumber())
+			return;
+		cell.bind(context);
+		cell.place((unsigned int)(i % width) + 1, (unsigned int)(i / width) + 1);
+		refs.clear();
+		cell->collectRefs(refs);
+		if (!refs.empty())
+			deps.setPrecedents(DependencyGraph::key((unsigned int)(i % width) + 1, (unsigned int)(i / width) + 1), refs);
+	});
+	for (DependencyGraph::CellKey key : cyclic) {
+		if (checkCol(DependencyGraph::keyCol(key)) && checkRow(DependencyGraph::keyRow(key)))
+			parseCell(DependencyGraph::keyCol(key), DependencyGraph::keyRow(key))->setCyclic(false);
+	}
+	cyclic.clear();
+	markCycles(deps.cells());
+	rebuildPlane();
+}
+
+std::vector<std::vector<size_t>> Sheet::evaluationLevels() const {
+	const long UNVISITED = -1, IN_PROGRESS = -2, UNRESOLVED = -3;
+	//oszloponként az elavult képletcellák sorai (0-tól indexelve), hogy a tartományokban gyorsan megtaláljuk őket
+	std::vector<std::vector<unsigned int>> dirtyRows(width);
+	table.forEach([&](size_t i, ExprPointer& cell){
+		if (cell.getState() == ExprPointer::DIRTY)
+			dirtyRows[i % width].push_back((unsigned int)(i / width));
+	});
+	//ritka elrendezésben csempénként járunk, a sorokat oszloponként rendezni kell
+	if (table.getLayout() != CellTable::DENSE) {
+		for (std::vector<unsigned int>& rows : dirtyRows)
+			std::sort(rows.begin(), rows.end());
+	}
+	//a cellák által hivatkozott elavult képletcellák
+	auto children = [&](size_t cell, std::vector<size_t>& out){
+		out.clear();
+		const std::vector<CellRect>* refs = deps.getPrecedents(DependencyGraph::key(
+				(unsigned int)(cell % width) + 1, (unsigned int)(cell / width) + 1));
+		if (refs == nullptr)
+			return;
+		for (const CellRect& r : *refs) {
+			for (unsigned int col = std::max(r.col1, 1u); col <= r.col2 && col <= width; col++) {
+				const std::vector<unsigned int>& rows = dirtyRows[col-1];
+				auto it = std::lower_bound(rows.begin(), rows.end(), std::max(r.row1, 1u) - 1);
+				for (; it != rows.end() && *it < r.row2; ++it) {
+					out.push_back(*it * width + col - 1);
+				}
+			}
+		}
+	};
+	//mélységi bejárás saját veremmel, hogy hosszú hivatkozási láncoknál se teljen be a hívási verem
+	struct Frame {
+		size_t cell;
+		std::vector<size_t> children;
+		size_t next;
+		long level;
+	};
+	//sűrű elrendezésben cellánként egy tömbelem, ritkában csak a bejárt cellák egy hasítótáblában
+	std::vector<long> denseLevel(table.getLayout() == CellTable::DENSE ? width*height : 0, UNVISITED);
+	std::unordered_map<size_t, long> sparseLevel;
+	auto level = [&](size_t cell) -> long& {
+		if (table.getLayout() == CellTable::DENSE)
+			return denseLevel[cell];
+		return sparseLevel.try_emplace(cell, UNVISITED).first->second;
+	};
+	std::vector<Frame> stack;
+	std::vector<std::vector<size_t>> levels;
+	for (size_t col = 0; col < width; col++) {
+		for (unsigned int row : dirtyRows[col]) {
+			size_t start = row*width + col;
+			if (level(start) != UNVISITED)
+				continue;
+			stack.push_back({start, {}, 0, 0});
+			children(start, stack.back().children);
+			level(start) = IN_PROGRESS;
+			while (!stack.empty()) {
+				Frame& f = stack.back();
+				if (f.level != UNRESOLVED && f.next < f.children.size()) {
+					size_t child = f.children[f.next++];
+					if (level(child) == UNVISITED) {
+						level(child) = IN_PROGRESS;
+						stack.push_back({child, {}, 0, 0});
+						children(child, stack.back().children);
+					} else if (level(child) == IN_PROGRESS || level(child) == UNRESOLVED) {
+						f.level = UNRESOLVED;
+					} else {
+						f.level = std::max(f.level, level(child) + 1);
+					}
+					continue;
+				}
+				long done = f.level;
+				size_t cell = f.cell;
+				level(cell) = done;
+				stack.pop_back();
+				if (done != UNRESOLVED) {
+					if (levels.size() <= (size_t)done)
+						levels.resize((size_t)done + 1);
+					levels[(size_t)done].push_back(cell);
+				}
+				if (!stack.empty()) {
+					Frame& parent = stack.back();
+					parent.level = done == UNRESOLVED ? UNRESOLVED : std::max(parent.level, done + 1);
+				}
+			}
+		}
+	}
+	return levels;
+}
+
+void Sheet::recalculate(ThreadPool& pool) const {
+	//a szám cellák mindig érvényesek, csak az elavult képleteket kell szintenként kiszámolni
+	aggregates.begin();
+	for (const std::vector<size_t>& level : evaluationLevels()) {
+		pool.parallelFor(level.size(), [this, &level](size_t begin, size_t end){
+			for (size_t i = begin; i < end; i++)
+				table.at(level[i]).result(); //a hibaértéket is a cella tárolja
+		});
+	}
+	aggregates.end();
+}
+
+void Sheet::appendNumber(std::string& out, double value){
+	char buf[32];
+	out.append(buf, std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::general, 6).ptr);
+}
+
+void Sheet::printValue(std::ostream& os, double value){
+	std::string text;
+	appendValue(text, value);
+	os << text;
+}
+
+void Sheet::appendValue(std::string& out, double value){
+	if (ErrorValue::isError(value)) {
+		out += "#ERR";
+		return;
+	}
+	appendNumber(out, value);
+}
+
+void Sheet::writeRows(std::ostream& os, const std::function<void(std::string&, unsigned int)>& formatRow, ThreadPool& pool) const {
+	//egy blokk kb. 64 kB szöveg, egyszerre szálanként néhány blokk készül el, a pufferek körről körre újrahasznosulnak
+	const size_t rowsPerBlock = std::max<size_t>(1, 64 * 1024 / (width * 8 + 8));
+	const size_t blocks = (height + rowsPerBlock - 1) / rowsPerBlock;
+	const size_t wave = pool.size() * 4;
+	std::vector<std::string> buffers(std::min(wave, blocks));
+	for (size_t first = 0; first < blocks; first += wave) {
+		size_t count = std::min(wave, blocks - first);
+		pool.parallelFor(count, [&](size_t begin, size_t end){
+			for (size_t b = begin; b < end; b++) {
+				buffers[b].clear();
+				size_t lastRow = std::min<size_t>(height, (first + b + 1) * rowsPerBlock);
+				for (size_t row = (first + b) * rowsPerBlock; row < lastRow; row++)
+					formatRow(buffers[b], (unsigned int)row);
+			}
+		});
+		for (size_t b = 0; b < count; b++)
+			os.write(buffers[b].data(), (std::streamsize)buffers[b].size());
+	}
+}
+
+void Sheet::formattedPrint(std::ostream& os, ThreadPool& pool) const {
 	if (height == 0 || width == 0) {
 		os << "Sheet doesn't exists" << std::endl;
 		return;
 	}
-	os << std::setw((int)std::log10(height)+2) << std::setfill(' ') << ' ';
+	recalculate(pool);
+	const size_t digits = (size_t)std::log10(height) + 1; //a sorszámok szélessége
+	std::string header(digits + 1, ' ');
 	for (unsigned int col = 0; col < width; col++) {
-		os << colLetter(col+1) << "\t";
+		header += colLetter(col+1);
+		header += '\t';
 	}
-	os << std::endl;
-	for (unsigned int row = 0; row < height; row++) {
-		os << std::setw((int)std::log10(height)+1) << row+1 << "|";
+	header += '\n';
+	os.write(header.data(), (std::streamsize)header.size());
+	writeRows(os, [this, digits](std::string& out, unsigned int row){
+		char num[16];
+		char* numEnd = std::to_chars(num, num + sizeof(num), row+1).ptr;
+		size_t length = (size_t)(numEnd - num);
+		if (length < digits)
+			out.append(digits - length, ' ');
+		out.append(num, numEnd);
+		out += '|';
 		for (unsigned int col = 0; col < width; col++) {
-			try {
-				os << table[row*width + col].evalMe() << "\t";
-			} catch (const eval_error&){
-				os << "#ERR" << "\t";
-			}
+			appendValue(out, table.at(row*width + col).result());
+			out += '\t';
 		}
-		os << std::endl;
-	}
+		out += '\n';
+	}, pool);
+	os.flush();
 }
 
-void Sheet::printValues(std::ostream& os) const {
-	for (unsigned int row = 0; row < height; row++) {
+void Sheet::printValues(std::ostream& os, ThreadPool& pool) const {
+	recalculate(pool);
+	//a kiszámolt cellák olvasása már nem módosít semmit, így a sorok párhuzamosan formázhatók
+	writeRows(os, [this](std::string& out, unsigned int row){
 		for (unsigned int col = 0; col < width; col++) {
-			try {
-				os << table[row*width + col].evalMe() << ",";
-			} catch (const char* msg){
-				os << "#ERR" << ",";
-			}
+			appendValue(out, table.at(row*width + col).result());
+			out += ',';
 		}
-		os << std::endl;
-	}
+		out += '\n';
+	}, pool);
+	os.flush();
 }
 
 void Sheet::printExpr(std::ostream& os) const {
+	//a képletek megjelenítése a megosztott fát is felépítheti (ld. ExprPointer::tree), ezért soronként, egy szálon írunk
+	std::string line;
 	for (unsigned int row = 0; row < height; row++) {
+		line.clear();
 		for (unsigned int col = 0; col < width; col++) {
-			os << table[row*width + col]->show() << ",";
+			const ExprPointer& cell = table.at(row*width + col);
+			if (cell.isNumber())
+				appendNumber(line, cell.getNumber());
+			else
+				line += cell->show();
+			line += ',';
+		}
+		line += '\n';
+		os.write(line.data(), (std::streamsize)line.size());
+	}
+	os.flush();
+}
+
+Sheet Sheet::fromCsv(std::string_view text, ThreadPool& pool) {
+	//sorhatárok: a szöveg részeiben párhuzamosan megszámoljuk, majd felírjuk a sorvégeket
+	const size_t parts = pool.size() * 4;
+	auto partBegin = [&](size_t p){return text.begin() + (std::ptrdiff_t)(text.size() * p / parts);};
+	std::vector<size_t> linesBefore(parts + 1, 0);
+	pool.parallelFor(parts, [&](size_t begin, size_t end){
+		for (size_t p = begin; p < end; p++)
+			linesBefore[p + 1] = (size_t)std::count(partBegin(p), partBegin(p + 1), '\n');
+	});
+	std::partial_sum(linesBefore.begin(), linesBefore.end(), linesBefore.begin());
+	size_t height = linesBefore[parts] + (!text.empty() && text.back() != '\n');
+	std::vector<size_t> lineStart(height + 1, 0); //az r. sor a lineStart[r+1]-1. bájt előtt ér véget
+	lineStart[height] = text.size() + 1;
+	pool.parallelFor(parts, [&](size_t begin, size_t end){
+		for (size_t p = begin; p < end; p++) {
+			size_t line = linesBefore[p];
+			for (auto it = partBegin(p); it != partBegin(p + 1); ++it) {
+				if (*it == '\n')
+					lineStart[++line] = (size_t)(it - text.begin()) + 1;
+			}
+		}
+	});
+	auto line = [&](size_t row){
+		std::string_view l = text.substr(lineStart[row], lineStart[row + 1] - 1 - lineStart[row]);
+		if (!l.empty() && l.back() == '\r')
+			l.remove_suffix(1);
+		return l;
+	};
+	//a záró vessző utáni üres mezőt nem számoljuk
+	size_t width = 0;
+	if (height > 0 && !line(0).empty())
+		width = (size_t)std::count(line(0).begin(), line(0).end(), ',') + (line(0).back() != ',');
+
+	Sheet sh(width, height, 0);
+	//soronként egybefüggő részek, mindegyik saját NodeArena-val és a benne talált képletekkel
+	struct Block {
+		size_t firstRow; ///<a rész első sora (0-tól indexelve)
+		size_t lastRow; ///<a rész utolsó utáni sora
+		NodeArena* arena = new NodeArena; ///<a részben elemzett fák csomópontjai
+		std::unordered_map<std::string, const ExprPointer*> formulas; ///<a részben talált képletek cellától független alakjuk szerint
+		std::unordered_map<const Expression*, const ExprPointer*> redirect; ///<a más részben is előforduló képletek fája helyett használandó cella
+	};
+	std::vector<Block> blocks(std::min(parts, height));
+	for (size_t b = 0; b < blocks.size(); b++) {
+		blocks[b].firstRow = height * b / blocks.size();
+		blocks[b].lastRow = height * (b + 1) / blocks.size();
+	}
+	pool.parallelFor(blocks.size(), [&](size_t begin, size_t end){
+		for (size_t b = begin; b < end; b++) {
+			Block& block = blocks[b];
+			NodeArena::Scope scope(block.arena);
+			for (size_t row = block.firstRow; row < block.lastRow; row++) {
+				std::string_view l = line(row);
+				for (size_t col = 0, pos = 0; pos < l.size() && col < width; col++) {
+					size_t comma = std::min(l.find(',', pos), l.size());
+					std::string_view word = l.substr(pos, comma - pos);
+					pos = comma + 1;
+					if (word.empty())
+						continue;
+					try {
+						ExprPointer& cell = sh.table.write(row*width + col);
+						cell = Parser(word).parse()->optimize();
+						if (cell.isNumber())
+							continue;
+						cell.bind(sh.context);
+						cell.place((unsigned int)col + 1, (unsigned int)row + 1);
+						auto found = block.formulas.emplace(cell.canonical(), &cell);
+						if (!found.second)
+							cell.shareBody(*found.first->second);
+					}
+					catch (const syntax_error& err) {}
+					catch (const eval_error& err) {}
+				}
+			}
+		}
+	});
+	//a részek képleteinek összefésülése: minden képletnek az első előfordulása marad meg
+	std::unordered_map<std::string_view, const ExprPointer*> formulas;
+	for (Block& block : blocks) {
+		for (const auto& f : block.formulas) {
+			auto found = formulas.emplace(f.first, f.second);
+			if (!found.second)
+				block.redirect.emplace((const Expression*)*f.second, found.first->second);
+		}
+	}
+	pool.parallelFor(blocks.size(), [&](size_t begin, size_t end){
+		for (size_t b = begin; b < end; b++) {
+			const Block& block = blocks[b];
+			if (block.redirect.empty())
+				continue;
+			for (size_t i = block.firstRow * width; i < block.lastRow * width; i++) {
+				ExprPointer& cell = sh.table.at(i);
+				if (cell.isNumber())
+					continue;
+				auto it = block.redirect.find((const Expression*)cell);
+				if (it != block.redirect.end())
+					cell.shareBody(*it->second); //az elengedett fa a rész saját NodeArena-jába kerül vissza
+			}
 		}
-		os << std::endl;
+	});
+	for (Block& block : blocks) {
+		sh.arena->merge(*block.arena);
+		delete block.arena;
 	}
+	sh.rebuildDependencies();
+	return sh;
 }
 
-unsigned int Sheet::colNumber(const std::string& str) {
+unsigned int Sheet::colNumber(std::string_view str) {
 	unsigned int col = 0;
 	for (char c : str) {
 		if (!std::isalpha(c))
@@ -128,7 +788,8 @@ unsigned int Sheet::colNumber(const std::string& str) {
 std::string Sheet::colLetter(unsigned int n) {
 	std::string col = "";
 	while (n > 0){
-		col.insert(0, 1, (char)(n%26 + 'a' - 1));
+		n--;
+		col.insert(0, 1, (char)(n%26 + 'a'));
 		n = n/26;
 	}
 	return col;
@@ -2,38 +2,124 @@
 #define SHEET_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <functional>
+#include <unordered_set>
+#include <stdexcept>
 #include <math.h>
 
 #include "expressions/expression_core.hpp"
+#include "dependency.hpp"
+#include "threadpool.hpp"
+#include "valueplane.hpp"
+#include "accumulator.hpp"
+#include "lookupindex.hpp"
+#include "arena.hpp"
+#include "celltable.hpp"
+#include "evalcontext.hpp"
 
 ///Számolótáblát reprezentáló osztály
 /**
-A Sheet osztály egy N×M méretű dinamikus memóriaterületen sorfolytonosan tárolja el az adott
-cellában lévő kifejezés értékét az ExprPointer osztály pédényaiként.
+A Sheet osztály egy N×M méretű táblában (CellTable) tárolja el az adott cellában lévő
+kifejezés értékét az ExprPointer osztály pédényaiként: alapesetben sorfolytonosan, nagy,
+többnyire üres táblánál csempékre osztva, ahol csak az írt csempék foglalnak memóriát. A cellák közötti
+hivatkozásokat egy függőségi gráfban (DependencyGraph) tartja nyilván, így egy cella
+módosítása után csak a tőle (közvetve vagy közvetlenül) függő cellákat kell újraszámolni.
+A körkörös hivatkozásokat is a módosításkor deríti fel, az érintett cellákat megjelöli,
+így kiértékeléskor már nem kell őket keresni. A konstans cellák értékét egy oszlopfolytonos
+tömbben (ValuePlane) is tárolja, ebből a tartományok összegét vektorizáltan számolja.
+A cellák kifejezésfái a tábla saját NodeArena-jából foglalnak, amelyet a tábla megszűnésekor
+vagy felülírásakor egyben szabadít fel. A fák hivatkozásai nem tárolják a táblát, a képletcellák
+a tábla kiértékelési környezetéhez (EvalContext) kötődnek, így a tábla másolásakor a fákat
+csak megosztjuk, mozgatásakor pedig egyáltalán nem kell hozzájuk nyúlni.
 */
 class Sheet {
-	ExprPointer* table; ///<a táblázat tartalma sorfolytonosan
+	friend class Snapshot;
+	friend class SheetImage;
+	NodeArena* arena; ///<a cellák kifejezésfáinak csomópontjait tároló memóriaterület
+	EvalContext* context; ///<a tábla kiértékelési környezete, a képletcellák erre mutatnak (a címe a tábla mozgatásakor sem változik)
+	CellTable table; ///<a táblázat cellái
 	size_t width; ///<tábla szélessége
 	size_t height; ///<tábla magassága
+	DependencyGraph deps; ///<a cellák közötti hivatkozások gráfja
+	std::unordered_set<DependencyGraph::CellKey> cyclic; ///<a körkörös hivatkozásban részt vevő cellák
+	unsigned int updateDepth = 0; ///<a beginUpdate hívások száma, amelyekhez még nem tartozott endUpdate
+	std::vector<DependencyGraph::CellKey> pendingCycleCheck; ///<a beginUpdate óta módosított, még ellenőrizendő cellák
+	ValuePlane plane; ///<a konstans cellák értéke oszlopfolytonosan (ritka elrendezésben üres)
+	mutable AggregateCache aggregates; ///<az újraszámolás alatt a nagy tartományok összesítései (a táblával nem másolódik)
+	mutable LookupIndexes lookups; ///<a keresések oszloptartományonként lustán épített indexei (a táblával nem másolódik)
+
+	void refreshPlane(size_t i) {
+		if (table.getLayout() != CellTable::DENSE)
+			return;
+		if (table.at(i).isNumber())
+			plane.setNumber((unsigned int)(i % width), (unsigned int)(i / width), table.at(i).getNumber());
+		else
+			plane.setFormula((unsigned int)(i % width), (unsigned int)(i / width));
+	} ///<adott sorfolytonos indexű cella bejegyzésének frissítése az oszlopfolytonos tömbben
+	void rebuildPlane(); ///<az oszlopfolytonos tömb újraépítése a cellák tartalmából
+	double sparseRangeSum(const CellRect& r) const; ///<tartomány összege ritka elrendezésben (a nem írt csempék egyben)
+	void sparseRangeAggregate(const CellRect& r, Accumulator& acc) const; ///<tartomány összesítése ritka elrendezésben (a nem írt csempék egyben)
+	///feltételes összesítés ritka elrendezésben (a feltételt nem teljesítő nem írt csempéket átugorja)
+	void sparseRangeSumIf(const CellRect& criteria, const Criterion& c, const CellRect& values, double& sum, size_t& count) const;
+	void invalidateDependents(DependencyGraph::CellKey key); ///<a cellától közvetve vagy közvetlenül függő cellák érvénytelenítése
+	static void printValue(std::ostream& os, double value); ///<egy cella értékének kiírása (hibaérték esetén "#ERR")
+	static void appendNumber(std::string& out, double value); ///<szám szöveggé alakítása a puffer végére, az ostream alapértelmezett (6 értékes jegyes) formátumában
+	///egy cella értékének szöveggé alakítása a puffer végére (ld. printValue), az ostream alapértelmezett formátumában
+	static void appendValue(std::string& out, double value);
+	///a tábla sorait blokkonként, a szálkészleten párhuzamosan szöveggé alakítja, és a blokkokat sorrendben, egyben írja ki
+	/**@param formatRow - adott sort (0-tól indexelve) a puffer végére fűző függvény, több szálról is hívódhat*/
+	void writeRows(std::ostream& os, const std::function<void(std::string&, unsigned int)>& formatRow, ThreadPool& pool) const;
+
+	///a megadott cellákból kiindulva felderíti a körkörös hivatkozásokat, és frissíti a cellák jelölését
+	void markCycles(const std::vector<DependencyGraph::CellKey>& roots);
 public:
-	explicit Sheet() : table(nullptr), width(0), height(0) {} ///<konstruktor
+	///a tábla egy sora, az oszlop szerinti indexelés írásra adja vissza a cellát
+	class Row {
+		Sheet* sheet; ///<a tábla
+		size_t row; ///<a sor indexe (0-tól)
+	public:
+		Row(Sheet* sheet, size_t row) : sheet(sheet), row(row) {} ///<konstruktor
+		///adott oszlopú cella írásra (ritka elrendezésben szükség esetén lefoglalja a csempét)
+		ExprPointer& operator[](size_t col) const {
+			if (col < sheet->width)
+				return sheet->table.write(row*sheet->width + col);
+			throw std::out_of_range("");
+		}
+	};
+	explicit Sheet() : arena(new NodeArena), context(new EvalContext(this)), width(0), height(0) {} ///<konstruktor
 	Sheet(const Sheet&); ///<másoló konstruktor
+	Sheet(Sheet&& sh) : Sheet() {swap(sh);} ///<mozgató konstruktor, a cellákhoz nem nyúl (ld. swap)
 	///konstruktor adott számmal inicializálással
 	/**
 	@param width - létrehozandó tábla szélessége
 	@param height - létrehozandó tábla magassága
 	@param fill - a létrejövő tábla minden celláját ezzel a számmal inicializálja
+	@param layout - a cellák elrendezése (ritka elrendezésben a csak fill értéket tartalmazó területek nem foglalnak memóriát)
 	*/
-	explicit Sheet(size_t width, size_t height, double fill = 0);
+	explicit Sheet(size_t width, size_t height, double fill = 0, CellTable::Layout layout = CellTable::DENSE);
+	CellTable::Layout getLayout() const {return table.getLayout();} ///<a cellák elrendezésének lekérdezése
 	size_t getWidth() const {return width;} ///<tábla szélességének lekérdezése
 	size_t getHeight() const {return height;}  ///<tábla magasságának lekérdezése
 	Sheet& operator=(const Sheet&); ///<értékadó operátor
-	ExprPointer* operator[](size_t i) {
+	Sheet& operator=(Sheet&& sh) {swap(sh); return *this;} ///<mozgató értékadás, a régi tartalom a másik táblával szűnik meg
+	///két tábla tartalmának cseréje konstans időben
+	/**A két tábla a kiértékelési környezetét is cseréli, így a cellákhoz nem kell nyúlni, a
+	tárolt értékek is megmaradnak.*/
+	void swap(Sheet& sh);
+	Row operator[](size_t i) {
 		if (i < height)
-			return table + i*width;
+			return Row(this, i);
 		throw std::out_of_range("");
-	} ///<adott sor lekérdezése 0-tól indexelve
+	} ///<adott sor lekérdezése 0-tól indexelve (a cellákat írásra adja, olvasáshoz ld. parseCell)
+	///tábla adott cellájának értéke oszlopszám és sorszám alapján (1-től indexelve), a hivatkozások kiértékelése ezt használja
+	/**Ha a cella kilóg a táblából, az OUT_OF_RANGE hibaértéket adja (ld. ErrorValue).*/
+	double cellValue(unsigned int col, unsigned int row) const {
+		if (checkRow(row) && checkCol(col))
+			return table.at((row-1)*width + col - 1).result();
+		return ErrorValue::make(ErrorValue::OUT_OF_RANGE);
+	}
 	ExprPointer* parseCell(unsigned int col, unsigned int row) const;
 		///<tábla adott cellájára mutató pointer visszaadása oszlopszám és sorszám alapján
 	ExprPointer* parseCell(const std::string& col, unsigned int row) const;
@@ -59,17 +145,123 @@ public:
 	akkor a fill paraméterben megadott számmal tölti ki az újonnan keletkező részt
 	*/
 	void resize(size_t width, size_t height, double fill = 0); ///<átméretezi a táblát
+	///új sor hozzáfűzése a tábla aljára
+	/**A sorok számára tartalékot tart: ha elfogy, kétszeres kapacitással foglalja újra a
+	táblát (a cellák fáit és tárolt értékét átmozgatja), így a hozzáfűzés amortizáltan konstans
+	idejű. Az új sor celláit a fill értékkel tölti ki, és érvényteleníti az új cellákra
+	hivatkozó (pl. korábban a táblából kilógó) cellákat.
+	@return - az új sor*/
+	Row appendRow(double fill = 0);
+	///a képleteket tartalmazó cellák tárolt értékét elavulttá teszi
+	/**A konstans cellák értéke nem függ más cellától, ezért azok tárolt értéke megmarad, az
+	oszlopfolytonos tömböt viszont újraépíti. Akkor van rá szükség, ha a cellákat nem az update
+	tagfüggvényen keresztül módosítottuk.*/
+	void invalidate();
+	///adott cella és a tőle közvetve vagy közvetlenül függő cellák tárolt értékét elavulttá teszi
+	/**Ha egy függő cella már elavult, azon túl nem halad tovább: egy cella csak akkor lehet
+	érvényes, ha az összes általa hivatkozott cella is az.*/
+	void invalidate(ExprPointer* cell);
+	///egy cella módosítása után frissíti a függőségi gráfot és érvényteleníti a tőle függő cellákat
+	/**A cella kifejezésének megváltoztatása (pl. Parser::parseTo) után kell meghívni. Ha a
+	cella hivatkozásai körkörös hivatkozást hoznak létre (vagy szüntetnek meg), a körben
+	részt vevő cellák jelölését is frissíti. Ehhez csak a cellától függő cellákat kell bejárni.
+	A képlet origóját a cella helyére teszi (ld. ExprPointer::place).*/
+	void update(ExprPointer* cell);
+	///sok cella módosítása előtt hívandó: a körkörös hivatkozások keresését endUpdate-ig elhalasztja
+	void beginUpdate() {updateDepth++;}
+	///a beginUpdate óta módosított cellákból kiindulva egyetlen bejárással felderíti a körkörös hivatkozásokat
+	void endUpdate();
+	void rebuildDependencies(); ///<a függőségi gráfot és a körkörös hivatkozások jelölését a cellák tartalmából újraépíti (a képleteket a tábla környezetéhez és a cellájuk helyéhez köti)
+	bool isCyclic(ExprPointer* cell) const {return cyclic.count(cellKey(cell)) > 0;}
+		///<körkörös hivatkozásban vesz-e részt a cella
+	///az elavult cellákat kiértékelési szintekre bontja
+	/**Egy cella szintje eggyel nagyobb, mint az általa hivatkozott elavult képletcellák
+	szintjének maximuma, így egy szint cellái egymástól függetlenek, és csak a korábbi
+	szintektől függenek. A körkörös hivatkozásban részt vevő (vagy attól függő) cellák
+	egyik szintbe sem kerülnek, ezeket a soros kiértékelés kezeli (hibaként).
+	@return - szintenként a cellák sorfolytonos indexei
+	*/
+	std::vector<std::vector<size_t>> evaluationLevels() const;
+	///az összes elavult cellát újraszámolja, szintenként párhuzamosan
+	/**Az eredmény a cellák tárolt értékébe kerül, amelyet a kiíró függvények olvasnak.
+	Egy cella értékét mindig ugyanúgy számoljuk, mint a soros kiértékeléskor, így az
+	eredmény független a szálak számától.*/
+	void recalculate(ThreadPool& pool = ThreadPool::shared()) const;
+	///adott tartomány celláinak összege
+	/**Oszloponként a konstans cellák összefüggő szakaszait a ValuePlane vektorizált ciklusa
+	összegzi, csak a képletcellákat értékeli ki egyenként. Ha a tartomány egy összegtáblával
+	ellátott régióba esik (ld. setSumIndex), a konstans cellák összegét abból olvassa ki. Kivételt
+	nem dob: ha a tartomány kilóg a táblából, az OUT_OF_RANGE hibaértéket adja, a hibás cellák
+	hibaértéke pedig az összegen keresztül terjed (ld. ErrorValue).*/
+	double rangeSum(const CellRect& rect) const;
+	///adott tartomány celláinak összesítése (min, max, count, product, var, stddev, ld. Accumulator)
+	/**A rangeSum-hoz hasonlóan a konstans szakaszokat vektorizáltan, a képletcellákat egyenként
+	veszi hozzá, a tartományt egyszer járja be. Újraszámolás alatt a nagy tartományok összesítését
+	megjegyzi, így az ugyanarra a tartományra hivatkozó többi cella nem járja be újra (ld.
+	AggregateCache). Kivételt nem dob: ha a tartomány kilóg a táblából, az összesítés az
+	OUT_OF_RANGE hibaértéket adja.*/
+	Accumulator rangeAggregate(const CellRect& rect) const;
+	///a kulcs helye (1-től) egy egyoszlopos tartományban (a match és lookup függvényekhez)
+	/**Pontos keresésnél a kulccsal egyenlő első cella, közelítő keresésnél a legnagyobb, a
+	kulcsnál nem nagyobb értékű cella (ezek közül az első) helye, a tartománynak ehhez nem kell
+	rendezettnek lennie. Legalább LookupIndexes::MIN_ROWS soros tartományban a keresés egy lustán
+	épített hash, illetve rendezett indexet használ (ld. LookupIndex), amelyet a tartomány
+	celláinak módosítása eldob. Kivételt nem dob: ha a kulcs hibaérték, azt adja vissza, ha a
+	tartomány kilóg a táblából vagy több oszlopos, az OUT_OF_RANGE, ha nincs találat, a
+	NOT_FOUND hibaértéket adja.
+	@param sorted - igaz: közelítő, hamis: pontos keresés*/
+	double rangeMatch(const CellRect& rect, double key, bool sorted) const;
+	///egy egyoszlopos tartomány adott helyű (1-től) cellájának értéke
+	/**Ha a hely hibaérték, azt adja vissza, ha nem egész, vagy kívül esik a tartományon,
+	illetve a tartomány kilóg a táblából vagy több oszlopos, az OUT_OF_RANGE hibaértéket adja.*/
+	double rangeIndex(const CellRect& rect, double position) const;
+	///a feltételt teljesítő cellák száma és a hozzájuk tartozó értékek összege (a sumif, countif, avgif függvényekhez)
+	/**A criteria tartomány celláit vizsgálja, és a teljesülő cellák values tartománybeli, azonos
+	helyű celláit összegzi. Oszloponként a konstans szakaszokat a ValuePlane zónatérképe és
+	vektorizált kernelje dolgozza fel (ld. ValuePlane::conditionalSum), így a feltételt biztosan nem
+	teljesítő blokkokat be sem olvassa, a képletcellákat egyenként vizsgálja. A hibaérték egy
+	feltételt sem teljesít, az összegzett hibás cellák hibaértéke az összegen keresztül terjed.
+	Kivételt nem dob: ha a küszöbérték hibaérték, az összeg és a darabszám is az lesz, ha egy
+	tartomány kilóg a táblából, vagy a két tartomány mérete eltér, mindkettő az OUT_OF_RANGE
+	hibaérték.*/
+	void rangeSumIf(const CellRect& criteria, const Criterion& c, const CellRect& values, double& sum, double& count) const;
+	///összegtábla építése adott régióra, hogy a régióba eső tartományok összegét konstans időben adja
+	/**Az összegtábla lustán, a régión belüli módosítás utáni első lekérdezéskor épül újra. Az
+	átméretezés megtartja, ha a régió belefér az új táblába.
+	@return hamis, ha a régió kilóg a táblából*/
+	bool setSumIndex(const CellRect& region) {return plane.setIndexRegion(region);}
+	void clearSumIndex() {plane.clearIndex();} ///<az összegtábla megszüntetése
+	const DependencyGraph& getDependencies() const {return deps;} ///<a függőségi gráf lekérdezése
+	bool contains(const ExprPointer* cell) const {size_t i; return table.locate(cell, i);}
+		///<ellenőrzi, hogy a pointer a tábla egy (írt) cellájára mutat-e
+	DependencyGraph::CellKey cellKey(ExprPointer* cell) const
+		{return DependencyGraph::key(getXCoord(cell)+1, getYCoord(cell)+1);} ///<adott cella kulcsa a függőségi gráfban
+	size_t allocatedTiles() const {return table.tileCount();} ///<ritka elrendezésben a lefoglalt csempék száma
 
-	void formattedPrint(std::ostream& os = std::cout) const;
-		///<kiértékeli és kiírja a cellák értékét, illetve az oszlop és sorszámokat a kapott ostream-re
-	void printValues(std::ostream& os = std::cout) const;
-		///<kiértékeli és kiírja a cellák értékét vesszővel elválasztva a kapott ostream-re
+	void formattedPrint(std::ostream& os = std::cout, ThreadPool& pool = ThreadPool::shared()) const;
+		///<kiértékeli (vagy a tárolt értékből kiolvassa) és kiírja a cellák értékét (a hibás cellákét "#ERR"-ként), illetve az oszlop és sorszámokat a kapott ostream-re
+	///kiértékeli és kiírja a cellák értékét (a hibás cellákét "#ERR"-ként) vesszővel elválasztva a kapott ostream-re
+	/**A sorblokkokat a szálkészlet párhuzamosan formázza (std::to_chars-szal), a kimenetre
+	blokkonként egyetlen írás kerül, és csak a végén ürítjük a puffert.*/
+	void printValues(std::ostream& os = std::cout, ThreadPool& pool = ThreadPool::shared()) const;
 	void printExpr(std::ostream& os = std::cout) const;
 		///<kiírja a cellákban található kifejezéseket a kapott ostream-re
+	///vesszővel elválasztott kifejezésekből (ld. printExpr) új táblát épít, a munkát a szálkészlet szálai között elosztva
+	/**A tábla szélessége az első sor mezőinek száma, magassága a sorok száma, a hiányzó és a
+	hibás kifejezésű cellák értéke 0. A sorhatárokat a szöveg részeit párhuzamosan bejárva
+	keresi meg, majd a sorokat szálanként külön NodeArena-ba elemzi, és a cellákat helyben írja.
+	Az azonos relatív képletű cellák egy fán osztoznak (ld. ExprPointer::shareBody). Végül a
+	függőségi gráfot egyben építi fel (ld. rebuildDependencies).*/
+	static Sheet fromCsv(std::string_view text, ThreadPool& pool = ThreadPool::shared());
+
+	const EvalContext* getContext() const {return context;}
+		///<a tábla kiértékelési környezete (a táblán kívüli kifejezéseket egy erre beállított EvalContext::Scope-ban lehet kiértékelni)
+	NodeArena* getArena() const {return arena;}
+		///<a tábla NodeArena-ja (a cellákba kerülő kifejezéseket egy erre beállított NodeArena::Scope-ban érdemes létrehozni)
 
-	~Sheet(){delete[] table;} ///<felszabadítja a táblát
+	~Sheet(){arena->retire(); table.clear(); delete context;} ///<lemond a NodeArena-ról, így a tábla felszabadításakor a csomópontok memóriája egyben szabadul fel (ld. NodeArena::retire)
 
-	static unsigned int colNumber(const std::string&); ///<oszlopbetű oszlopszámra alakítása (1-től indexelve)
+	static unsigned int colNumber(std::string_view); ///<oszlopbetű oszlopszámra alakítása (1-től indexelve)
 	static std::string colLetter (unsigned int); ///<oszlopszám oszlopbetűre alakítása (1-től indexelve)
 };
 
@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <numeric>
+#include <string>
+
+#include "sheetimage.hpp"
+
+
+SheetImage::SheetImage(const Sheet& sh) : width(sh.width), height(sh.height), fill(sh.table.getFill()) {
+	bool sparse = sh.table.getLayout() == CellTable::SPARSE;
+	cells.reserve(sparse ? sh.table.tileCount() * CellTable::TILE * CellTable::TILE : width * height);
+	sh.table.forEachDistinct([&](size_t i, const ExprPointer& cell){
+		Cell c = {cell.isNumber() ? cell.getNumber() : 0, nullptr, 0, 0};
+		if (cell.hasFormula()) {
+			const ExprPointer::Formula* f = cell.formula();
+			ExprPointer::tree(f); //a még visszafejtetlen fát itt építjük fel, a kiíró szál csak olvassa
+			ExprPointer::share(f->body);
+			c = {0, f->body, f->col, f->row};
+		}
+		if (sparse)
+			indices.push_back(i);
+		cells.push_back(c);
+	});
+}
+
+void SheetImage::printExpr(std::ostream& os) const {
+	//ritka elrendezésben a cellák csempénként következnek, ezért index szerint sorba rendezzük őket
+	std::vector<size_t> order(indices.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [this](size_t a, size_t b){return indices[a] < indices[b];});
+	const Cell empty = {fill, nullptr, 0, 0};
+	size_t next = 0;
+	std::string buffer;
+	for (size_t i = 0; i < width * height; i++) {
+		const Cell* c = &empty;
+		if (indices.empty())
+			c = &cells[i];
+		else if (next < order.size() && indices[order[next]] == i)
+			c = &cells[order[next++]];
+		if (c->body == nullptr) {
+			Sheet::appendNumber(buffer, c->number);
+		} else {
+			EvalContext::Scope scope(nullptr, c->col, c->row);
+			buffer += c->body->content->show();
+		}
+		buffer += ',';
+		if ((i + 1) % width == 0) {
+			buffer += '\n';
+			if (buffer.size() >= 64 * 1024) {
+				os.write(buffer.data(), (std::streamsize)buffer.size());
+				buffer.clear();
+			}
+		}
+	}
+	os.write(buffer.data(), (std::streamsize)buffer.size());
+	os.flush();
+}
+
+SheetImage::~SheetImage(){
+	for (const Cell& c : cells)
+		if (c.body)
+			ExprPointer::release(c.body);
+}
@@ -0,0 +1,43 @@
+#ifndef SHEETIMAGE_HPP
+#define SHEETIMAGE_HPP
+
+#include <vector>
+#include <ostream>
+
+#include "sheet.hpp"
+
+///Egy tábla egy időpontbeli, csak olvasható képe, amelyet egy háttérszál is kiírhat
+/**
+A kép elkészítése a cellákon egyetlen gyors bejárás: a szám cellák értékét, a képlet cellák
+megosztott fáját (ld. ExprPointer) és origóját rögzíti, a fákat nem másolja, csak megosztja.
+Mivel a tábla a megosztott fát módosítás előtt mindig lemásolja (ld. ExprPointer::own), a
+képben rögzített fák a tábla további módosításaitól függetlenül változatlanok maradnak, így
+a kép kiírása (printExpr) egy másik szálon futhat, miközben a táblát tovább szerkesztik.
+A képet a tábla szálán kell létrehozni és megszüntetni, mert a fák ekkor a tábla
+NodeArena-jából foglalnak, illetve oda szabadulnak fel.
+*/
+class SheetImage {
+	///egy cella rögzített tartalma
+	struct Cell {
+		double number; ///<szám cella értéke
+		ExprPointer::Body* body; ///<képlet cella megosztott fája (szám cellánál nullptr)
+		unsigned int col; ///<a képlet origójának oszlopa
+		unsigned int row; ///<a képlet origójának sora
+	};
+	size_t width; ///<a tábla szélessége
+	size_t height; ///<a tábla magassága
+	double fill; ///<ritka elrendezésben a nem tárolt cellák értéke
+	std::vector<Cell> cells; ///<a tárolt cellák (sűrű elrendezésben sorfolytonosan az összes)
+	std::vector<size_t> indices; ///<ritka elrendezésben a tárolt cellák sorfolytonos indexe (sűrűben üres)
+public:
+	explicit SheetImage(const Sheet& sh); ///<konstruktor, rögzíti a tábla aktuális tartalmát
+	SheetImage(const SheetImage&) = delete;
+	SheetImage& operator=(const SheetImage&) = delete;
+	size_t getWidth() const {return width;} ///<a tábla szélessége
+	size_t getHeight() const {return height;} ///<a tábla magassága
+	///a rögzített kifejezések kiírása a Sheet::printExpr-rel azonos alakban (bármelyik szálról hívható)
+	void printExpr(std::ostream& os) const;
+	~SheetImage(); ///<destruktor, elengedi a megosztott fákat
+};
+
+#endif
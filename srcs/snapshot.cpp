@@ -0,0 +1,152 @@
+#include <cstring>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+
+#include "snapshot.hpp"
+#include "exceptions.hpp"
+
+
+const char Snapshot::MAGIC[8] = {'S', 'H', 'E', 'E', 'T', 'S', 'N', 'P'};
+
+void Snapshot::save(const Sheet& sh, std::ostream& os){
+	uint64_t fill = ExprPointer::newNumber(sh.table.getLayout() == CellTable::DENSE ? 0 : sh.table.getFill()).bits;
+	std::vector<CellRecord> cells;
+	std::vector<FormulaRecord> formulas;
+	//az azonos lefordított alakú kifejezések (pl. a külön beírt azonos relatív képletek) egyszer kerülnek a fájlba
+	std::string programs;
+	std::unordered_map<std::string, uint32_t> programIndex;
+	std::unordered_map<const ExprPointer::Body*, uint32_t> bodyIndex;
+	std::string program;
+	sh.table.forEachDistinct([&](size_t i, const ExprPointer& cell){
+		if (!cell.hasFormula()) {
+			//az üres (kifejezés nélküli) cella értéke 0
+			uint64_t bits = cell.isNumber() ? cell.bits : ExprPointer::newNumber(0).bits;
+			if (bits != fill)
+				cells.push_back({i, bits});
+			return;
+		}
+		const ExprPointer::Formula* f = cell.formula();
+		auto found = bodyIndex.emplace(f->body, 0);
+		if (found.second) {
+			program.clear();
+			ExprPointer::compiled(f->body)->write(program);
+			auto stored = programIndex.emplace(program, (uint32_t)programIndex.size());
+			if (stored.second)
+				programs += program;
+			found.first->second = stored.first->second;
+		}
+		ExprPointer::CacheState state = f->state == ExprPointer::EVALUATING ? ExprPointer::DIRTY : f->state;
+		cells.push_back({i, FORMULA_MARK | formulas.size()});
+		formulas.push_back({found.first->second, (uint32_t)state, f->value});
+	});
+	//ritka elrendezésben a cellák csempénként következnek, a fájlban viszont sorfolytonosan vannak
+	if (sh.table.getLayout() == CellTable::SPARSE)
+		std::sort(cells.begin(), cells.end(), [](const CellRecord& a, const CellRecord& b){return a.index < b.index;});
+	Header header;
+	std::memset(&header, 0, sizeof header);
+	std::memcpy(header.magic, MAGIC, sizeof MAGIC);
+	header.version = VERSION;
+	header.layout = sh.table.getLayout();
+	header.width = sh.width;
+	header.height = sh.height;
+	header.fill = fill;
+	header.cells = cells.size();
+	header.formulas = formulas.size();
+	header.bodies = programIndex.size();
+	os.write(reinterpret_cast<const char*>(&header), sizeof header);
+	os.write(reinterpret_cast<const char*>(cells.data()), (std::streamsize)(cells.size() * sizeof(CellRecord)));
+	os.write(reinterpret_cast<const char*>(formulas.data()), (std::streamsize)(formulas.size() * sizeof(FormulaRecord)));
+	os.write(programs.data(), (std::streamsize)programs.size());
+}
+
+Sheet Snapshot::load(std::string_view data){
+	const char* p = data.data();
+	const char* end = data.data() + data.size();
+	Header header;
+	if (data.size() < sizeof header)
+		throw eval_error("truncated snapshot");
+	std::memcpy(&header, p, sizeof header);
+	p += sizeof header;
+	if (std::memcmp(header.magic, MAGIC, sizeof MAGIC) != 0)
+		throw eval_error("not a sheet snapshot");
+	if (header.version != VERSION)
+		throw eval_error("unsupported snapshot version");
+	if (header.layout > CellTable::SPARSE || header.width > UINT32_MAX || header.height > UINT32_MAX
+			|| (header.width != 0 && header.height > UINT64_MAX / header.width))
+		throw eval_error("invalid snapshot size");
+	if ((size_t)(end - p) / sizeof(CellRecord) < header.cells
+			|| ((size_t)(end - p) - header.cells * sizeof(CellRecord)) / sizeof(FormulaRecord) < header.formulas)
+		throw eval_error("truncated snapshot");
+	const char* cellData = p;
+	const char* formulaData = p + header.cells * sizeof(CellRecord);
+	p = formulaData + header.formulas * sizeof(FormulaRecord);
+
+	std::vector<ExprPointer::Body*> bodies;
+	auto releaseBodies = [&bodies](){
+		for (ExprPointer::Body* body : bodies)
+			ExprPointer::release(body);
+	};
+	try {
+		for (uint64_t b = 0; b < header.bodies; b++) {
+			Bytecode* code = Bytecode::read(p, end);
+			ExprPointer::Body* body = new ExprPointer::Body(nullptr);
+			body->code = code;
+			ExprPointer::share(body); //a betöltés végéig mi is tartjuk
+			bodies.push_back(body);
+		}
+		double fill;
+		std::memcpy(&fill, &header.fill, sizeof fill);
+		Sheet sh(header.width, header.height, fill, (CellTable::Layout)header.layout);
+		std::vector<bool> used(header.formulas, false);
+		std::vector<CellRect> refs;
+		uint64_t size = header.width * header.height;
+		uint64_t previous = 0; //az előző cella indexe (a cellák szigorúan növekvő sorrendben jönnek)
+		for (uint64_t c = 0; c < header.cells; c++) {
+			CellRecord record;
+			std::memcpy(&record, cellData + c * sizeof(CellRecord), sizeof record);
+			if (record.index >= size || (c > 0 && record.index <= previous))
+				throw eval_error("invalid cell in snapshot");
+			previous = record.index;
+			ExprPointer& cell = sh.table.write(record.index);
+			if ((record.bits & ExprPointer::TAG_MASK) != FORMULA_MARK) {
+				double v;
+				std::memcpy(&v, &record.bits, sizeof v);
+				cell = ExprPointer::newNumber(v);
+				continue;
+			}
+			uint64_t index = record.bits & ~ExprPointer::TAG_MASK;
+			FormulaRecord formula;
+			if (index >= header.formulas || used[index])
+				throw eval_error("invalid cell in snapshot");
+			used[index] = true;
+			std::memcpy(&formula, formulaData + index * sizeof(FormulaRecord), sizeof formula);
+			if (formula.body >= bodies.size() || formula.state == ExprPointer::EVALUATING || formula.state > ExprPointer::CYCLIC)
+				throw eval_error("invalid formula in snapshot");
+			unsigned int col = (unsigned int)(record.index % header.width) + 1, row = (unsigned int)(record.index / header.width) + 1;
+			ExprPointer::Formula* f = new ExprPointer::Formula(bodies[formula.body], sh.context, col, row);
+			f->value = formula.value;
+			f->state = (ExprPointer::CacheState)formula.state;
+			cell.clear();
+			cell.bits = ExprPointer::formulaBits(f);
+			//a hivatkozásokat a lefordított alakból olvassuk ki, a fát nem fejtjük vissza
+			refs.clear();
+			{
+				EvalContext::Scope scope(nullptr, col, row);
+				f->body->code.load()->collectRefs(refs);
+			}
+			DependencyGraph::CellKey key = DependencyGraph::key(col, row);
+			if (!refs.empty())
+				sh.deps.setPrecedents(key, refs);
+			if (f->state == ExprPointer::CYCLIC)
+				sh.cyclic.insert(key);
+		}
+		sh.rebuildPlane();
+		releaseBodies();
+		return sh;
+	} catch (...) {
+		releaseBodies();
+		throw;
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <string_view>
+#include <ostream>
+#include <cstdint>
+
+#include "sheet.hpp"
+
+///Táblák bináris pillanatképét író és olvasó osztály
+/**
+A pillanatkép a tábla celláit, a képletek lefordított alakját (ld. Bytecode) és a cellákban
+tárolt utolsó értékeket tartalmazza, így betöltés után a tábla elemzés és újraszámolás nélkül
+kiírható. A fájl egy fejlécből és rögzített méretű rekordok tömbjeiből áll, a tömbök 8 bájtra
+igazítottak, így a fájl a memóriába képezve (ld. MappedFile) közvetlenül olvasható:
+- fejléc (Header): azonosító, verziószám, méretek és a tömbök hossza,
+- cellák (CellRecord): a kitöltő értéktől eltérő cellák sorfolytonos indexe és tárolt alakja: a
+  szám bitjei, vagy az ExprPointer-hez hasonlóan egy negatív NaN-ban a képlet sorszáma,
+- képletek (FormulaRecord): a Body sorszáma, a gyorsítótár állapota és az utolsó érték,
+- Body-k: a kifejezések lefordított alakja egymás után (ld. Bytecode::write), minden
+  különböző utasítássorozat egyszer, így az azonos relatív képletek betöltés után egy fán osztoznak.
+A számok a gép saját bájtsorrendjében szerepelnek. A cellák hivatkozásait (és így a függőségi
+gráfot) betöltéskor a lefordított alakból olvassuk ki, a kifejezésfákat pedig csak akkor fejtjük
+vissza, amikor először szükség van rájuk (ld. ExprPointer::tree), pl. a cella kiírásakor vagy
+módosításakor.
+*/
+class Snapshot {
+	///a fájl fejléce
+	struct Header {
+		char magic[8]; ///<a fájltípus azonosítója (MAGIC)
+		uint32_t version; ///<a formátum verziója (VERSION)
+		uint32_t layout; ///<a tábla elrendezése (ld. CellTable::Layout)
+		uint64_t width; ///<a tábla szélessége
+		uint64_t height; ///<a tábla magassága
+		uint64_t fill; ///<a nem tárolt cellák értékének bitjei
+		uint64_t cells; ///<a tárolt cellák száma
+		uint64_t formulas; ///<a képletek száma
+		uint64_t bodies; ///<a megosztott kifejezések száma
+	};
+	///egy tárolt cella
+	struct CellRecord {
+		uint64_t index; ///<a cella sorfolytonos indexe (a cellák index szerint növekvő sorrendben követik egymást)
+		uint64_t bits; ///<a szám bitjei vagy FORMULA_MARK és a képlet sorszáma
+	};
+	///egy képlet cella adatai
+	struct FormulaRecord {
+		uint32_t body; ///<a kifejezés sorszáma
+		uint32_t state; ///<a tárolt érték állapota (ld. ExprPointer::CacheState)
+		double value; ///<a legutóbb kiszámolt érték
+	};
+	static const uint64_t FORMULA_MARK = 0xFFFC000000000000; ///<a képletet jelölő bitminta a cellákban
+	static const char MAGIC[8]; ///<a fájltípus azonosítója
+public:
+	static const uint32_t VERSION = 1; ///<a formátum aktuális verziója
+	///a tábla pillanatképének kiírása
+	/**A még le nem fordított képleteket lefordítja, a tárolt értékeket változatlanul menti (a
+	friss értékekhez előbb recalculate hívandó). Ha egy képlet nem menthető, eval_error kivételt dob.*/
+	static void save(const Sheet& sh, std::ostream& os);
+	///tábla létrehozása egy pillanatképből
+	/**Az adatot csak a hívás idejéig használja. Hibás, csonka vagy más verziójú adat esetén
+	eval_error kivételt dob.*/
+	static Sheet load(std::string_view data);
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "threadpool.hpp"
+
+
+ThreadPool::ThreadPool(size_t threads){
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+	for (size_t i = 0; i < threads; i++) {
+		queues.push_back(std::make_unique<Queue>());
+	}
+	for (size_t i = 1; i < threads; i++) {
+		workers.emplace_back(&ThreadPool::work, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool(){
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+	for (std::thread& t : workers) {
+		t.join();
+	}
+}
+
+bool ThreadPool::pop(size_t self, Task& task){
+	{
+		Queue& own = *queues[self];
+		std::lock_guard<std::mutex> lock(own.mtx);
+		if (!own.tasks.empty()) {
+			task = own.tasks.back();
+			own.tasks.pop_back();
+			queued--;
+			return true;
+		}
+	}
+	for (size_t i = 1; i < queues.size(); i++) {
+		Queue& other = *queues[(self + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(other.mtx);
+		if (!other.tasks.empty()) {
+			task = other.tasks.front();
+			other.tasks.pop_front();
+			queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::execute(const Task& task){
+	(*task.job->body)(task.begin, task.end);
+	if (task.job->remaining.fetch_sub(1) == 1) {
+		std::lock_guard<std::mutex> lock(mtx);
+		jobDone.notify_all();
+	}
+}
+
+void ThreadPool::work(size_t self){
+	while (true) {
+		Task task;
+		if (pop(self, task)) {
+			execute(task);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(mtx);
+		workAvailable.wait(lock, [this]{return stopping || queued > 0;});
+		if (stopping && queued <= 0)
+			return;
+	}
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t, size_t)>& body){
+	if (n == 0)
+		return;
+	if (workers.empty() || n == 1) {
+		body(0, n);
+		return;
+	}
+	//szálanként több részre bontjuk a munkát, hogy legyen mit ellopni
+	size_t chunkSize = (n + queues.size()*4 - 1) / (queues.size()*4);
+	size_t chunks = (n + chunkSize - 1) / chunkSize;
+	Job job;
+	job.body = &body;
+	job.remaining = chunks;
+	for (size_t c = 0; c < chunks; c++) {
+		size_t begin = c * chunkSize;
+		size_t end = begin + chunkSize < n ? begin + chunkSize : n;
+		Queue& q = *queues[c % queues.size()];
+		std::lock_guard<std::mutex> lock(q.mtx);
+		q.tasks.push_back({&job, begin, end});
+	}
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		queued += (long)chunks;
+	}
+	workAvailable.notify_all();
+	while (job.remaining > 0) {
+		Task task;
+		if (pop(0, task)) {
+			execute(task);
+		} else {
+			std::unique_lock<std::mutex> lock(mtx);
+			jobDone.wait(lock, [&job]{return job.remaining == 0;});
+		}
+	}
+}
+
+ThreadPool& ThreadPool::shared(){
+	static ThreadPool pool;
+	return pool;
+}
@@ -0,0 +1,64 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+///Munkalopásos (work-stealing) szálkészlet
+/**
+Minden szálnak saját feladatsora van: a szál a saját sorának végéről veszi ki a feladatokat,
+ha az kiürült, akkor a többi szál sorának elejéről "lop". A parallelFor-t hívó szál is részt
+vesz a munkában, ezért n méretű készlet n-1 háttérszálat indít, 1 méretű készlet pedig
+mindent a hívó szálon hajt végre.
+*/
+class ThreadPool {
+	///egy parallelFor hívás adatai
+	struct Job {
+		const std::function<void(size_t, size_t)>* body; ///<a végrehajtandó függvény
+		std::atomic<size_t> remaining; ///<a még be nem fejezett részfeladatok száma
+	};
+	///részfeladat: a [begin, end) indextartomány feldolgozása
+	struct Task {
+		Job* job; ///<a feladat, amelyhez tartozik
+		size_t begin; ///<első index
+		size_t end; ///<utolsó utáni index
+	};
+	///egy szál feladatsora
+	struct Queue {
+		std::mutex mtx; ///<a sort védő zár
+		std::deque<Task> tasks; ///<a sorban álló részfeladatok
+	};
+	std::vector<std::unique_ptr<Queue>> queues; ///<feladatsorok, a 0. a parallelFor-t hívó száljé
+	std::vector<std::thread> workers; ///<háttérszálak
+	std::mutex mtx; ///<az alvó szálak ébresztéséhez használt zár
+	std::condition_variable workAvailable; ///<új feladat érkezésekor jelez
+	std::condition_variable jobDone; ///<egy parallelFor hívás befejeződésekor jelez
+	std::atomic<long> queued{0}; ///<sorban álló részfeladatok száma
+	bool stopping = false; ///<leállítás alatt áll-e a készlet
+
+	bool pop(size_t self, Task& task); ///<kivesz egy feladatot a saját sorból, vagy lop egyet egy másikból
+	void execute(const Task& task); ///<végrehajt egy részfeladatot
+	void work(size_t self); ///<háttérszálak fő ciklusa
+public:
+	///konstruktor
+	/**@param threads - a készlet mérete a hívó szállal együtt (0 esetén a processzormagok száma)*/
+	explicit ThreadPool(size_t threads = 0);
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	size_t size() const {return queues.size();} ///<a készlet mérete (a hívó szállal együtt)
+	///párhuzamosan végrehajtja a body függvényt a [0, n) tartomány részein, és megvárja a végét
+	/**A body függvény nem dobhat kivételt. Egy részfeladat body(begin, end) hívással dolgozza fel
+	a [begin, end) tartományt, a részek feldolgozásának sorrendje nem meghatározott.*/
+	void parallelFor(size_t n, const std::function<void(size_t, size_t)>& body);
+	~ThreadPool(); ///<leállítja és bevárja a háttérszálakat
+
+	static ThreadPool& shared(); ///<a processzormagok számával megegyező méretű közös szálkészlet
+};
+
+#endif
@@ -16,6 +16,14 @@ std::string Token::show() const {
 			return "right br";
 		case COLON:
 			return "colon";
+		case SEMICOLON:
+			return "semicolon";
+		case LESS:
+			return "less";
+		case GREATER:
+			return "greater";
+		case EQUAL:
+			return "equal";
 		case NUMBER:
 			return "number";
 		case DOLLAR:
@@ -41,6 +49,14 @@ Token_type Token::parseTokenType(char c){
 			return RIGHT_BR;
 		case ':':
 			return COLON;
+		case ';':
+			return SEMICOLON;
+		case '<':
+			return LESS;
+		case '>':
+			return GREATER;
+		case '=':
+			return EQUAL;
 		case '$':
 			return DOLLAR;
 		default:
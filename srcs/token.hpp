@@ -2,6 +2,7 @@
 #define TOKEN_HPP
 
 #include <string>
+#include <string_view>
 #include <iostream>
 
 /**
@@ -10,34 +11,27 @@
 */
 enum Token_type {
 	MINUS, PLUS, SLASH, STAR, LEFT_BR, RIGHT_BR, COLON,
-	DOLLAR, NUMBER, STRING
+	SEMICOLON, LESS, GREATER, EQUAL, DOLLAR, NUMBER, STRING
 };
 
 ///Tokenek osztálya: Az kifejezés értelmező ezen osztály példányaival tárolja el a kifejezéseket
+/**A token egy kis értéktípus: a típusán kívül a bemenet rá eső szeletét (std::string_view), szám
+token esetén pedig a már kiolvasott értéket is tárolja, így a tokenizálás nem foglal tokenenként
+memóriát, és az értelmezőnek sem kell a tartalmat típuskényszerítéssel elérnie. A szelet a
+bemenetre mutat, ezért a token csak addig használható, amíg a bemenet érvényes.*/
 class Token {
-protected:
 	Token_type type; ///<token típusa
+	std::string_view text; ///<a token szövege (a bemenet egy szelete)
+	double number; ///<NUMBER típusú token értéke
 public:
-	explicit Token() {} ///<alapértelmezett konstruktor
-	explicit Token(Token_type t) : type(t) {} ///<konstruktor típus megadásával
+	explicit Token(Token_type t, std::string_view text = {}, double number = 0) : type(t), text(text), number(number) {}
+		///<konstruktor típus, szöveg és (szám token esetén) érték megadásával
 	Token_type getType() const {return type;} ///<típus lekérdezése
+	std::string_view getText() const {return text;} ///<a token szövegének lekérdezése
+	double getNumber() const {return number;} ///<szám token értékének lekérdezése
 
 	std::string show() const; ///<token megjelenítése std::string-ként
-	virtual Token* copy() {return new Token(type);} ///<dinamikusan foglalt memóriaterületen visszaadott másolat
 	static Token_type parseTokenType(char c); ///<karakterhez megfelelő tokentípus rendelése
-	virtual ~Token(){} ///<destruktor
-};
-
-///Adattartalommal rendelkezó tokenek osztálya.
-/**A token osztály leszármazottja az olyan tokeneknek, amelyek a típusokon felül más adattartalommal is rendelkeznek.
-*/
-template <typename T>
-class DataToken : public Token {
-	T content; ///<a token adattartalma
-public:
-	explicit DataToken(Token_type tt, const T& s) : Token(tt), content(s) {} ///<konstruktor típus és adat megadásával
-	T getContent() const {return content;} ///<belső adat lekérdezése
-	Token* copy() const {return new DataToken(type, content);} ///<dinamikusan foglalt memóriaterületen visszaadott másolat
 };
 
 #endif
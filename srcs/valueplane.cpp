@@ -0,0 +1,351 @@
+#include "valueplane.hpp"
+
+#include <utility>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+ValuePlane& ValuePlane::operator=(const ValuePlane& plane){
+	if (&plane != this) {
+		values = plane.values;
+		formulaRows = plane.formulaRows;
+		height = plane.height;
+		capacity = plane.capacity;
+		indexed = plane.indexed;
+		region = plane.region;
+		prefix.clear();
+		prefixError.clear();
+		indexValid = false;
+		dropZones();
+	}
+	return *this;
+}
+
+void ValuePlane::swap(ValuePlane& plane){
+	values.swap(plane.values);
+	formulaRows.swap(plane.formulaRows);
+	std::swap(height, plane.height);
+	std::swap(capacity, plane.capacity);
+	std::swap(indexed, plane.indexed);
+	std::swap(region, plane.region);
+	prefix.swap(plane.prefix);
+	prefixError.swap(plane.prefixError);
+	std::swap(magnitude, plane.magnitude);
+	std::swap(usable, plane.usable);
+	std::swap(regionFormulas, plane.regionFormulas);
+	bool valid = indexValid;
+	indexValid = plane.indexValid.load();
+	plane.indexValid = valid;
+	dropZones();
+	plane.dropZones();
+}
+
+void ValuePlane::reset(size_t width, size_t height){
+	this->height = height;
+	capacity = height;
+	values.assign(width*height, 0);
+	formulaRows.assign(width, {});
+	indexValid = false;
+	dropZones();
+	if (indexed && (region.col2 > width || region.row2 > height))
+		clearIndex();
+}
+
+void ValuePlane::appendRow(){
+	size_t width = formulaRows.size();
+	if (height == capacity) {
+		size_t grown = capacity < 4 ? 4 : 2*capacity;
+		std::vector<double> moved(width*grown, 0);
+		for (size_t col = 0; col < width; col++)
+			std::copy(values.begin() + (long)(col*capacity), values.begin() + (long)(col*capacity + height), moved.begin() + (long)(col*grown));
+		values.swap(moved);
+		capacity = grown;
+		dropZones();
+	}
+	for (size_t col = 0; col < width; col++) {
+		values[col*capacity + height] = 0;
+		touch((unsigned int)col, (unsigned int)height);
+	}
+	height++;
+}
+
+bool ValuePlane::setIndexRegion(const CellRect& r){
+	if (r.col1 == 0 || r.row1 == 0 || r.col1 > r.col2 || r.row1 > r.row2
+			|| r.col2 > formulaRows.size() || r.row2 > height) {
+		clearIndex();
+		return false;
+	}
+	indexed = true;
+	region = r;
+	indexValid = false;
+	return true;
+}
+
+///két szám pontos összege kerekített összegként és kerekítési maradékként (Knuth TwoSum)
+static inline void twoSum(double a, double b, double& sum, double& error){
+	sum = a + b;
+	double b1 = sum - a;
+	error = (a - (sum - b1)) + (b - b1);
+}
+
+///két kompenzált (összeg, maradék) alakú szám összege ugyanilyen alakban
+static inline void addCompensated(double& hi, double& lo, double bhi, double blo){
+	double s, e;
+	twoSum(hi, bhi, s, e);
+	e += lo + blo;
+	hi = s + e;
+	lo = e - (hi - s);
+}
+
+void ValuePlane::buildIndex() const {
+	size_t w = region.col2 - region.col1 + 1;
+	size_t h = region.row2 - region.row1 + 1;
+	prefix.assign((w+1)*(h+1), 0);
+	prefixError.assign((w+1)*(h+1), 0);
+	usable = true;
+	regionFormulas = false;
+	magnitude = 0;
+	for (size_t c = 0; c < w; c++) {
+		const double* col = values.data() + (region.col1 - 1 + c)*capacity + region.row1 - 1;
+		double* out = prefix.data() + (c+1)*(h+1);
+		double* outError = prefixError.data() + (c+1)*(h+1);
+		const double* left = prefix.data() + c*(h+1);
+		const double* leftError = prefixError.data() + c*(h+1);
+		double run = 0, runError = 0; //az oszlop eddigi elemeinek összege kompenzáltan
+		for (size_t r = 0; r < h; r++) {
+			if (col[r] - col[r] != 0) //végtelen vagy NaN
+				usable = false;
+			magnitude += std::fabs(col[r]);
+			addCompensated(run, runError, col[r], 0);
+			double hi = left[r+1], lo = leftError[r+1];
+			addCompensated(hi, lo, run, runError);
+			out[r+1] = hi;
+			outError[r+1] = lo;
+		}
+		const std::set<unsigned int>& formulas = formulaRows[region.col1 - 1 + c];
+		auto it = formulas.lower_bound(region.row1 - 1);
+		if (it != formulas.end() && *it < region.row2)
+			regionFormulas = true;
+	}
+}
+
+bool ValuePlane::indexedSum(const CellRect& r, double& sum, bool& hasFormulas) const {
+	if (!indexed || !region.contains(r.col1, r.row1) || !region.contains(r.col2, r.row2))
+		return false;
+	if (!indexValid.load(std::memory_order_acquire)) {
+		std::lock_guard<std::mutex> lock(indexMutex);
+		if (!indexValid.load(std::memory_order_relaxed)) {
+			buildIndex();
+			indexValid.store(true, std::memory_order_release);
+		}
+	}
+	if (!usable)
+		return false;
+	size_t h = region.row2 - region.row1 + 1, w = region.col2 - region.col1 + 1;
+	size_t c1 = r.col1 - region.col1, c2 = r.col2 - region.col1 + 1;
+	size_t r1 = r.row1 - region.row1, r2 = r.row2 - region.row1 + 1;
+	double hi = prefix[c2*(h+1) + r2], lo = prefixError[c2*(h+1) + r2];
+	addCompensated(hi, lo, -prefix[c1*(h+1) + r2], -prefixError[c1*(h+1) + r2]);
+	addCompensated(hi, lo, -prefix[c2*(h+1) + r1], -prefixError[c2*(h+1) + r1]);
+	addCompensated(hi, lo, prefix[c1*(h+1) + r1], prefixError[c1*(h+1) + r1]);
+	double total = hi + lo;
+	//a kompenzált elemek hibája legfeljebb (lépésszám) * 2^-104 * magnitude; ha ez az összeg fél
+	//egységnyi kerekítésével összemérhető, a különbség nem megbízható
+	double bound = magnitude * (double)(w + h + 4) * 0x1p-100;
+	if (std::fabs(total) * 0x1p-53 < bound)
+		return false;
+	sum = total;
+	hasFormulas = regionFormulas;
+	return true;
+}
+
+double ValuePlane::sum(const double* p, size_t n){
+	size_t i = 0;
+	double total = 0;
+#if defined(__AVX__)
+	__m256d acc0 = _mm256_setzero_pd();
+	__m256d acc1 = _mm256_setzero_pd();
+	for (; i + 8 <= n; i += 8) {
+		acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(p + i));
+		acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(p + i + 4));
+	}
+	double lanes[4];
+	_mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+	total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__SSE2__)
+	__m128d acc0 = _mm_setzero_pd();
+	__m128d acc1 = _mm_setzero_pd();
+	for (; i + 4 <= n; i += 4) {
+		acc0 = _mm_add_pd(acc0, _mm_loadu_pd(p + i));
+		acc1 = _mm_add_pd(acc1, _mm_loadu_pd(p + i + 2));
+	}
+	double lanes[2];
+	_mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+	total = lanes[0] + lanes[1];
+#endif
+	for (; i < n; i++)
+		total += p[i];
+	return total;
+}
+
+#if defined(__AVX__)
+///a feltétel vektoros összehasonlítása (a NaN-ra minden összehasonlítás hamis)
+template <Criterion::Op OP>
+static inline __m256d compare(__m256d x, __m256d t){
+	if constexpr (OP == Criterion::EQ) return _mm256_cmp_pd(x, t, _CMP_EQ_OQ);
+	else if constexpr (OP == Criterion::NE) return _mm256_cmp_pd(x, t, _CMP_NEQ_OQ);
+	else if constexpr (OP == Criterion::LT) return _mm256_cmp_pd(x, t, _CMP_LT_OQ);
+	else if constexpr (OP == Criterion::LE) return _mm256_cmp_pd(x, t, _CMP_LE_OQ);
+	else if constexpr (OP == Criterion::GT) return _mm256_cmp_pd(x, t, _CMP_GT_OQ);
+	else return _mm256_cmp_pd(x, t, _CMP_GE_OQ);
+}
+#elif defined(__SSE2__)
+///a feltétel vektoros összehasonlítása (a NaN-ra minden összehasonlítás hamis)
+template <Criterion::Op OP>
+static inline __m128d compare(__m128d x, __m128d t){
+	if constexpr (OP == Criterion::EQ) return _mm_cmpeq_pd(x, t);
+	else if constexpr (OP == Criterion::NE) return _mm_or_pd(_mm_cmplt_pd(x, t), _mm_cmpgt_pd(x, t)); //a _mm_cmpneq_pd NaN-ra igaz
+	else if constexpr (OP == Criterion::LT) return _mm_cmplt_pd(x, t);
+	else if constexpr (OP == Criterion::LE) return _mm_cmple_pd(x, t);
+	else if constexpr (OP == Criterion::GT) return _mm_cmpgt_pd(x, t);
+	else return _mm_cmpge_pd(x, t);
+}
+#endif
+
+///a sumIf kernelje egy rögzített összehasonlításra
+template <Criterion::Op OP>
+static void sumIfKernel(const double* criteria, const double* values, size_t n, const Criterion& c, double& sum, size_t& count){
+	size_t i = 0;
+	double total = 0, matched = 0;
+#if defined(__AVX__)
+	__m256d acc = _mm256_setzero_pd(), cnt = _mm256_setzero_pd();
+	__m256d t = _mm256_set1_pd(c.value), one = _mm256_set1_pd(1);
+	for (; i + 4 <= n; i += 4) {
+		__m256d mask = compare<OP>(_mm256_loadu_pd(criteria + i), t);
+		acc = _mm256_add_pd(acc, _mm256_and_pd(mask, _mm256_loadu_pd(values + i)));
+		cnt = _mm256_add_pd(cnt, _mm256_and_pd(mask, one));
+	}
+	double lanes[2][4];
+	_mm256_storeu_pd(lanes[0], acc);
+	_mm256_storeu_pd(lanes[1], cnt);
+	total = (lanes[0][0] + lanes[0][1]) + (lanes[0][2] + lanes[0][3]);
+	matched = (lanes[1][0] + lanes[1][1]) + (lanes[1][2] + lanes[1][3]);
+#elif defined(__SSE2__)
+	__m128d acc = _mm_setzero_pd(), cnt = _mm_setzero_pd();
+	__m128d t = _mm_set1_pd(c.value), one = _mm_set1_pd(1);
+	for (; i + 2 <= n; i += 2) {
+		__m128d mask = compare<OP>(_mm_loadu_pd(criteria + i), t);
+		acc = _mm_add_pd(acc, _mm_and_pd(mask, _mm_loadu_pd(values + i)));
+		cnt = _mm_add_pd(cnt, _mm_and_pd(mask, one));
+	}
+	double lanes[2][2];
+	_mm_storeu_pd(lanes[0], acc);
+	_mm_storeu_pd(lanes[1], cnt);
+	total = lanes[0][0] + lanes[0][1];
+	matched = lanes[1][0] + lanes[1][1];
+#endif
+	for (; i < n; i++) {
+		if (c.matches(criteria[i])) {
+			total += values[i];
+			matched++;
+		}
+	}
+	sum += total;
+	count += (size_t)matched;
+}
+
+void ValuePlane::sumIf(const double* criteria, const double* values, size_t n, const Criterion& c, double& sum, size_t& count){
+	switch (c.op) {
+		case Criterion::EQ: sumIfKernel<Criterion::EQ>(criteria, values, n, c, sum, count); break;
+		case Criterion::NE: sumIfKernel<Criterion::NE>(criteria, values, n, c, sum, count); break;
+		case Criterion::LT: sumIfKernel<Criterion::LT>(criteria, values, n, c, sum, count); break;
+		case Criterion::LE: sumIfKernel<Criterion::LE>(criteria, values, n, c, sum, count); break;
+		case Criterion::GT: sumIfKernel<Criterion::GT>(criteria, values, n, c, sum, count); break;
+		case Criterion::GE: sumIfKernel<Criterion::GE>(criteria, values, n, c, sum, count); break;
+	}
+}
+
+bool ValuePlane::excludes(const Criterion& c, const Zone& z){
+	switch (c.op) {
+		case Criterion::EQ: return !(z.min <= c.value && c.value <= z.max);
+		case Criterion::NE: return z.min > z.max || (z.min == c.value && z.max == c.value);
+		case Criterion::LT: return !(z.min < c.value);
+		case Criterion::LE: return !(z.min <= c.value);
+		case Criterion::GT: return !(z.max > c.value);
+		default: return !(z.max >= c.value);
+	}
+}
+
+bool ValuePlane::covers(const Criterion& c, const Zone& z){
+	if (z.nan)
+		return false;
+	switch (c.op) {
+		case Criterion::EQ: return z.min == c.value && z.max == c.value;
+		case Criterion::NE: return c.value < z.min || c.value > z.max;
+		case Criterion::LT: return z.max < c.value;
+		case Criterion::LE: return z.max <= c.value;
+		case Criterion::GT: return z.min > c.value;
+		default: return z.min >= c.value;
+	}
+}
+
+void ValuePlane::refreshZones() const {
+	if (zonesValid.load(std::memory_order_acquire))
+		return;
+	std::lock_guard<std::mutex> lock(zoneMutex);
+	if (zonesValid.load(std::memory_order_relaxed))
+		return;
+	size_t blocks = zoneBlocks();
+	if (!zoned) {
+		zones.assign(formulaRows.size() * blocks, {0, 0, false});
+		staleZones.assign(zones.size(), 1);
+		zoned = true;
+	}
+	//a zóna a blokk minden sorát lefedi, a képletcellák helyén és a tartaléksorokban álló 0-kat is
+	for (size_t i = 0; i < zones.size(); i++) {
+		if (!staleZones[i])
+			continue;
+		size_t row = i % blocks * ZONE;
+		size_t end = row + ZONE < capacity ? row + ZONE : capacity;
+		const double* p = values.data() + i / blocks * capacity;
+		Zone z = {std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), false};
+		for (; row < end; row++) {
+			if (p[row] < z.min)
+				z.min = p[row];
+			if (p[row] > z.max)
+				z.max = p[row];
+			if (p[row] != p[row])
+				z.nan = true;
+		}
+		zones[i] = z;
+		staleZones[i] = 0;
+	}
+	zonesValid.store(true, std::memory_order_release);
+}
+
+void ValuePlane::conditionalSum(unsigned int col, unsigned int valueCol, long shift, size_t from, size_t to,
+		const Criterion& c, double& sum, size_t& count) const {
+	if (from >= to)
+		return;
+	refreshZones();
+	const Zone* map = zones.data() + col * zoneBlocks();
+	const double* criteria = column(col);
+	const double* values = column(valueCol);
+	for (size_t row = from; row < to;) {
+		size_t block = row / ZONE;
+		size_t end = (block + 1) * ZONE < to ? (block + 1) * ZONE : to;
+		const double* v = values + (long)row + shift;
+		if (covers(c, map[block])) {
+			sum += ValuePlane::sum(v, end - row);
+			count += end - row;
+		} else if (!excludes(c, map[block])) {
+			sumIf(criteria + row, v, end - row, c, sum, count);
+		}
+		row = end;
+	}
+}
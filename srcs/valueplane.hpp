@@ -0,0 +1,161 @@
+#ifndef VALUEPLANE_HPP
+#define VALUEPLANE_HPP
+
+#include <vector>
+#include <set>
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+
+#include "dependency.hpp"
+
+///Egy feltételes összesítés (sumif, countif, avgif) feltétele: összehasonlítás egy küszöbértékkel
+struct Criterion {
+	///az összehasonlítás fajtája (a cella értéke op küszöbérték)
+	enum Op : unsigned char {EQ, NE, LT, LE, GT, GE};
+	Op op; ///<az összehasonlítás
+	double value; ///<a küszöbérték
+	///teljesíti-e az érték a feltételt (a NaN, így a hibaérték sem teljesíti soha)
+	bool matches(double x) const {
+		switch (op) {
+			case EQ: return x == value;
+			case NE: return x < value || x > value;
+			case LT: return x < value;
+			case LE: return x <= value;
+			case GT: return x > value;
+			default: return x >= value;
+		}
+	}
+};
+
+///A konstans cellák értékeit oszlopfolytonosan tároló tömb
+/**
+A tartományon végzett függvények (sum, avg) cellánként egy virtuális kiértékelést
+végeznének, holott a cellák nagy része rendszerint csak egy számot tartalmaz. A ValuePlane
+ezeknek a celláknak az értékét egy összefüggő, oszlopfolytonos double tömbben tartja, így
+egy oszlop egymás alatti konstans celláit egyetlen vektorizált ciklus összegezheti.
+Oszloponként nyilvántartja azokat a sorokat is, ahol a cella képletet tartalmaz, ezeket
+a tömbből nem lehet kiolvasni. A sorokat és oszlopokat 0-tól indexeli. Az oszlopok végén
+tartaléksorok lehetnek, így a tábla aljára fűzött sorok (appendRow) amortizáltan konstans
+időben kerülnek be.
+
+Egy kijelölt téglalap alakú régióra kérésre összegtáblát (summed-area table) is épít: ennek
+minden eleme a régió bal felső sarkától az adott celláig terjedő téglalap konstans celláinak
+összege, így a régióba eső bármely téglalap összege négy kiolvasásból megkapható. A négy
+nagy összeg különbsége kioltással járhat, ezért a tábla elemeit kompenzáltan, kétszeres
+pontossággal (egy kerekített összeg és a kerekítési maradéka) számolja és vonja ki; ha a régió
+értékei a kért összeghez képest még így is túl nagyok, a kiolvasás helyett a hívó közvetlenül
+összegez (ld. indexedSum). Az összegtáblát csak a régión belüli módosítás avulttá, és csak a következő lekérdezés építi
+újra. A lekérdezés több szálról is érkezhet (ld. Sheet::recalculate), az újraépítést egy
+mutex védi.
+
+A feltételes összesítésekhez (ld. conditionalSum) oszloponként ZONE soros blokkokra zónatérképet
+is tart: blokkonként a benne lévő értékek minimumát és maximumát. Egy feltétel a zóna alapján
+kizárhatja a blokkot (pl. >100, ha a maximum 50), ekkor a blokkot nem kell beolvasni, vagy
+lefedheti (minden értéke teljesíti), ekkor a blokk egyszerű összegzés. A zónatérkép az első
+lekérdezéskor épül fel, utána a módosítás csak az érintett blokkot jelöli meg, amelyet a
+következő lekérdezés számol újra.
+*/
+class ValuePlane {
+	std::vector<double> values; ///<a cellák értéke oszlopfolytonosan (a képletcellák helyén 0)
+	std::vector<std::set<unsigned int>> formulaRows; ///<oszloponként a képletet tartalmazó cellák sorai
+	size_t height = 0; ///<egy oszlop hossza
+	size_t capacity = 0; ///<egy oszlop számára lefoglalt hely (a tömbben az oszlopok távolsága)
+
+	bool indexed = false; ///<van-e kijelölt régió az összegtáblához
+	CellRect region = {0, 0, 0, 0}; ///<az összegtábla régiója (1-től indexelve)
+	mutable std::vector<double> prefix; ///<az összegtábla oszlopfolytonosan, egy csupa 0 nulladik sorral és oszloppal
+	mutable std::vector<double> prefixError; ///<az összegtábla elemeinek kerekítési maradéka (a pontos összeg prefix + prefixError)
+	mutable double magnitude = 0; ///<a régió értékeinek abszolútérték-összege (a kiolvasás hibakorlátjához)
+	mutable bool usable = false; ///<használható-e az összegtábla (nem használható, ha a régióban végtelen vagy NaN érték van)
+	mutable bool regionFormulas = false; ///<van-e képletcella a régióban
+	mutable std::atomic<bool> indexValid{false}; ///<naprakész-e az összegtábla
+	mutable std::mutex indexMutex; ///<az összegtábla újraépítését védi
+
+	///egy oszlopblokk értékeinek tartománya (a zónatérkép eleme)
+	struct Zone {
+		double min; ///<legkisebb érték (a NaN-ok nélkül)
+		double max; ///<legnagyobb érték (a NaN-ok nélkül)
+		bool nan; ///<van-e NaN (pl. hibaérték) a blokkban
+	};
+	mutable std::vector<Zone> zones; ///<a zónatérkép oszlopfolytonosan, oszloponként zoneBlocks() blokk
+	mutable std::vector<unsigned char> staleZones; ///<blokkonként: módosult-e a blokk a zóna számolása óta
+	mutable bool zoned = false; ///<felépült-e már a zónatérkép (előtte a módosításokat nem kell jelölni)
+	mutable std::atomic<bool> zonesValid{false}; ///<naprakész-e minden zóna
+	mutable std::mutex zoneMutex; ///<a zónák újraszámolását védi
+
+	void buildIndex() const; ///<az összegtábla újraépítése
+	void touch(unsigned int col, unsigned int row) {
+		if (indexed && region.contains(col + 1, row + 1))
+			indexValid.store(false, std::memory_order_relaxed);
+		if (zoned) {
+			staleZones[col*zoneBlocks() + row/ZONE] = 1;
+			zonesValid.store(false, std::memory_order_relaxed);
+		}
+	} ///<módosításkor a régión belül az összegtáblát, és a blokk zónáját avulttá teszi
+	size_t zoneBlocks() const {return (capacity + ZONE - 1) / ZONE;} ///<egy oszlop blokkjainak száma
+	void dropZones() {zones.clear(); staleZones.clear(); zoned = false; zonesValid = false;} ///<a zónatérkép eldobása (a következő lekérdezés építi újra)
+	void refreshZones() const; ///<a zónatérkép felépítése, illetve az avult zónák újraszámolása
+	static bool excludes(const Criterion& c, const Zone& z); ///<biztosan egyik értéke sem teljesíti-e a feltételt a blokknak
+	static bool covers(const Criterion& c, const Zone& z); ///<biztosan minden értéke teljesíti-e a feltételt a blokknak
+public:
+	static const size_t ZONE = 1024; ///<a zónatérkép egy blokkjának hossza (sor)
+
+	ValuePlane() {} ///<konstruktor
+	ValuePlane(const ValuePlane& plane) {*this = plane;} ///<másoló konstruktor, az összegtáblát a másolat újraépíti
+	ValuePlane& operator=(const ValuePlane& plane); ///<értékadó operátor, az összegtáblát a másolat újraépíti
+	void swap(ValuePlane& plane); ///<két tömb tartalmának cseréje (az összegtáblákkal együtt, a zónatérképeket a következő lekérdezés építi újra)
+	void reset(size_t width, size_t height); ///<adott méretű, csupa 0 értékű tömb létrehozása (a régió megmarad, ha belefér)
+	void appendRow(); ///<egy csupa 0 értékű sor hozzáfűzése (ha elfogyott a tartalék, kétszeres kapacitással újrafoglal)
+	///konstans cella értékének beállítása
+	void setNumber(unsigned int col, unsigned int row, double value) {
+		values[col*capacity + row] = value;
+		if (!formulaRows[col].empty())
+			formulaRows[col].erase(row);
+		touch(col, row);
+	}
+	///a cella képletet tartalmaz, az értékét nem ebből a tömbből kell olvasni
+	void setFormula(unsigned int col, unsigned int row) {values[col*capacity + row] = 0; formulaRows[col].insert(row); touch(col, row);}
+	const double* column(unsigned int col) const {return values.data() + col*capacity;} ///<adott oszlop első eleme
+	const std::set<unsigned int>& formulas(unsigned int col) const {return formulaRows[col];}
+		///<adott oszlop képletcelláinak sorai növekvő sorrendben
+
+	///n darab egymás utáni szám összege
+	/**AVX támogatással fordítva (pl. -mavx vagy -march=native) 256 bites, egyébként SSE2
+	(x86-64-en mindig elérhető) 128 bites vektorokkal összegez, két független akkumulátorral.
+	Más architektúrán skaláris ciklus fut.*/
+	static double sum(const double* p, size_t n);
+
+	///összegtábla régiójának kijelölése (1-től indexelve), a tábla az első lekérdezéskor épül fel
+	/**@return hamis, ha a régió nem fér bele a tömbbe (ekkor nincs összegtábla)*/
+	bool setIndexRegion(const CellRect& r);
+	void clearIndex() {indexed = false; indexValid = false; prefix.clear(); prefixError.clear();} ///<az összegtábla megszüntetése
+	bool hasIndex() const {return indexed;} ///<van-e kijelölt régió
+	const CellRect& indexRegion() const {return region;} ///<a kijelölt régió
+	///téglalap konstans celláinak összege az összegtáblából (1-től indexelve)
+	/**Ha szükséges, előbb újraépíti az összegtáblát.
+	@param hasFormulas - igazra állítja, ha a régióban képletcella is van (ezeket a hívónak kell hozzáadnia)
+	@return hamis, ha a téglalap nincs a régióban, az összegtábla nem használható, vagy a régió értékeihez
+	képest kis összeg nem olvasható ki belőle megbízhatóan (ezekben az esetekben közvetlenül kell összegezni)*/
+	bool indexedSum(const CellRect& r, double& sum, bool& hasFormulas) const;
+
+	///n darab szám közül a feltételt teljesítők száma és a hozzájuk tartozó értékek összege
+	/**A criteria[i] értéket vizsgálja, és feltétel teljesülésekor a values[i]-t adja az összeghez
+	(a két tömb lehet azonos). A sum-hoz hasonlóan AVX-szel, illetve SSE2-vel vektorizált: a
+	vektoros összehasonlítás maszkjával nullázza a nem teljesülő elemeket, így elágazás nélkül
+	összegez és számol. Az eredményt sum-hoz és count-hoz adja.*/
+	static void sumIf(const double* criteria, const double* values, size_t n, const Criterion& c, double& sum, size_t& count);
+	///egy oszlop konstans szakaszának feltételes összege a zónatérkép alapján (a sorok 0-tól indexelve)
+	/**A [from, to) sorokat ZONE soros blokkonként dolgozza fel: a feltételt biztosan nem teljesítő
+	blokkokat átugorja, a biztosan teljesítőket egyszerűen összegzi, a többit a sumIf vizsgálja. A
+	hívónak kell gondoskodnia róla, hogy a szakaszban ne legyen képletcella egyik oszlopban sem.
+	Ha szükséges, előbb felépíti, illetve frissíti a zónatérképet.
+	@param col - a feltétel oszlopa
+	@param valueCol - az összegzett oszlop
+	@param shift - a feltétel sorához tartozó összegzett sor eltolása
+	@param sum, count - ide adja hozzá a feltételt teljesítő értékek összegét és számát*/
+	void conditionalSum(unsigned int col, unsigned int valueCol, long shift, size_t from, size_t to,
+		const Criterion& c, double& sum, size_t& count) const;
+};
+
+#endif